@@ -10,8 +10,14 @@ in vec3 vNormal;    //Normal in view space
 in vec3 vPos;       //Position of the fragment in camera coordinates
 in vec2 vTexCoord;  //Texture coordinate of the fragment
 in vec3 vTangent;   //Tangent in view space
+in float vHandedness; //Sign of the bitangent
 
-uniform vec3 lightPosition;         //Position of the light in camera coordinates
+//Per-frame data shared by all programs, one std140 uniform buffer at CAMERA_UNIFORM_BINDING (see shader.h)
+layout(std140) uniform Camera {
+	mat4 projection;    //Projection matrix
+	mat4 view;          //View matrix
+	vec4 lightPosition; //Position of the light in camera coordinates, w is 1
+};
 
 uniform bool useDiffuse;
 uniform bool useNormal;
@@ -27,7 +33,7 @@ void main() {
 	if (useNormal) {
 		vec3 n = normal;
 		vec3 t = normalize(vTangent - n * dot(vTangent, n));
-		vec3 b = cross(n, t);
+		vec3 b = vHandedness * cross(n, t);
 
 		// TODO(3.4): Implement normal mapping.
 
@@ -38,7 +44,7 @@ void main() {
 
 	// The lighting is performed in view-space, so the camera is located in the origin.
 	vec3 viewDir = normalize(vec3(0, 0, 0) - vPos);
-	vec3 lightDir = normalize(lightPosition - vPos);
+	vec3 lightDir = normalize(lightPosition.xyz - vPos);
 	vec3 halfView = normalize(lightDir + viewDir);
 
 	float ambientIntensity = 0.1;
@@ -4,11 +4,20 @@ layout(location = 0) in vec3 position; //Vertex position in object coordinates
 layout(location = 1) in vec3 normal;   //Vertex normal
 layout(location = 2) in vec3 color;    //Per-vertex color (for coloring using color array). Note that the vertex array gets disabled when STATIC_COLOR is used. This means that a standard value is inserted here.
 layout(location = 3) in vec2 texCoord; //Texture coordinate (for using textures)
-layout(location = 4) in vec3 tangent;
+layout(location = 4) in vec4 tangent; //Tangent and handedness of the bitangent, w is 1 if the mesh has no tangents
+
+//Per-frame data shared by all programs, one std140 uniform buffer at CAMERA_UNIFORM_BINDING (see shader.h)
+layout(std140) uniform Camera {
+	mat4 projection;    //Projection matrix
+	mat4 view;          //View matrix
+	vec4 lightPosition; //Position of the light in camera coordinates, w is 1
+};
 
 uniform mat4 modelView;     //ModelView matrix
-uniform mat4 projection;    //Projection matrix
 uniform mat3 normalMatrix;  //The transpose inverse of the ModelView matrix, used for transformation of normals.
+//Dequantization of 16 bit positions, see only_mvp.vert
+uniform vec3 positionScale = vec3(1.0);
+uniform vec3 positionOffset = vec3(0.0);
 
 uniform bool useDisplacement;
 
@@ -19,9 +28,10 @@ out vec3 vNormal;   //Per-vertex normal, transformed
 out vec3 vPos;      //Position in camera coordinates
 out vec2 vTexCoord; //Texture coordinate of current vertex
 out vec3 vTangent;  //Per-vertex tangent, in view space
+out float vHandedness; //Sign of the bitangent, -1 for mirrored texture coordinates
 
 void main() {
-	vec3 pos = position;
+	vec3 pos = positionOffset + positionScale * position;
 
 	// TODO(3.4): Implement displacement mapping.
 	if(useDisplacement){
@@ -36,5 +46,6 @@ void main() {
 	vColor = color;
 	vNormal = normalMatrix * normal;
 	vTexCoord = texCoord;
-	vTangent = normalize(vec3(modelView * vec4(tangent, 0.0)));
+	vTangent = normalize(vec3(modelView * vec4(tangent.xyz, 0.0)));
+	vHandedness = tangent.w < 0.0 ? -1.0 : 1.0;
 }
@@ -0,0 +1,38 @@
+#version 330 core
+
+/*
+This vertex shader draws many copies of a mesh with one draw call, see TriangleMesh::drawInstanced. Every copy has its own model matrix and color as per-instance attributes, they are transformed by the view matrix of the Camera block. OpenGLView links it with the fragment shader of every selectable program, so it provides the outputs of only_mvp.vert.
+*/
+
+layout(location = 0) in vec3 position;       //Vertex position in model coordinates
+layout(location = 1) in vec3 normal;         //Vertex normal
+layout(location = 3) in vec2 texCoord;       //Texture coordinate (for using textures)
+layout(location = 5) in mat4 instanceModel;  //Model matrix of the instance, takes the locations 5 to 8
+layout(location = 9) in vec3 instanceColor;  //Color of the instance, replaces the per-vertex color
+
+//Per-frame data shared by all programs, one std140 uniform buffer at CAMERA_UNIFORM_BINDING (see shader.h)
+layout(std140) uniform Camera {
+    mat4 projection;    //Projection matrix
+    mat4 view;          //View matrix
+    vec4 lightPosition; //Position of the light in camera coordinates, w is 1
+};
+//Dequantization of 16 bit positions, see only_mvp.vert
+uniform vec3 positionScale = vec3(1.0);
+uniform vec3 positionOffset = vec3(0.0);
+
+out vec3 vColor;    //Per-instance color
+out vec3 vNormal;   //Per-vertex normal, transformed
+out vec3 vPos;      //Position in camera coordinates
+out vec2 vTexCoord; //Texture coordinate of current vertex
+
+void main() {
+    vec3 pos = positionOffset + positionScale * position;
+    mat4 instanceModelView = view * instanceModel;
+    vec4 tempPos = instanceModelView * vec4(pos, 1.0);
+    gl_Position = projection * tempPos;
+    vPos = tempPos.xyz / tempPos.w; //inhomogenous coordinates
+    vColor = instanceColor;
+    //The instances are only rotated, translated and uniformly scaled, so the upper 3x3 part can transform normals.
+    vNormal = normalize(mat3(instanceModelView) * normal);
+    vTexCoord = texCoord;
+}
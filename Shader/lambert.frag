@@ -10,7 +10,13 @@ in vec3 vNormal;    //Normal of the fragment
 in vec3 vPos;       //Position of the fragment in camera coordinates
 in vec2 vTexCoord;  //Texture coordinate of the fragment
 
-uniform vec3 lightPosition;         //Position of the light in camera coordinates
+//Per-frame data shared by all programs, one std140 uniform buffer at CAMERA_UNIFORM_BINDING (see shader.h)
+layout(std140) uniform Camera {
+    mat4 projection;    //Projection matrix
+    mat4 view;          //View matrix
+    vec4 lightPosition; //Position of the light in camera coordinates, w is 1
+};
+
 uniform bool useTexture;            //Flag whether to use a texture instead of per-vertex colors
 uniform sampler2D diffuseTexture;   //Texture to use
 
@@ -19,7 +25,7 @@ out vec4 color;
 
 void main() {
     //Calculate the direction of the light.
-    vec3 lightDir = normalize(lightPosition - vPos);
+    vec3 lightDir = normalize(lightPosition.xyz - vPos);
     //Calculate Lambertian intensity. We clamp at 0.1 in order to simulate some kind of ambient light
     //Please note that both vectors are normalized, so the dot is the cosine of the encapsulated angle.
     float intensity = max(dot(lightDir, vNormal), 0.05);
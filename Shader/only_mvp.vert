@@ -9,9 +9,19 @@ layout(location = 1) in vec3 normal;   //Vertex normal
 layout(location = 2) in vec3 color;    //Per-vertex color (for coloring using color array). Note that the vertex array gets disabled when STATIC_COLOR is used. This means that a standard value is inserted here.
 layout(location = 3) in vec2 texCoord; //Texture coordinate (for using textures)
 
+//Per-frame data shared by all programs, one std140 uniform buffer at CAMERA_UNIFORM_BINDING (see shader.h)
+layout(std140) uniform Camera {
+    mat4 projection;    //Projection matrix
+    mat4 view;          //View matrix
+    vec4 lightPosition; //Position of the light in camera coordinates, w is 1
+};
+
 uniform mat4 modelView;     //ModelView matrix
-uniform mat4 projection;    //Projection matrix
 uniform mat3 normalMatrix;  //The transpose inverse of the ModelView matrix, used for transformation of normals.
+//Quantized meshes store positions as 16 bit values in [0,1] relative to their bounding box. The mesh sets these
+//only while it is drawn, all other meshes use the defaults.
+uniform vec3 positionScale = vec3(1.0);
+uniform vec3 positionOffset = vec3(0.0);
 
 out vec3 vColor;    //Per-vertex color
 out vec3 vNormal;   //Per-vertex normal, transformed
@@ -19,8 +29,9 @@ out vec3 vPos;      //Position in camera coordinates
 out vec2 vTexCoord; //Texture coordinate of current vertex
 
 void main() {
-    gl_Position = projection * modelView * vec4(position, 1.0);
-    vec4 tempPos = modelView * vec4(position, 1.0);
+    vec3 pos = positionOffset + positionScale * position;
+    gl_Position = projection * modelView * vec4(pos, 1.0);
+    vec4 tempPos = modelView * vec4(pos, 1.0);
     vPos = tempPos.xyz / tempPos.w; //inhomogenous coordinates
     vColor = color;
     vNormal = normalMatrix * normal;
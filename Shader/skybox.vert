@@ -4,10 +4,15 @@ layout (location = 0) in vec3 aPos;
 
 out vec3 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+//Per-frame data shared by all programs, one std140 uniform buffer at CAMERA_UNIFORM_BINDING (see shader.h)
+layout(std140) uniform Camera {
+	mat4 projection;    //Projection matrix
+	mat4 view;          //View matrix
+	vec4 lightPosition; //Position of the light in camera coordinates, w is 1
+};
 
 void main() {
 	TexCoords = aPos;
-	gl_Position = projection * view * vec4(aPos, 1.0);
+	//only the rotation of the camera, the skybox is infinitely far away
+	gl_Position = projection * mat4(mat3(view)) * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,440 @@
+// ========================================================================= //
+// GRIS - Graphisch Interaktive Systeme                                      //
+// Technische Universität Darmstadt                                          //
+// Fraunhoferstrasse 5                                                       //
+// D-64283 Darmstadt, Germany                                                //
+//                                                                           //
+// Content: Bounding volume hierarchy over the triangles of a mesh           //
+// ========================================================================= //
+
+#include "bvh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BVH_USE_SSE
+#endif
+
+#include "parallel.h"
+
+namespace {
+
+const uint32_t LEAF_BIT = 0x80000000u;
+const unsigned int LEAF_COUNT_BITS = 4;
+const uint32_t LEAF_COUNT_MASK = (1u << LEAF_COUNT_BITS) - 1;
+static_assert(BVH_MAX_LEAF_TRIANGLES <= LEAF_COUNT_MASK, "leaf size does not fit into the child index");
+static_assert(BVH_MAX_TRIANGLES <= (size_t(LEAF_BIT) >> LEAF_COUNT_BITS), "first triangle does not fit into the child index");
+
+// Ranges of at most this many triangles are built by one thread.
+const size_t BVH_SUBTREE_SIZE = 1 << 14;
+// Triangles per block when the large ranges at the top are binned in parallel.
+const size_t BVH_BINNING_BLOCK_SIZE = 1 << 16;
+// Deeper ranges are split at the median instead of by the SAH. That bounds the depth of degenerate inputs, and so
+// the traversal stack.
+const unsigned int BVH_MAX_SAH_DEPTH = 40;
+const unsigned int TRAVERSAL_STACK_SIZE = 256;
+
+struct Box {
+    Vec3f lower{ FLT_MAX }, upper{ -FLT_MAX };
+
+    void grow(const Vec3f& p) {
+        for (unsigned int c = 0; c < 3; ++c) {
+            lower[c] = std::min(lower[c], p[c]);
+            upper[c] = std::max(upper[c], p[c]);
+        }
+    }
+    void grow(const Box& box) {
+        for (unsigned int c = 0; c < 3; ++c) {
+            lower[c] = std::min(lower[c], box.lower[c]);
+            upper[c] = std::max(upper[c], box.upper[c]);
+        }
+    }
+    float area() const {
+        if (lower[0] > upper[0]) return 0.0f;
+        const Vec3f d = upper - lower;
+        return 2.0f * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+    }
+};
+
+// Node of the binary hierarchy the 4-wide nodes are collapsed from. Leaves have count > 0.
+struct BuildNode {
+    Box bounds;
+    uint32_t left, right;
+    uint32_t first, count;
+};
+
+struct Bin {
+    Box bounds;
+    unsigned int count{0};
+};
+
+// Bins of all three axes over the centroid bounds of a range.
+struct Bins {
+    Bin bins[3][BVH_BINS];
+
+    void merge(const Bins& other) {
+        for (unsigned int axis = 0; axis < 3; ++axis)
+            for (unsigned int b = 0; b < BVH_BINS; ++b) {
+                bins[axis][b].bounds.grow(other.bins[axis][b].bounds);
+                bins[axis][b].count += other.bins[axis][b].count;
+            }
+    }
+};
+
+// Range of triangles whose subtree is built on a worker thread, node is the placeholder of its root.
+struct SubtreeTask {
+    uint32_t node;
+    uint32_t first, count;
+    unsigned int depth;
+};
+
+class Builder {
+    const std::vector<Box>& boxes;
+    const std::vector<Vec3f>& centroids;
+    std::vector<unsigned int>& order;
+
+    // runs fn(begin, end) over [first, first + count), on several threads if parallel is set
+    template<typename Fn>
+    void forRange(size_t first, size_t count, bool parallel, const Fn& fn) const {
+        if (parallel) parallelFor(count, BVH_BINNING_BLOCK_SIZE, [&](size_t begin, size_t end) { fn(first + begin, first + end); });
+        else fn(first, first + count);
+    }
+
+    unsigned int binOf(const Vec3f& centroid, unsigned int axis, const Box& centroidBounds, float scale) const {
+        const int bin = static_cast<int>((centroid[axis] - centroidBounds.lower[axis]) * scale);
+        return static_cast<unsigned int>(std::min(std::max(bin, 0), static_cast<int>(BVH_BINS) - 1));
+    }
+
+public:
+    Builder(const std::vector<Box>& boxes, const std::vector<Vec3f>& centroids, std::vector<unsigned int>& order)
+        : boxes(boxes), centroids(centroids), order(order) {}
+
+    // Builds the subtree of order[first, first + count) into nodes and returns the index of its root. If tasks is
+    // set, ranges of at most BVH_SUBTREE_SIZE triangles are only reserved and left to the workers, and the larger
+    // ones are binned in parallel.
+    uint32_t build(std::vector<BuildNode>& nodes, uint32_t first, uint32_t count, unsigned int depth, std::vector<SubtreeTask>* tasks) {
+        const uint32_t index = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(BuildNode{ Box(), 0, 0, first, count });
+        if (tasks && count <= BVH_SUBTREE_SIZE) {
+            tasks->push_back(SubtreeTask{ index, first, count, depth });
+            return index;
+        }
+        const bool parallel = tasks != nullptr;
+
+        Box bounds, centroidBounds;
+        std::mutex mutex;
+        forRange(first, count, parallel, [&](size_t begin, size_t end) {
+            Box blockBounds, blockCentroids;
+            for (size_t i = begin; i < end; ++i) {
+                blockBounds.grow(boxes[order[i]]);
+                blockCentroids.grow(centroids[order[i]]);
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            bounds.grow(blockBounds);
+            centroidBounds.grow(blockCentroids);
+        });
+        nodes[index].bounds = bounds;
+        if (count == 1) return index;
+
+        const Vec3f extent = centroidBounds.upper - centroidBounds.lower;
+        const unsigned int widestAxis = extent[0] >= extent[1] && extent[0] >= extent[2] ? 0 : (extent[1] >= extent[2] ? 1 : 2);
+        uint32_t middle = first;
+        if (extent[widestAxis] <= 0.0f) {
+            // all centroids coincide, no plane separates them
+            if (count <= BVH_MAX_LEAF_TRIANGLES) return index;
+            middle = first + count / 2;
+        } else if (depth >= BVH_MAX_SAH_DEPTH) {
+            if (count <= BVH_MAX_LEAF_TRIANGLES) return index;
+            middle = first + count / 2;
+            std::nth_element(order.begin() + first, order.begin() + middle, order.begin() + first + count,
+                             [&](unsigned int a, unsigned int b) { return centroids[a][widestAxis] < centroids[b][widestAxis]; });
+        } else {
+            Bins bins;
+            float scales[3];
+            for (unsigned int axis = 0; axis < 3; ++axis) scales[axis] = extent[axis] > 0.0f ? BVH_BINS / extent[axis] : 0.0f;
+            forRange(first, count, parallel, [&](size_t begin, size_t end) {
+                Bins blockBins;
+                for (size_t i = begin; i < end; ++i)
+                    for (unsigned int axis = 0; axis < 3; ++axis) {
+                        Bin& bin = blockBins.bins[axis][binOf(centroids[order[i]], axis, centroidBounds, scales[axis])];
+                        bin.bounds.grow(boxes[order[i]]);
+                        ++bin.count;
+                    }
+                std::lock_guard<std::mutex> lock(mutex);
+                bins.merge(blockBins);
+            });
+
+            // cost of splitting after bin b, sweeping from the right and then from the left
+            float bestCost = FLT_MAX;
+            unsigned int bestAxis = 0, bestBin = 0;
+            for (unsigned int axis = 0; axis < 3; ++axis) {
+                if (extent[axis] <= 0.0f) continue;
+                float rightCosts[BVH_BINS];
+                Box right;
+                unsigned int rightCount = 0;
+                for (unsigned int b = BVH_BINS - 1; b > 0; --b) {
+                    right.grow(bins.bins[axis][b].bounds);
+                    rightCount += bins.bins[axis][b].count;
+                    rightCosts[b] = right.area() * rightCount;
+                }
+                Box left;
+                unsigned int leftCount = 0;
+                for (unsigned int b = 0; b + 1 < BVH_BINS; ++b) {
+                    left.grow(bins.bins[axis][b].bounds);
+                    leftCount += bins.bins[axis][b].count;
+                    const float cost = left.area() * leftCount + rightCosts[b + 1];
+                    if (leftCount > 0 && leftCount < count && cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestBin = b;
+                    }
+                }
+            }
+            const float area = bounds.area();
+            const float splitCost = BVH_TRAVERSAL_COST + (area > 0.0f ? bestCost / area : 0.0f);
+            if (count <= BVH_MAX_LEAF_TRIANGLES && static_cast<float>(count) <= splitCost) return index;
+            middle = static_cast<uint32_t>(std::partition(order.begin() + first, order.begin() + first + count, [&](unsigned int t) {
+                return binOf(centroids[t], bestAxis, centroidBounds, scales[bestAxis]) <= bestBin;
+            }) - order.begin());
+            if (middle == first || middle == first + count) middle = first + count / 2;
+        }
+
+        const uint32_t left = build(nodes, first, middle - first, depth + 1, tasks);
+        const uint32_t right = build(nodes, middle, first + count - middle, depth + 1, tasks);
+        nodes[index].left = left;
+        nodes[index].right = right;
+        nodes[index].count = 0;
+        return index;
+    }
+};
+
+uint32_t leafChild(const BuildNode& leaf) {
+    return LEAF_BIT | (leaf.first << LEAF_COUNT_BITS) | leaf.count;
+}
+
+} // namespace
+
+void TriangleBVH::build(const Vec3f* vertices, const Vec3ui* triangles, size_t numTriangles) {
+    clear();
+    if (numTriangles == 0) return;
+    if (numTriangles > BVH_MAX_TRIANGLES) {
+        std::cout << "TriangleBVH::build: " << numTriangles << " triangles exceed the limit of " << BVH_MAX_TRIANGLES
+                  << ", no hierarchy is built" << std::endl;
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<Box> boxes(numTriangles);
+    std::vector<Vec3f> centroids(numTriangles);
+    parallelFor(numTriangles, BVH_BINNING_BLOCK_SIZE, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) {
+            for (unsigned int k = 0; k < 3; ++k) boxes[t].grow(vertices[triangles[t][k]]);
+            centroids[t] = 0.5f * (boxes[t].lower + boxes[t].upper);
+        }
+    });
+    std::vector<unsigned int> order(numTriangles);
+    std::iota(order.begin(), order.end(), 0u);
+
+    // the top of the hierarchy is split on the calling thread, binning in parallel. the subtrees below are built by
+    // the workers into their own node arrays, which are appended afterwards.
+    Builder builder(boxes, centroids, order);
+    std::vector<BuildNode> binaryNodes;
+    std::vector<SubtreeTask> tasks;
+    const bool parallel = workerThreadCount() > 1 && numTriangles > BVH_SUBTREE_SIZE;
+    builder.build(binaryNodes, 0, static_cast<uint32_t>(numTriangles), 0, parallel ? &tasks : nullptr);
+    if (!tasks.empty()) {
+        std::vector<std::vector<BuildNode>> subtrees(tasks.size());
+        std::atomic<size_t> nextTask(0);
+        runParallel(static_cast<unsigned int>(std::min<size_t>(workerThreadCount(), tasks.size())), [&](unsigned int) {
+            for (size_t i = nextTask++; i < tasks.size(); i = nextTask++)
+                builder.build(subtrees[i], tasks[i].first, tasks[i].count, tasks[i].depth, nullptr);
+        });
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            // node j > 0 of the subtree moves to offset + j - 1, its root replaces the placeholder
+            const uint32_t offset = static_cast<uint32_t>(binaryNodes.size());
+            for (BuildNode& node : subtrees[i]) {
+                if (node.count > 0) continue;
+                node.left += offset - 1;
+                node.right += offset - 1;
+            }
+            binaryNodes[tasks[i].node] = subtrees[i][0];
+            binaryNodes.insert(binaryNodes.end(), subtrees[i].begin() + 1, subtrees[i].end());
+        }
+    }
+
+    // every 4-wide node takes the children of a binary node and opens the largest inner children until it has four
+    auto emptyNode = []() {
+        Node4 node;
+        for (unsigned int lane = 0; lane < 4; ++lane) {
+            node.minX[lane] = node.minY[lane] = node.minZ[lane] = FLT_MAX;
+            node.maxX[lane] = node.maxY[lane] = node.maxZ[lane] = -FLT_MAX;
+            node.child[lane] = LEAF_BIT;
+        }
+        return node;
+    };
+    auto setLane = [](Node4& node, unsigned int lane, const Box& bounds, uint32_t child) {
+        node.minX[lane] = bounds.lower[0];
+        node.minY[lane] = bounds.lower[1];
+        node.minZ[lane] = bounds.lower[2];
+        node.maxX[lane] = bounds.upper[0];
+        node.maxY[lane] = bounds.upper[1];
+        node.maxZ[lane] = bounds.upper[2];
+        node.child[lane] = child;
+    };
+    std::function<uint32_t(uint32_t)> collapse = [&](uint32_t binaryIndex) {
+        const uint32_t index = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(emptyNode());
+        uint32_t children[4] = { binaryNodes[binaryIndex].left, binaryNodes[binaryIndex].right, 0, 0 };
+        unsigned int numChildren = 2;
+        while (numChildren < 4) {
+            int largest = -1;
+            for (unsigned int i = 0; i < numChildren; ++i) {
+                const BuildNode& child = binaryNodes[children[i]];
+                if (child.count == 0 && (largest < 0 || child.bounds.area() > binaryNodes[children[largest]].bounds.area()))
+                    largest = static_cast<int>(i);
+            }
+            if (largest < 0) break;
+            const BuildNode& opened = binaryNodes[children[largest]];
+            children[largest] = opened.left;
+            children[numChildren++] = opened.right;
+        }
+        Node4 node = emptyNode();
+        for (unsigned int lane = 0; lane < numChildren; ++lane) {
+            const BuildNode& child = binaryNodes[children[lane]];
+            setLane(node, lane, child.bounds, child.count > 0 ? leafChild(child) : collapse(children[lane]));
+        }
+        nodes[index] = node;
+        return index;
+    };
+    if (binaryNodes[0].count > 0) {
+        nodes.push_back(emptyNode());
+        setLane(nodes[0], 0, binaryNodes[0].bounds, leafChild(binaryNodes[0]));
+    } else {
+        collapse(0);
+    }
+
+    packedTriangles.resize(numTriangles);
+    parallelFor(numTriangles, BVH_BINNING_BLOCK_SIZE, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const Vec3ui& triangle = triangles[order[i]];
+            const Vec3f& v0 = vertices[triangle[0]];
+            packedTriangles[i] = PackedTriangle{ v0, vertices[triangle[1]] - v0, vertices[triangle[2]] - v0, order[i] };
+        }
+    });
+    buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void TriangleBVH::clear() {
+    nodes.clear();
+    packedTriangles.clear();
+    buildSeconds = 0.0;
+}
+
+bool TriangleBVH::traverse(const Vec3f& origin, const Vec3f& direction, float maxDistance, bool anyHit, RayHit& hit) const {
+    if (nodes.empty()) return false;
+
+    // zero components would give an infinite inverse and NaN for boxes in the plane of the origin
+    Vec3f inverse;
+    bool negative[3];
+    for (unsigned int c = 0; c < 3; ++c) {
+        const float d = std::fabs(direction[c]) < 1e-30f ? std::copysign(1e-30f, direction[c]) : direction[c];
+        inverse[c] = 1.0f / d;
+        negative[c] = d < 0.0f;
+    }
+    float closest = maxDistance;
+    bool found = false;
+
+    uint32_t stack[TRAVERSAL_STACK_SIZE];
+    unsigned int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const uint32_t child = stack[--stackSize];
+        if (child & LEAF_BIT) {
+            const uint32_t first = (child & ~LEAF_BIT) >> LEAF_COUNT_BITS, end = first + (child & LEAF_COUNT_MASK);
+            for (uint32_t i = first; i < end; ++i) {
+                // Moeller-Trumbore, both sides
+                const PackedTriangle& triangle = packedTriangles[i];
+                const Vec3f p = cross(direction, triangle.edge2);
+                const float determinant = triangle.edge1 * p;
+                if (determinant == 0.0f) continue;
+                const float inverseDeterminant = 1.0f / determinant;
+                const Vec3f s = origin - triangle.v0;
+                const float u = (s * p) * inverseDeterminant;
+                if (u < 0.0f || u > 1.0f) continue;
+                const Vec3f q = cross(s, triangle.edge1);
+                const float v = (direction * q) * inverseDeterminant;
+                if (v < 0.0f || u + v > 1.0f) continue;
+                const float t = (triangle.edge2 * q) * inverseDeterminant;
+                if (t < 0.0f || t > closest) continue;
+                closest = t;
+                hit = RayHit{ t, triangle.index, u, v };
+                found = true;
+                if (anyHit) return true;
+            }
+            continue;
+        }
+
+        // slabs of the four children. the near plane of an axis is the minimum for positive directions, so the
+        // inverted bounds of unused children never overlap.
+        const Node4& node = nodes[child];
+        const float* nearX = negative[0] ? node.maxX : node.minX;
+        const float* farX = negative[0] ? node.minX : node.maxX;
+        const float* nearY = negative[1] ? node.maxY : node.minY;
+        const float* farY = negative[1] ? node.minY : node.maxY;
+        const float* nearZ = negative[2] ? node.maxZ : node.minZ;
+        const float* farZ = negative[2] ? node.minZ : node.maxZ;
+        float entry[4];
+        int hitMask = 0;
+#ifdef BVH_USE_SSE
+        const __m128 ox = _mm_set1_ps(origin[0]), oy = _mm_set1_ps(origin[1]), oz = _mm_set1_ps(origin[2]);
+        const __m128 ix = _mm_set1_ps(inverse[0]), iy = _mm_set1_ps(inverse[1]), iz = _mm_set1_ps(inverse[2]);
+        const __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(nearX), ox), ix),
+                                                   _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(nearY), oy), iy)),
+                                        _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(nearZ), oz), iz), _mm_setzero_ps()));
+        const __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(farX), ox), ix),
+                                                  _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(farY), oy), iy)),
+                                       _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(farZ), oz), iz), _mm_set1_ps(closest)));
+        hitMask = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+        _mm_storeu_ps(entry, tNear);
+#else
+        for (unsigned int lane = 0; lane < 4; ++lane) {
+            const float tNear = std::max(std::max((nearX[lane] - origin[0]) * inverse[0], (nearY[lane] - origin[1]) * inverse[1]),
+                                         std::max((nearZ[lane] - origin[2]) * inverse[2], 0.0f));
+            const float tFar = std::min(std::min((farX[lane] - origin[0]) * inverse[0], (farY[lane] - origin[1]) * inverse[1]),
+                                        std::min((farZ[lane] - origin[2]) * inverse[2], closest));
+            entry[lane] = tNear;
+            if (tNear <= tFar) hitMask |= 1 << lane;
+        }
+#endif
+        if (hitMask == 0) continue;
+
+        // push the farthest child first, so that the nearest one is visited next and shortens the ray early
+        unsigned int lanes[4], numLanes = 0;
+        for (unsigned int lane = 0; lane < 4; ++lane) {
+            if (!(hitMask & (1 << lane))) continue;
+            unsigned int i = numLanes++;
+            for (; i > 0 && entry[lanes[i - 1]] < entry[lane]; --i) lanes[i] = lanes[i - 1];
+            lanes[i] = lane;
+        }
+        for (unsigned int i = 0; i < numLanes; ++i) stack[stackSize++] = node.child[lanes[i]];
+    }
+    return found;
+}
+
+bool TriangleBVH::intersect(const Vec3f& origin, const Vec3f& direction, float maxDistance, RayHit& hit) const {
+    return traverse(origin, direction, maxDistance, false, hit);
+}
+
+bool TriangleBVH::occluded(const Vec3f& origin, const Vec3f& direction, float maxDistance) const {
+    RayHit hit;
+    return traverse(origin, direction, maxDistance, true, hit);
+}
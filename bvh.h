@@ -0,0 +1,78 @@
+// ========================================================================= //
+// GRIS - Graphisch Interaktive Systeme                                      //
+// Technische Universität Darmstadt                                          //
+// Fraunhoferstrasse 5                                                       //
+// D-64283 Darmstadt, Germany                                                //
+//                                                                           //
+// Content: Bounding volume hierarchy over the triangles of a mesh           //
+//   * binned SAH build, subtrees on several threads                         //
+//   * collapsed into 4-wide nodes, boxes tested four at once with SSE       //
+//   * closest hit and any hit ray queries                                   //
+// ========================================================================= //
+
+#ifndef BVH_H
+#define BVH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "vec3.h"
+
+// Number of bins per axis the SAH split is chosen from.
+const unsigned int BVH_BINS = 16;
+// Leaves hold at most this many triangles. Larger leaves are split even if the SAH prefers a leaf.
+const unsigned int BVH_MAX_LEAF_TRIANGLES = 8;
+// Cost of visiting a node relative to intersecting one triangle.
+const float BVH_TRAVERSAL_COST = 1.0f;
+// Largest number of triangles a hierarchy can hold, the index of the first triangle of a leaf has 27 bits.
+const size_t BVH_MAX_TRIANGLES = size_t(1) << 27;
+
+// Closest intersection of a ray. u and v are the barycentric coordinates of corners 1 and 2 of the triangle.
+struct RayHit {
+    float t;
+    unsigned int triangle;
+    float u, v;
+};
+
+class TriangleBVH {
+    // bounds of four children as structure of arrays. a child is the index of an inner node, or a leaf with
+    // LEAF_BIT set, the first triangle above LEAF_COUNT_BITS and the number of triangles below. unused children are
+    // empty leaves with inverted bounds.
+    struct Node4 {
+        float minX[4], minY[4], minZ[4];
+        float maxX[4], maxY[4], maxZ[4];
+        uint32_t child[4];
+    };
+    // triangle prepared for Moeller-Trumbore
+    struct PackedTriangle {
+        Vec3f v0, edge1, edge2;
+        unsigned int index;
+    };
+
+    std::vector<Node4> nodes;
+    std::vector<PackedTriangle> packedTriangles;
+    double buildSeconds{0.0};
+
+    bool traverse(const Vec3f& origin, const Vec3f& direction, float maxDistance, bool anyHit, RayHit& hit) const;
+
+public:
+    // Builds the hierarchy over the triangles, replacing the previous one. Meshes of more than BVH_MAX_TRIANGLES
+    // triangles are refused, the hierarchy stays empty and every query misses.
+    void build(const Vec3f* vertices, const Vec3ui* triangles, size_t numTriangles);
+    void clear();
+
+    bool isBuilt() const { return !nodes.empty(); }
+    size_t getNumNodes() const { return nodes.size(); }
+    size_t getMemoryBytes() const { return nodes.size() * sizeof(Node4) + packedTriangles.size() * sizeof(PackedTriangle); }
+    // wall clock time of the last build
+    double getBuildSeconds() const { return buildSeconds; }
+
+    // Closest intersection with origin + t * direction for t in [0, maxDistance]. direction does not need to be
+    // normalized, t is measured in multiples of it. Both sides of the triangles are hit.
+    bool intersect(const Vec3f& origin, const Vec3f& direction, float maxDistance, RayHit& hit) const;
+    // Whether any triangle is hit for t in [0, maxDistance], cheaper than intersect since it stops at the first hit.
+    bool occluded(const Vec3f& origin, const Vec3f& direction, float maxDistance) const;
+};
+
+#endif // BVH_H
@@ -0,0 +1,152 @@
+// ========================================================================= //
+// GRIS - Graphisch Interaktive Systeme                                      //
+// Technische Universität Darmstadt                                          //
+// Fraunhoferstrasse 5                                                       //
+// D-64283 Darmstadt, Germany                                                //
+//                                                                           //
+// Content: Benchmark of the ray queries against the triangle BVH            //
+//   * builds the BVH of a generated terrain and of an OBJ model             //
+//   * reports build time and closest/any hit rays per second as JSON        //
+// ========================================================================= //
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "meshgeometry.h"
+#include "bvh.h"
+#include "parallel.h"
+
+namespace {
+
+// Discards everything written to it, the mesh functions log to std::cout and would break the JSON output.
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+struct Ray {
+    Vec3f origin, direction;
+};
+
+// Rays from random points on a sphere around the mesh to random points inside its bounding box, like picking and
+// line of sight queries from all around. direction reaches the target at t = 1.
+std::vector<Ray> generateRays(const Vec3f& lower, const Vec3f& upper, size_t numRays) {
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::normal_distribution<float> normal;
+    const Vec3f center = 0.5f * (lower + upper);
+    const float radius = (upper - lower).length();
+    std::vector<Ray> rays(numRays);
+    for (Ray& ray : rays) {
+        Vec3f onSphere(normal(random), normal(random), normal(random));
+        if (!onSphere.normalize()) onSphere = Vec3f(0.0f, 1.0f, 0.0f);
+        ray.origin = center + radius * onSphere;
+        const Vec3f target(lower[0] + unit(random) * (upper[0] - lower[0]), lower[1] + unit(random) * (upper[1] - lower[1]),
+                           lower[2] + unit(random) * (upper[2] - lower[2]));
+        ray.direction = target - ray.origin;
+    }
+    return rays;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Best of repeat runs of the build and of both queries, as one JSON object.
+std::string benchmark(const std::string& name, const MeshGeometry& mesh, size_t numRays, unsigned int repeat) {
+    const std::vector<Vec3f>& vertices = mesh.vertices;
+    const std::vector<Vec3ui>& triangles = mesh.triangles;
+    TriangleBVH bvh;
+    double buildSeconds = -1.0;
+    for (unsigned int run = 0; run < repeat; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        bvh.build(vertices.data(), triangles.data(), triangles.size());
+        const double seconds = secondsSince(start);
+        if (buildSeconds < 0.0 || seconds < buildSeconds) buildSeconds = seconds;
+    }
+
+    const std::vector<Ray> rays = generateRays(mesh.boundingBoxMin, mesh.boundingBoxMax, numRays);
+    double closestSeconds = -1.0, anySeconds = -1.0;
+    size_t closestHits = 0, anyHits = 0;
+    for (unsigned int run = 0; run < repeat; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        closestHits = 0;
+        RayHit hit;
+        for (const Ray& ray : rays) closestHits += bvh.intersect(ray.origin, ray.direction, FLT_MAX, hit);
+        double seconds = secondsSince(start);
+        if (closestSeconds < 0.0 || seconds < closestSeconds) closestSeconds = seconds;
+
+        // line of sight from the origin to the target
+        start = std::chrono::steady_clock::now();
+        anyHits = 0;
+        for (const Ray& ray : rays) anyHits += bvh.occluded(ray.origin, ray.direction, 1.0f);
+        seconds = secondsSince(start);
+        if (anySeconds < 0.0 || seconds < anySeconds) anySeconds = seconds;
+    }
+
+    std::ostringstream result;
+    result << "{\"mesh\": \"" << name << "\""
+           << ", \"triangles\": " << triangles.size()
+           << ", \"buildSeconds\": " << buildSeconds
+           << ", \"nodes\": " << bvh.getNumNodes()
+           << ", \"bytes\": " << bvh.getMemoryBytes()
+           << ", \"rays\": " << numRays
+           << ", \"closestHitRaysPerSecond\": " << (closestSeconds > 0.0 ? numRays / closestSeconds : 0.0)
+           << ", \"closestHitFraction\": " << (numRays > 0 ? static_cast<double>(closestHits) / numRays : 0.0)
+           << ", \"anyHitRaysPerSecond\": " << (anySeconds > 0.0 ? numRays / anySeconds : 0.0)
+           << ", \"anyHitFraction\": " << (numRays > 0 ? static_cast<double>(anyHits) / numRays : 0.0) << "}";
+    return result.str();
+}
+
+void printUsage() {
+    std::cerr << "usage: bvh_bench [--terrain N] [--model PATH] [--rays R] [--repeat K]" << std::endl
+              << "  builds the BVH of an N x N terrain (default 512) and of an OBJ model (default Models/doppeldecker.obj)" << std::endl
+              << "  and prints the best of K runs (default 3) of R rays (default 1M) per mesh as JSON" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int terrainSize = 512;
+    std::string model = "Models/doppeldecker.obj";
+    size_t numRays = 1000000;
+    unsigned int repeat = 3;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--terrain" && i + 1 < argc) terrainSize = std::max(2, std::atoi(argv[++i]));
+        else if (arg == "--model" && i + 1 < argc) model = argv[++i];
+        else if (arg == "--rays" && i + 1 < argc) numRays = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--repeat" && i + 1 < argc) repeat = std::max(1, std::atoi(argv[++i]));
+        else {
+            printUsage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    NullBuffer nullBuffer;
+    std::streambuf* coutBuffer = std::cout.rdbuf(&nullBuffer);
+    MeshGeometry terrain, airplane;
+    generateTerrainGrid(terrainSize, terrainSize, generateHeightmap(terrainSize, terrainSize, 4000, 0), terrain);
+    MeshLoadOptions options;
+    options.useMeshCache = false;
+    ObjParseStats stats;
+    loadOBJGeometry(model.c_str(), options, airplane, stats);
+    std::cout.rdbuf(coutBuffer);
+    if (airplane.triangles.empty()) {
+        std::cerr << "bvh_bench: can not load " << model << std::endl;
+        return 1;
+    }
+
+    std::cout << "{\n  \"benchmark\": \"bvh_bench\",\n  \"threads\": " << workerThreadCount()
+              << ",\n  \"repeat\": " << repeat << ",\n  \"results\": [\n    "
+              << benchmark("terrain", terrain, numRays, repeat) << ",\n    "
+              << benchmark(model, airplane, numRays, repeat) << "\n  ]\n}" << std::endl;
+    return 0;
+}
@@ -18,7 +18,7 @@
 #include "./ui_mainwindow.h"
 
 void MainWindow::refreshStatusBarMessage() const {
-    statusBar()->showMessage(tr("FPS: %1, Triangles: %2, Drawn Obj: %3, Culled Obj: %4").arg(fpsCount).arg(triangleCount).arg(drawnObjectsCount).arg(culledObjectsCount));
+    statusBar()->showMessage(tr("FPS: %1, Triangles: %2, Drawn Obj: %3, Culled Obj: %4, LOD: %5").arg(fpsCount).arg(triangleCount).arg(drawnObjectsCount).arg(culledObjectsCount).arg(lodHistogram));
 }
 
 void MainWindow::changeFpsCount(unsigned int fps)
@@ -45,6 +45,12 @@ void MainWindow::changeCulledObjectsCount(unsigned int culledObjects)
     refreshStatusBarMessage();
 }
 
+void MainWindow::changeLodHistogram(const QString& histogram)
+{
+    lodHistogram = histogram;
+    refreshStatusBarMessage();
+}
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
@@ -68,6 +74,7 @@ MainWindow::MainWindow(QWidget *parent)
     connect(ui->openGLWidget, &OpenGLView::triangleCountChanged, this, &MainWindow::changeTriangleCount);
     connect(ui->openGLWidget, &OpenGLView::drawnObjectsCountChanged, this, &MainWindow::changeDrawnObjectsCount);
     connect(ui->openGLWidget, &OpenGLView::culledObjectsCountChanged, this, &MainWindow::changeCulledObjectsCount);
+    connect(ui->openGLWidget, &OpenGLView::lodHistogramChanged, this, &MainWindow::changeLodHistogram);
 
     connect(ui->openGLWidget, &OpenGLView::shaderCompiled, this, &MainWindow::addShaderToList, Qt::QueuedConnection);
 
@@ -125,6 +132,9 @@ void MainWindow::keyPressEvent(QKeyEvent *ev)
     case Qt::Key_Plus:
         movementSpeed *= 2.f;
         break;
+    case Qt::Key_B:
+        ui->openGLWidget->benchmarkVertexLayouts();
+        break;
     case Qt::Key_Minus:
         movementSpeed /= 2.f;
     default:
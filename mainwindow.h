@@ -13,6 +13,7 @@
 #define MAINWINDOW_H
 
 #include <QPoint>
+#include <QString>
 #include <QMainWindow>
 
 QT_BEGIN_NAMESPACE
@@ -33,6 +34,7 @@ public slots:
     void changeTriangleCount(unsigned int triangles);
     void changeDrawnObjectsCount(unsigned int drawnObjects);
     void changeCulledObjectsCount(unsigned int culledObjects);
+    void changeLodHistogram(const QString& histogram);
 
 public:
     MainWindow(QWidget *parent = nullptr);
@@ -49,6 +51,7 @@ private:
     unsigned int triangleCount = 0;
     unsigned int drawnObjectsCount = 0;
     unsigned int culledObjectsCount = 0;
+    QString lodHistogram;
     void refreshStatusBarMessage() const;
 
     // mouse information
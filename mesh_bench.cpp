@@ -0,0 +1,219 @@
+// ========================================================================= //
+// GRIS - Graphisch Interaktive Systeme                                      //
+// Technische Universität Darmstadt                                          //
+// Fraunhoferstrasse 5                                                       //
+// D-64283 Darmstadt, Germany                                                //
+//                                                                           //
+// Content: Benchmark of the OBJ load path on synthetic meshes               //
+//   * generates grid meshes with varied face syntax                         //
+//   * runs loadOBJGeometry without OpenGL and reports the stages as JSON    //
+// ========================================================================= //
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "meshgeometry.h"
+#include "parallel.h"
+
+namespace {
+
+// Peak resident set size of the process so far. Sizes are benchmarked in increasing order, so this is the peak
+// of the largest mesh loaded up to now.
+size_t peakResidentBytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(__APPLE__)
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// Buffered writer for the generated files, printf for every line would dominate the generation time.
+class ObjWriter {
+    std::FILE* file;
+    std::vector<char> buffer;
+    size_t used{0};
+
+public:
+    explicit ObjWriter(std::FILE* file) : file(file), buffer(1 << 20) {}
+    ~ObjWriter() { flush(); }
+
+    template<typename... Args>
+    void line(const char* format, Args... args) {
+        if (buffer.size() - used < 256) flush();
+        used += std::snprintf(buffer.data() + used, buffer.size() - used, format, args...);
+    }
+    void flush() {
+        std::fwrite(buffer.data(), 1, used, file);
+        used = 0;
+    }
+};
+
+// Writes a height field of n x n cells (2 n^2 triangles) with positions, texture coordinates and normals. The faces
+// cycle through all corner formats, quads, negative indices and blank/tab separators, and there are comments and
+// entries the loader skips. Since not every corner has a texture coordinate and a normal, all stages of the load run.
+bool generateOBJ(const std::string& fileName, unsigned int n) {
+    std::FILE* file = std::fopen(fileName.c_str(), "wb");
+    if (!file) return false;
+    {
+        ObjWriter out(file);
+        const unsigned int rowLength = n + 1;
+        const long numVertices = static_cast<long>(rowLength) * rowLength;
+        out.line("# mesh_bench grid with %u x %u cells\no grid\ns 1\n", n, n);
+        for (unsigned int z = 0; z <= n; ++z) {
+            for (unsigned int x = 0; x <= n; ++x) {
+                const float height = 0.25f * std::sin(0.1f * x) * std::cos(0.07f * z);
+                if ((x + z) % 16 == 0) out.line("v\t%e\t%e\t%e\n", x * 0.01f, height, z * 0.01f);
+                else out.line("v %.6f %.6f %.6f\n", x * 0.01f, height, z * 0.01f);
+            }
+        }
+        for (unsigned int z = 0; z <= n; ++z)
+            for (unsigned int x = 0; x <= n; ++x) out.line("vt %.5f %.5f\n", static_cast<float>(x) / n, static_cast<float>(z) / n);
+        out.line("\n# normals\n");
+        for (unsigned int z = 0; z <= n; ++z)
+            for (unsigned int x = 0; x <= n; ++x) out.line("vn 0.0 1.0 0.0\n");
+        out.line("g faces\n");
+        for (unsigned int z = 0; z < n; ++z) {
+            for (unsigned int x = 0; x < n; ++x) {
+                // 1-based ids of the cell corners
+                const long a = static_cast<long>(z) * rowLength + x + 1, b = a + 1, c = a + rowLength, d = c + 1;
+                switch ((x + z) % 6) {
+                    case 0:
+                        out.line("f %ld %ld %ld %ld\n", a, c, d, b);
+                        break;
+                    case 1:
+                        out.line("f %ld/%ld %ld/%ld %ld/%ld\nf %ld/%ld %ld/%ld %ld/%ld\n", a, a, c, c, d, d, a, a, d, d, b, b);
+                        break;
+                    case 2:
+                        out.line("f %ld//%ld %ld//%ld %ld//%ld\nf %ld//%ld %ld//%ld %ld//%ld\n", a, a, c, c, d, d, a, a, d, d, b, b);
+                        break;
+                    case 3:
+                        out.line("f %ld/%ld/%ld %ld/%ld/%ld %ld/%ld/%ld %ld/%ld/%ld\n", a, a, a, c, c, c, d, d, d, b, b, b);
+                        break;
+                    case 4:
+                        // relative to the end of the vertex list
+                        out.line("f %ld %ld %ld\nf %ld %ld %ld\n", a - numVertices - 1, c - numVertices - 1, d - numVertices - 1,
+                                 a - numVertices - 1, d - numVertices - 1, b - numVertices - 1);
+                        break;
+                    default:
+                        out.line("f\t%ld   %ld\t%ld \r\nf %ld %ld %ld # comment\n", a, c, d, a, d, b);
+                        break;
+                }
+            }
+        }
+    }
+    const bool ok = std::ferror(file) == 0;
+    return std::fclose(file) == 0 && ok;
+}
+
+// Discards everything written to it, loadOBJGeometry logs to std::cout and would break the JSON output.
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+void printUsage() {
+    std::cerr << "usage: mesh_bench [--max-triangles N] [--repeat R] [--dir PATH] [--keep]" << std::endl
+              << "  benchmarks loadOBJGeometry on synthetic meshes from 10K up to N triangles (default 1M, at most 50M)" << std::endl
+              << "  and prints the best of R runs (default 3) per size as JSON" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t maxTriangles = 1000000;
+    unsigned int repeat = 3;
+    std::string directory = ".";
+    bool keepFiles = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--max-triangles" && i + 1 < argc) maxTriangles = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--repeat" && i + 1 < argc) repeat = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--dir" && i + 1 < argc) directory = argv[++i];
+        else if (arg == "--keep") keepFiles = true;
+        else {
+            printUsage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    maxTriangles = std::min<size_t>(maxTriangles, 50000000);
+
+    std::vector<size_t> sizes;
+    for (size_t size : { 10000, 100000, 1000000, 10000000, 50000000 })
+        if (size <= maxTriangles) sizes.push_back(size);
+    if (sizes.empty() || sizes.back() != maxTriangles) sizes.push_back(maxTriangles);
+
+    std::ostringstream results;
+    NullBuffer nullBuffer;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        const unsigned int n = std::max(1u, static_cast<unsigned int>(std::ceil(std::sqrt(sizes[i] / 2.0))));
+        const std::string fileName = directory + "/mesh_bench_" + std::to_string(sizes[i]) + ".obj";
+        std::cerr << "mesh_bench: generating " << fileName << std::endl;
+        if (!generateOBJ(fileName, n)) {
+            std::cerr << "mesh_bench: can not write " << fileName << std::endl;
+            return 1;
+        }
+
+        // best of several runs, the first one also pays for reading the file from disk
+        ObjParseStats best;
+        best.totalSeconds = -1.0;
+        size_t numTriangles = 0, numVertices = 0;
+        MeshLoadOptions options;
+        options.useMeshCache = false;
+        for (unsigned int run = 0; run < repeat; ++run) {
+            MeshGeometry mesh;
+            ObjParseStats stats;
+            std::streambuf* coutBuffer = std::cout.rdbuf(&nullBuffer);
+            loadOBJGeometry(fileName.c_str(), options, mesh, stats);
+            std::cout.rdbuf(coutBuffer);
+            if (best.totalSeconds < 0.0 || stats.totalSeconds < best.totalSeconds) best = stats;
+            numTriangles = mesh.triangles.size();
+            numVertices = mesh.vertices.size();
+        }
+        if (!keepFiles) std::remove(fileName.c_str());
+
+        results << (i == 0 ? "" : ",") << "\n    {"
+                << "\"requestedTriangles\": " << sizes[i]
+                << ", \"triangles\": " << numTriangles
+                << ", \"vertices\": " << numVertices
+                << ", \"splitVertices\": " << best.splitVertices
+                << ", \"weldedVertices\": " << best.weldedVertices
+                << ", \"bytes\": " << best.bytes
+                << ", \"parseMBps\": " << best.megabytesPerSecond()
+                << ", \"trianglesPerSecond\": " << (best.totalSeconds > 0.0 ? numTriangles / best.totalSeconds : 0.0)
+                << ", \"stages\": {\"parse\": " << best.parseSeconds
+                << ", \"build\": " << best.buildSeconds
+                << ", \"weld\": " << best.weldSeconds
+                << ", \"normals\": " << best.normalSeconds
+                << ", \"texCoords\": " << best.texCoordSeconds
+                << ", \"tangents\": " << best.tangentSeconds
+                << ", \"optimize\": " << best.optimizeSeconds
+                << ", \"total\": " << best.totalSeconds << "}"
+                << ", \"peakRssBytes\": " << peakResidentBytes() << "}";
+    }
+
+    std::cout << "{\n  \"benchmark\": \"mesh_bench\",\n  \"threads\": " << workerThreadCount()
+              << ",\n  \"repeat\": " << repeat << ",\n  \"results\": [" << results.str() << "\n  ]\n}" << std::endl;
+    return 0;
+}
@@ -0,0 +1,140 @@
+// ========================================================================= //
+// GRIS - Graphisch Interaktive Systeme                                      //
+// Technische Universität Darmstadt                                          //
+// Fraunhoferstrasse 5                                                       //
+// D-64283 Darmstadt, Germany                                                //
+//                                                                           //
+// Content: Connectivity of a triangle mesh in flat arrays                   //
+// ========================================================================= //
+
+#include "meshadjacency.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "parallel.h"
+
+namespace {
+
+// Vertices or triangles per thread at least, smaller meshes are not worth starting threads for.
+const size_t ADJACENCY_BLOCK_SIZE = 1 << 15;
+
+// Turns counts stored at offsets[v + 1] into the offsets of the lists.
+void prefixSum(std::vector<unsigned int>& offsets) {
+    for (size_t v = 1; v < offsets.size(); ++v) offsets[v] += offsets[v - 1];
+}
+
+} // namespace
+
+void MeshAdjacency::build(const Vec3ui* triangles, size_t numTriangles, size_t numVertices, bool withHalfEdges) {
+    clear();
+    this->numTriangles = numTriangles;
+
+    // counting scatter over contiguous blocks of triangles, one block per thread. every block counts the corners of its
+    // triangles per vertex, the counts of all blocks then become the offsets of each block inside the list of a
+    // vertex, and every block writes its triangles there. every triangle is visited twice in total, and since the
+    // blocks are in triangle order the lists come out in ascending order. the counters cost 4 bytes per block and
+    // vertex, the offsets of a block replace its counts in place. the number of blocks is capped so that the counters
+    // never take more memory than vertexTriangles, about six blocks for a closed mesh.
+    const size_t maxBlocks = std::max<size_t>(1, std::min(numTriangles / ADJACENCY_BLOCK_SIZE, 3 * numTriangles / std::max<size_t>(1, numVertices)));
+    const unsigned int numBlocks = static_cast<unsigned int>(std::min<size_t>(workerThreadCount(), maxBlocks));
+    auto blockBegin = [numTriangles, numBlocks](unsigned int block) { return numTriangles * block / numBlocks; };
+    std::vector<unsigned int> blockOffsets(size_t(numBlocks) * numVertices, 0);
+    runParallel(numBlocks, [&](unsigned int block) {
+        unsigned int* counts = blockOffsets.data() + size_t(block) * numVertices;
+        for (size_t t = blockBegin(block); t < blockBegin(block + 1); ++t)
+            for (unsigned int k = 0; k < 3; ++k) ++counts[triangles[t][k]];
+    });
+    vertexTriangleOffsets.assign(numVertices + 1, 0);
+    parallelFor(numVertices, ADJACENCY_BLOCK_SIZE, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            unsigned int count = 0;
+            for (unsigned int block = 0; block < numBlocks; ++block) {
+                unsigned int& blockCount = blockOffsets[size_t(block) * numVertices + v];
+                const unsigned int offset = count;
+                count += blockCount;
+                blockCount = offset;
+            }
+            vertexTriangleOffsets[v + 1] = count;
+        }
+    });
+    prefixSum(vertexTriangleOffsets);
+    vertexTriangles.resize(vertexTriangleOffsets[numVertices]);
+    runParallel(numBlocks, [&](unsigned int block) {
+        unsigned int* fill = blockOffsets.data() + size_t(block) * numVertices;
+        for (size_t t = blockBegin(block); t < blockBegin(block + 1); ++t)
+            for (unsigned int k = 0; k < 3; ++k) {
+                const unsigned int v = triangles[t][k];
+                vertexTriangles[vertexTriangleOffsets[v] + fill[v]++] = static_cast<unsigned int>(t);
+            }
+    });
+
+    // the neighbours of a vertex are the other corners of its triangles, sorted and without duplicates. every block of
+    // vertices gathers them into its own array in one pass, the arrays are then copied behind each other.
+    const size_t maxVertexBlocks = std::max<size_t>(1, numVertices / ADJACENCY_BLOCK_SIZE);
+    const unsigned int numVertexBlocks = static_cast<unsigned int>(std::min<size_t>(workerThreadCount(), maxVertexBlocks));
+    auto vertexBlockBegin = [numVertices, numVertexBlocks](unsigned int block) { return numVertices * block / numVertexBlocks; };
+    std::vector<std::vector<unsigned int>> blockNeighbours(numVertexBlocks);
+    vertexNeighbourOffsets.assign(numVertices + 1, 0);
+    runParallel(numVertexBlocks, [&](unsigned int block) {
+        std::vector<unsigned int>& neighbours = blockNeighbours[block];
+        neighbours.reserve(2 * size_t(vertexTriangleOffsets[vertexBlockBegin(block + 1)] - vertexTriangleOffsets[vertexBlockBegin(block)]));
+        for (size_t v = vertexBlockBegin(block); v < vertexBlockBegin(block + 1); ++v) {
+            const size_t first = neighbours.size();
+            for (unsigned int t : getTriangles(static_cast<unsigned int>(v)))
+                for (unsigned int k = 0; k < 3; ++k)
+                    if (triangles[t][k] != v) neighbours.push_back(triangles[t][k]);
+            std::sort(neighbours.begin() + first, neighbours.end());
+            neighbours.erase(std::unique(neighbours.begin() + first, neighbours.end()), neighbours.end());
+            vertexNeighbourOffsets[v + 1] = static_cast<unsigned int>(neighbours.size() - first);
+        }
+    });
+    prefixSum(vertexNeighbourOffsets);
+    vertexNeighbours.resize(vertexNeighbourOffsets[numVertices]);
+    runParallel(numVertexBlocks, [&](unsigned int block) {
+        std::copy(blockNeighbours[block].begin(), blockNeighbours[block].end(), vertexNeighbours.begin() + vertexNeighbourOffsets[vertexBlockBegin(block)]);
+    });
+
+    if (!withHalfEdges) return;
+    // half-edge a -> b is paired with b -> a if both exist exactly once. more of either means the edge is
+    // non-manifold or the triangles are not oriented consistently, then both stay unpaired like a border. the owner
+    // of a sorts the half-edges that leave and enter a by their other vertex, so that high valences stay cheap.
+    oppositeHalfEdges.assign(3 * numTriangles, NO_HALF_EDGE);
+    typedef std::pair<unsigned int, unsigned int> VertexHalfEdge;
+    parallelFor(numVertices, ADJACENCY_BLOCK_SIZE, [&](size_t begin, size_t end) {
+        std::vector<VertexHalfEdge> outgoing, incoming;
+        for (size_t v = begin; v < end; ++v) {
+            outgoing.clear();
+            incoming.clear();
+            for (unsigned int t : getTriangles(static_cast<unsigned int>(v)))
+                for (unsigned int k = 0; k < 3; ++k) {
+                    const unsigned int a = triangles[t][k], b = triangles[t][(k + 1) % 3];
+                    if (a == b) continue;
+                    if (a == v) outgoing.emplace_back(b, 3 * t + k);
+                    if (b == v) incoming.emplace_back(a, 3 * t + k);
+                }
+            std::sort(outgoing.begin(), outgoing.end());
+            std::sort(incoming.begin(), incoming.end());
+            auto in = incoming.begin();
+            for (auto out = outgoing.begin(); out != outgoing.end();) {
+                auto outEnd = out;
+                while (outEnd != outgoing.end() && outEnd->first == out->first) ++outEnd;
+                while (in != incoming.end() && in->first < out->first) ++in;
+                auto inEnd = in;
+                while (inEnd != incoming.end() && inEnd->first == out->first) ++inEnd;
+                if (outEnd - out == 1 && inEnd - in == 1) oppositeHalfEdges[out->second] = in->second;
+                out = outEnd;
+                in = inEnd;
+            }
+        }
+    });
+}
+
+void MeshAdjacency::clear() {
+    numTriangles = 0;
+    vertexTriangleOffsets.clear();
+    vertexTriangles.clear();
+    vertexNeighbourOffsets.clear();
+    vertexNeighbours.clear();
+    oppositeHalfEdges.clear();
+}
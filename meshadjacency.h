@@ -0,0 +1,76 @@
+// ========================================================================= //
+// GRIS - Graphisch Interaktive Systeme                                      //
+// Technische Universität Darmstadt                                          //
+// Fraunhoferstrasse 5                                                       //
+// D-64283 Darmstadt, Germany                                                //
+//                                                                           //
+// Content: Connectivity of a triangle mesh in flat arrays                   //
+//   * vertex -> triangle and vertex -> vertex lists (CSR)                   //
+//   * optional half-edge table with the opposite half-edges                 //
+// ========================================================================= //
+
+#ifndef MESHADJACENCY_H
+#define MESHADJACENCY_H
+
+#include <cstddef>
+#include <vector>
+
+#include "vec3.h"
+
+// Marks a half-edge without an opposite one, at a border or at a non-manifold edge.
+const unsigned int NO_HALF_EDGE = 0xFFFFFFFFu;
+
+// Contiguous list of indices inside one of the flat arrays, usable in range-based for loops.
+struct IndexRange {
+    const unsigned int* first;
+    const unsigned int* last;
+
+    const unsigned int* begin() const { return first; }
+    const unsigned int* end() const { return last; }
+    size_t size() const { return static_cast<size_t>(last - first); }
+    bool empty() const { return first == last; }
+};
+
+// Connectivity of an indexed triangle mesh, in compressed sparse rows: the triangles of vertex v are
+// vertexTriangles[vertexTriangleOffsets[v]] to vertexTriangles[vertexTriangleOffsets[v + 1] - 1], in ascending
+// order, the neighbours of v likewise. Vertices are only connected by their indices, vertices that are split at
+// texture or normal seams are not neighbours of each other.
+// Half-edge h = 3 * t + k runs from corner k of triangle t to corner (k + 1) % 3, opposite(h) runs the other way in the
+// neighbouring triangle.
+class MeshAdjacency {
+    size_t numTriangles{0};
+    std::vector<unsigned int> vertexTriangleOffsets;
+    std::vector<unsigned int> vertexTriangles;
+    std::vector<unsigned int> vertexNeighbourOffsets;
+    std::vector<unsigned int> vertexNeighbours;
+    std::vector<unsigned int> oppositeHalfEdges;
+
+public:
+    // Builds the lists on several threads, and the half-edge table if withHalfEdges is set.
+    void build(const Vec3ui* triangles, size_t numTriangles, size_t numVertices, bool withHalfEdges);
+    void clear();
+
+    // false until build was called and after clear
+    bool isBuilt() const { return !vertexTriangleOffsets.empty(); }
+    bool hasHalfEdges() const { return isBuilt() && oppositeHalfEdges.size() == 3 * numTriangles; }
+    size_t getNumVertices() const { return isBuilt() ? vertexTriangleOffsets.size() - 1 : 0; }
+    size_t getNumTriangles() const { return numTriangles; }
+
+    // triangles that use vertex v
+    IndexRange getTriangles(unsigned int v) const {
+        return IndexRange{ vertexTriangles.data() + vertexTriangleOffsets[v], vertexTriangles.data() + vertexTriangleOffsets[v + 1] };
+    }
+    // vertices that share an edge with vertex v
+    IndexRange getNeighbours(unsigned int v) const {
+        return IndexRange{ vertexNeighbours.data() + vertexNeighbourOffsets[v], vertexNeighbours.data() + vertexNeighbourOffsets[v + 1] };
+    }
+
+    // half-edges, only valid if hasHalfEdges()
+    static unsigned int triangleOf(unsigned int halfEdge) { return halfEdge / 3; }
+    static unsigned int next(unsigned int halfEdge) { return halfEdge % 3 == 2 ? halfEdge - 2 : halfEdge + 1; }
+    static unsigned int previous(unsigned int halfEdge) { return halfEdge % 3 == 0 ? halfEdge + 2 : halfEdge - 1; }
+    unsigned int opposite(unsigned int halfEdge) const { return oppositeHalfEdges[halfEdge]; }
+    bool isBorder(unsigned int halfEdge) const { return oppositeHalfEdges[halfEdge] == NO_HALF_EDGE; }
+};
+
+#endif // MESHADJACENCY_H
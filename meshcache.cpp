@@ -0,0 +1,165 @@
+// ========================================================================= //
+// GRIS - Graphisch Interaktive Systeme                                      //
+// Technische Universität Darmstadt                                          //
+// Fraunhoferstrasse 5                                                       //
+// D-64283 Darmstadt, Germany                                                //
+//                                                                           //
+// Content: Versioned binary cache (.meshbin) for processed meshes           //
+// ========================================================================= //
+
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSaveFile>
+
+#include "meshcache.h"
+
+namespace {
+
+const char MAGIC[8] = { 'M', 'E', 'S', 'H', 'B', 'I', 'N', '\0' };
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+const uint64_t SECTION_ALIGNMENT = 16;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrderMark;
+    uint64_t sourceSize;
+    int64_t sourceModified;
+    uint64_t sourceHash;
+    uint64_t settings;
+    uint32_t numSections;
+    uint32_t reserved;
+};
+
+struct FileSectionEntry {
+    uint32_t id;
+    uint32_t elementSize;
+    uint64_t count;
+    uint64_t offset;
+};
+
+static_assert(sizeof(FileSectionEntry) == sizeof(uint64_t) * 3, "section entries must be tightly packed");
+
+uint64_t alignUp(uint64_t value) {
+    return (value + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+// 64 bit hash over 8 byte words, fast enough to run over every source file on every load
+uint64_t hashBytes(const char* data, size_t size) {
+    const uint64_t prime = 0x100000001b3ull;
+    uint64_t hash = 0xcbf29ce484222325ull ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; ++i) hash = (hash ^ static_cast<unsigned char>(data[i])) * prime;
+    return hash ^ (hash >> 32);
+}
+
+} // namespace
+
+MeshCacheKey makeMeshCacheKey(const char* fileName, const MappedFile& source) {
+    MeshCacheKey key;
+    key.sourceSize = source.size();
+    key.sourceModified = QFileInfo(fileName).lastModified().toMSecsSinceEpoch();
+    key.sourceHash = hashBytes(source.begin(), source.size());
+    return key;
+}
+
+std::vector<char> joinStrings(const std::vector<std::string>& strings) {
+    std::vector<char> joined;
+    for (const auto& string : strings) {
+        joined.insert(joined.end(), string.begin(), string.end());
+        joined.push_back('\0');
+    }
+    return joined;
+}
+
+std::vector<std::string> splitStrings(const std::vector<char>& joined) {
+    std::vector<std::string> strings;
+    auto begin = joined.begin();
+    for (auto it = joined.begin(); it != joined.end(); ++it) {
+        if (*it != '\0') continue;
+        strings.emplace_back(begin, it);
+        begin = it + 1;
+    }
+    return strings;
+}
+
+std::string meshCachePath(const char* fileName) {
+    return std::string(fileName) + ".meshbin";
+}
+
+void MeshCacheWriter::addSection(MeshCacheSection id, uint32_t elementSize, uint64_t count, const void* data) {
+    sections.push_back({ id, elementSize, count, data });
+}
+
+bool MeshCacheWriter::write(const std::string& path, const MeshCacheKey& key) const {
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = MESH_CACHE_VERSION;
+    header.byteOrderMark = BYTE_ORDER_MARK;
+    header.sourceSize = key.sourceSize;
+    header.sourceModified = key.sourceModified;
+    header.sourceHash = key.sourceHash;
+    header.settings = key.settings;
+    header.numSections = static_cast<uint32_t>(sections.size());
+
+    std::vector<FileSectionEntry> entries;
+    uint64_t offset = alignUp(sizeof(Header) + sections.size() * sizeof(FileSectionEntry));
+    for (const auto& section : sections) {
+        entries.push_back({ static_cast<uint32_t>(section.id), section.elementSize, section.count, offset });
+        offset = alignUp(offset + section.elementSize * section.count);
+    }
+
+    // QSaveFile writes into a temporary file and renames it on commit, so readers never see half a cache
+    QSaveFile file(QString::fromStdString(path));
+    if (!file.open(QFile::WriteOnly)) return false;
+    const char padding[SECTION_ALIGNMENT] = {};
+    uint64_t written = 0;
+    auto writeBytes = [&](const void* data, uint64_t size) {
+        if (size && file.write(static_cast<const char*>(data), size) != static_cast<qint64>(size)) return false;
+        written += size;
+        return true;
+    };
+    bool ok = writeBytes(&header, sizeof(header)) && writeBytes(entries.data(), entries.size() * sizeof(FileSectionEntry));
+    for (size_t i = 0; ok && i < sections.size(); ++i) {
+        ok = writeBytes(padding, entries[i].offset - written)
+            && writeBytes(sections[i].data, sections[i].elementSize * sections[i].count);
+    }
+    if (!ok) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+MeshCacheReader::MeshCacheReader(const std::string& path, const MeshCacheKey& key) : file(path.c_str()) {
+    if (!file.isOpen() || file.size() < sizeof(Header)) return;
+    Header header;
+    std::memcpy(&header, file.begin(), sizeof(Header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != MESH_CACHE_VERSION
+        || header.byteOrderMark != BYTE_ORDER_MARK) return;
+    const MeshCacheKey cachedKey{ header.sourceSize, header.sourceModified, header.sourceHash, header.settings };
+    if (!(cachedKey == key)) return;
+    if (file.size() < sizeof(Header) + uint64_t(header.numSections) * sizeof(FileSectionEntry)) return;
+
+    entries = reinterpret_cast<const SectionEntry*>(file.begin() + sizeof(Header));
+    numEntries = header.numSections;
+    for (uint32_t i = 0; i < numEntries; ++i) {
+        if (entries[i].offset + entries[i].elementSize * entries[i].count > file.size()) return;
+    }
+    valid = true;
+}
+
+const MeshCacheReader::SectionEntry* MeshCacheReader::find(MeshCacheSection id, uint32_t elementSize) const {
+    if (!valid) return nullptr;
+    for (uint32_t i = 0; i < numEntries; ++i) {
+        if (entries[i].id == static_cast<uint32_t>(id))
+            return entries[i].elementSize == elementSize ? &entries[i] : nullptr;
+    }
+    return nullptr;
+}
@@ -0,0 +1,117 @@
+// ========================================================================= //
+// GRIS - Graphisch Interaktive Systeme                                      //
+// Technische Universität Darmstadt                                          //
+// Fraunhoferstrasse 5                                                       //
+// D-64283 Darmstadt, Germany                                                //
+//                                                                           //
+// Content: Versioned binary cache (.meshbin) for processed meshes           //
+// ========================================================================= //
+
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "objparser.h"
+
+// Bump whenever the layout or the meaning of a section changes, old caches are then rebuilt automatically.
+const uint32_t MESH_CACHE_VERSION = 11;
+
+// Identifies the source file a cache was built from and the processing options it was built with.
+struct MeshCacheKey {
+    uint64_t sourceSize{0};
+    int64_t sourceModified{0}; // msecs since epoch
+    uint64_t sourceHash{0};
+    uint64_t settings{0};      // options that change the processed mesh, chosen by the caller
+
+    bool operator== (const MeshCacheKey& other) const {
+        return sourceSize == other.sourceSize && sourceModified == other.sourceModified && sourceHash == other.sourceHash
+            && settings == other.settings;
+    }
+};
+
+// Sections a cache file can contain.
+enum class MeshCacheSection : uint32_t {
+    VERTICES = 1,
+    NORMALS = 2,
+    TRIANGLES = 3,
+    TEXCOORDS = 4,
+    TANGENTS = 5,
+    BOUNDING_BOX = 6,
+    SUBMESHES = 7,
+    MATERIAL_NAMES = 8,     // strings, see joinStrings
+    MATERIAL_LIBRARIES = 9, // strings, see joinStrings
+    MESHLETS = 10,
+    MESHLET_MATERIALS = 11,
+    LOD_LEVELS = 12,        // one entry per level, the ranges of all levels follow each other in LOD_RANGES
+    LOD_RANGES = 13,
+    LOD_TRIANGLES = 14,
+};
+
+// Strings are stored as one section of characters, each string terminated by '\0'.
+std::vector<char> joinStrings(const std::vector<std::string>& strings);
+std::vector<std::string> splitStrings(const std::vector<char>& joined);
+
+// Builds the key of an already mapped source file.
+MeshCacheKey makeMeshCacheKey(const char* fileName, const MappedFile& source);
+
+// Path of the cache file that belongs to a source file.
+std::string meshCachePath(const char* fileName);
+
+// Collects sections and writes them into a cache file.
+class MeshCacheWriter {
+    struct Section {
+        MeshCacheSection id;
+        uint32_t elementSize;
+        uint64_t count;
+        const void* data;
+    };
+    std::vector<Section> sections;
+
+public:
+    template<typename T>
+    void addSection(MeshCacheSection id, const std::vector<T>& data) { addSection(id, sizeof(T), data.size(), data.data()); }
+    void addSection(MeshCacheSection id, uint32_t elementSize, uint64_t count, const void* data);
+
+    // writes atomically, returns false if the file could not be written (e.g. read-only directory)
+    bool write(const std::string& path, const MeshCacheKey& key) const;
+};
+
+// Maps a cache file and gives access to its sections. isValid() is false if the file does not exist,
+// is damaged, has another version or was built from a different source.
+class MeshCacheReader {
+    MappedFile file;
+    bool valid{false};
+
+    struct SectionEntry {
+        uint32_t id;
+        uint32_t elementSize;
+        uint64_t count;
+        uint64_t offset;
+    };
+    const SectionEntry* entries{nullptr};
+    uint32_t numEntries{0};
+
+    const SectionEntry* find(MeshCacheSection id, uint32_t elementSize) const;
+
+public:
+    MeshCacheReader(const std::string& path, const MeshCacheKey& key);
+
+    bool isValid() const { return valid; }
+
+    // copies a section into data, returns false if the section is missing or has another element size
+    template<typename T>
+    bool readSection(MeshCacheSection id, std::vector<T>& data) const {
+        const SectionEntry* entry = find(id, sizeof(T));
+        if (!entry) return false;
+        data.resize(entry->count);
+        if (entry->count) std::memcpy(data.data(), file.begin() + entry->offset, entry->count * sizeof(T));
+        return true;
+    }
+};
+
+#endif // MESHCACHE_H
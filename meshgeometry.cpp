@@ -0,0 +1,885 @@
+// ========================================================================= //
+// GRIS - Graphisch Interaktive Systeme                                      //
+// Technische Universität Darmstadt                                          //
+// Fraunhoferstrasse 5                                                       //
+// D-64283 Darmstadt, Germany                                                //
+//                                                                           //
+// Content: CPU side of a triangle mesh, without OpenGL                      //
+// ========================================================================= //
+
+#include <cmath>
+#include <cfloat>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MESHGEOMETRY_USE_SSE
+#endif
+
+#include <QtGlobal>
+#include <QtMath>
+
+#include "meshgeometry.h"
+#include "meshcache.h"
+#include "parallel.h"
+
+namespace {
+
+// Vertices per block of the parallel normal calculation, smaller meshes are not worth the threads.
+const size_t NORMAL_BLOCK_SIZE = 1 << 15;
+
+// Level of detail as stored in the .meshbin cache, its ranges are stored separately.
+struct CachedLevelOfDetail {
+    uint64_t numTriangles;
+    uint32_t numRanges;
+    float error;
+};
+
+#ifdef MESHGEOMETRY_USE_SSE
+// x, y and z of four vectors in one register each
+struct Vec3x4 {
+    __m128 x, y, z;
+};
+
+inline Vec3x4 loadVec3x4(const Vec3f& a, const Vec3f& b, const Vec3f& c, const Vec3f& d) {
+    return Vec3x4{ _mm_set_ps(d[0], c[0], b[0], a[0]), _mm_set_ps(d[1], c[1], b[1], a[1]), _mm_set_ps(d[2], c[2], b[2], a[2]) };
+}
+
+// same as Vec3f::normalize: divides by the length sqrt((x*x + y*y) + z*z), keeps vectors shorter than EPS
+inline Vec3x4 normalize(const Vec3x4& v) {
+    const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(v.x, v.x), _mm_mul_ps(v.y, v.y)), _mm_mul_ps(v.z, v.z)));
+    const __m128 keep = _mm_cmplt_ps(length, _mm_set1_ps(EPS));
+    auto divide = [&](__m128 c) { return _mm_or_ps(_mm_and_ps(keep, c), _mm_andnot_ps(keep, _mm_div_ps(c, length))); };
+    return Vec3x4{ divide(v.x), divide(v.y), divide(v.z) };
+}
+
+inline void store(const Vec3x4& v, Vec3f* out) {
+    alignas(16) float x[4], y[4], z[4];
+    _mm_store_ps(x, v.x);
+    _mm_store_ps(y, v.y);
+    _mm_store_ps(z, v.z);
+    for (int i = 0; i < 4; ++i) out[i] = Vec3f(x[i], y[i], z[i]);
+}
+#endif
+
+// Spatial hash grid for weldVertices. Every cell holds a linked list of the vertices that were kept in it.
+class WeldGrid {
+    struct Cell {
+        int64_t x, y, z;
+        unsigned int head;
+    };
+    static const unsigned int EMPTY = ~0u;
+    std::vector<Cell> cells;
+    std::vector<unsigned int> next;
+    size_t mask;
+    float inverseCellSize;
+
+    static size_t hash(int64_t x, int64_t y, int64_t z) {
+        uint64_t h = static_cast<uint64_t>(x) * 0x9E3779B97F4A7C15ull;
+        h ^= static_cast<uint64_t>(y) * 0xC2B2AE3D27D4EB4Full;
+        h ^= static_cast<uint64_t>(z) * 0x165667B19E3779F9ull;
+        return static_cast<size_t>(h ^ (h >> 29));
+    }
+
+    Cell& find(int64_t x, int64_t y, int64_t z) {
+        for (size_t i = hash(x, y, z) & mask;; i = (i + 1) & mask) {
+            Cell& cell = cells[i];
+            if (cell.head == EMPTY || (cell.x == x && cell.y == y && cell.z == z)) return cell;
+        }
+    }
+
+public:
+    WeldGrid(size_t maxVertices, float cellSize) : next(maxVertices, EMPTY), inverseCellSize(1.0f / cellSize) {
+        size_t capacity = 16;
+        while (capacity < 2 * maxVertices) capacity *= 2;
+        cells.assign(capacity, Cell{ 0, 0, 0, EMPTY });
+        mask = capacity - 1;
+    }
+
+    int64_t cellOf(float coordinate) const { return static_cast<int64_t>(std::floor(coordinate * inverseCellSize)); }
+
+    void insert(const Vec3f& position, unsigned int id) {
+        Cell& cell = find(cellOf(position[0]), cellOf(position[1]), cellOf(position[2]));
+        if (cell.head == EMPTY) {
+            cell.x = cellOf(position[0]);
+            cell.y = cellOf(position[1]);
+            cell.z = cellOf(position[2]);
+        }
+        next[id] = cell.head;
+        cell.head = id;
+    }
+
+    // calls fn(id) for the vertices in the 27 cells around position until fn returns true
+    template<typename Fn>
+    bool findNear(const Vec3f& position, const Fn& fn) {
+        const int64_t cx = cellOf(position[0]), cy = cellOf(position[1]), cz = cellOf(position[2]);
+        for (int64_t x = cx - 1; x <= cx + 1; ++x)
+        for (int64_t y = cy - 1; y <= cy + 1; ++y)
+        for (int64_t z = cz - 1; z <= cz + 1; ++z) {
+            for (unsigned int id = find(x, y, z).head; id != EMPTY; id = next[id])
+                if (fn(id)) return true;
+        }
+        return false;
+    }
+};
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// processing options that change the cached mesh, part of the cache key
+uint64_t meshCacheSettings(const MeshLoadOptions& options) {
+    // the triangle order depends on the overdraw threshold and on the meshlets, the cache also holds the levels of detail
+    uint32_t threshold;
+    std::memcpy(&threshold, &options.overdrawThreshold, sizeof(threshold));
+    return threshold | uint64_t(options.useMeshlets) << 32 | uint64_t(options.numLODLevels) << 40;
+}
+
+// read or write the .meshbin cache of an OBJ file. reading fails if the cache does not belong to the key.
+bool readMeshCache(MeshGeometry& mesh, const std::string& path, const MeshCacheKey& key) {
+    MeshCacheReader cache(path, key);
+    std::vector<Vec3f> boundingBox;
+    std::vector<char> materialNames, libraries;
+    std::vector<CachedLevelOfDetail> levels;
+    std::vector<ObjSubMesh> levelRanges;
+    bool valid = cache.isValid()
+        && cache.readSection(MeshCacheSection::VERTICES, mesh.vertices)
+        && cache.readSection(MeshCacheSection::NORMALS, mesh.normals)
+        && cache.readSection(MeshCacheSection::TRIANGLES, mesh.triangles)
+        && cache.readSection(MeshCacheSection::TEXCOORDS, mesh.texCoords)
+        && cache.readSection(MeshCacheSection::TANGENTS, mesh.tangents)
+        && cache.readSection(MeshCacheSection::BOUNDING_BOX, boundingBox)
+        && cache.readSection(MeshCacheSection::SUBMESHES, mesh.subMeshes)
+        && cache.readSection(MeshCacheSection::MATERIAL_NAMES, materialNames)
+        && cache.readSection(MeshCacheSection::MATERIAL_LIBRARIES, libraries)
+        && cache.readSection(MeshCacheSection::MESHLETS, mesh.meshlets)
+        && cache.readSection(MeshCacheSection::MESHLET_MATERIALS, mesh.meshletMaterials)
+        && cache.readSection(MeshCacheSection::LOD_LEVELS, levels)
+        && cache.readSection(MeshCacheSection::LOD_RANGES, levelRanges)
+        && cache.readSection(MeshCacheSection::LOD_TRIANGLES, mesh.lodTriangles)
+        && boundingBox.size() == 2;
+
+    // the key only says which source the cache belongs to. a damaged cache must fall back to parsing instead of
+    // letting createAllVBOs read out of bounds, so every index and range is checked.
+    const size_t numVertices = mesh.vertices.size();
+    auto isPerVertex = [numVertices](size_t size) { return size == 0 || size == numVertices; };
+    auto indicesValid = [numVertices](const std::vector<Vec3ui>& triangles) {
+        for (const auto& triangle : triangles)
+            if (triangle[0] >= numVertices || triangle[1] >= numVertices || triangle[2] >= numVertices) return false;
+        return true;
+    };
+    const int numMaterials = static_cast<int>(splitStrings(materialNames).size());
+    auto materialValid = [numMaterials](int material) { return material >= -1 && material < numMaterials; };
+    auto rangesValid = [&](const std::vector<ObjSubMesh>& ranges, size_t numTriangles) {
+        for (const auto& range : ranges)
+            if (range.firstTriangle > numTriangles || range.numTriangles > numTriangles - range.firstTriangle || !materialValid(range.material)) return false;
+        return true;
+    };
+    valid = valid && isPerVertex(mesh.normals.size()) && isPerVertex(mesh.texCoords.size()) && isPerVertex(mesh.tangents.size())
+        && indicesValid(mesh.triangles) && indicesValid(mesh.lodTriangles)
+        && rangesValid(mesh.subMeshes, mesh.triangles.size()) && rangesValid(levelRanges, mesh.lodTriangles.size())
+        && mesh.meshletMaterials.size() == mesh.meshlets.size();
+    for (size_t i = 0; valid && i < mesh.meshlets.size(); ++i) {
+        const Meshlet& meshlet = mesh.meshlets[i];
+        valid = meshlet.firstTriangle <= mesh.triangles.size() && meshlet.numTriangles <= mesh.triangles.size() - meshlet.firstTriangle
+            && materialValid(mesh.meshletMaterials[i]);
+    }
+    // the ranges of the levels of detail follow each other
+    size_t numLevelRanges = 0;
+    for (const auto& level : levels) {
+        numLevelRanges += level.numRanges;
+        valid = valid && level.numTriangles <= mesh.lodTriangles.size();
+    }
+    valid = valid && numLevelRanges == levelRanges.size();
+
+    if (!valid) {
+        mesh.vertices.clear();
+        mesh.normals.clear();
+        mesh.triangles.clear();
+        mesh.texCoords.clear();
+        mesh.tangents.clear();
+        mesh.subMeshes.clear();
+        mesh.lodTriangles.clear();
+        mesh.meshlets.clear();
+        mesh.meshletMaterials.clear();
+        return false;
+    }
+    auto range = levelRanges.begin();
+    for (const auto& level : levels) {
+        mesh.levelsOfDetail.push_back(MeshLevelOfDetail{ std::vector<ObjSubMesh>(range, range + level.numRanges), static_cast<size_t>(level.numTriangles), level.error });
+        range += level.numRanges;
+    }
+    // the materials themselves are read from their libraries again, so that edits of the MTL files show up
+    const std::vector<std::string> names = splitStrings(materialNames);
+    mesh.materials.resize(names.size());
+    for (size_t i = 0; i < names.size(); ++i) mesh.materials[i].name = names[i];
+    mesh.materialLibraries = splitStrings(libraries);
+    mesh.boundingBoxMin = boundingBox[0];
+    mesh.boundingBoxMax = boundingBox[1];
+    mesh.boundingBoxMid = 0.5f*mesh.boundingBoxMin + 0.5f*mesh.boundingBoxMax;
+    mesh.boundingBoxSize = mesh.boundingBoxMax - mesh.boundingBoxMin;
+    return true;
+}
+
+bool writeMeshCache(const MeshGeometry& mesh, const std::string& path, const MeshCacheKey& key) {
+    const std::vector<Vec3f> boundingBox = { mesh.boundingBoxMin, mesh.boundingBoxMax };
+    std::vector<std::string> materialNames;
+    for (const auto& material : mesh.materials) materialNames.push_back(material.name);
+    const std::vector<char> names = joinStrings(materialNames), libraries = joinStrings(mesh.materialLibraries);
+    std::vector<CachedLevelOfDetail> levels;
+    std::vector<ObjSubMesh> levelRanges;
+    for (const auto& lod : mesh.levelsOfDetail) {
+        levels.push_back(CachedLevelOfDetail{ lod.numTriangles, static_cast<uint32_t>(lod.ranges.size()), lod.error });
+        levelRanges.insert(levelRanges.end(), lod.ranges.begin(), lod.ranges.end());
+    }
+    MeshCacheWriter cache;
+    cache.addSection(MeshCacheSection::VERTICES, mesh.vertices);
+    cache.addSection(MeshCacheSection::NORMALS, mesh.normals);
+    cache.addSection(MeshCacheSection::TRIANGLES, mesh.triangles);
+    cache.addSection(MeshCacheSection::TEXCOORDS, mesh.texCoords);
+    cache.addSection(MeshCacheSection::TANGENTS, mesh.tangents);
+    cache.addSection(MeshCacheSection::BOUNDING_BOX, boundingBox);
+    cache.addSection(MeshCacheSection::SUBMESHES, mesh.subMeshes);
+    cache.addSection(MeshCacheSection::MATERIAL_NAMES, names);
+    cache.addSection(MeshCacheSection::MATERIAL_LIBRARIES, libraries);
+    cache.addSection(MeshCacheSection::MESHLETS, mesh.meshlets);
+    cache.addSection(MeshCacheSection::MESHLET_MATERIALS, mesh.meshletMaterials);
+    cache.addSection(MeshCacheSection::LOD_LEVELS, levels);
+    cache.addSection(MeshCacheSection::LOD_RANGES, levelRanges);
+    cache.addSection(MeshCacheSection::LOD_TRIANGLES, mesh.lodTriangles);
+    return cache.write(path, key);
+}
+
+}
+
+// =================
+// === LOAD MESH ===
+// =================
+
+bool loadOBJGeometry(const char* filename, const MeshLoadOptions& options, MeshGeometry& out, ObjParseStats& stats) {
+    stats = ObjParseStats();
+    auto loadStart = std::chrono::steady_clock::now();
+    // map the obj file into memory
+    MappedFile file(filename);
+    if (!file.isOpen()) {
+        std::cout << "loadOBJ: can not find " << filename << std::endl;
+        return false;
+    }
+
+    // reuse the processed mesh of an earlier run if the source did not change since then
+    MeshCacheKey cacheKey;
+    if (options.useMeshCache) {
+        auto cacheStart = std::chrono::steady_clock::now();
+        cacheKey = makeMeshCacheKey(filename, file);
+        cacheKey.settings = meshCacheSettings(options);
+        if (readMeshCache(out, meshCachePath(filename), cacheKey)) {
+            stats.fromCache = true;
+            stats.bytes = file.size();
+            stats.parseSeconds = secondsSince(cacheStart);
+            stats.totalSeconds = secondsSince(loadStart);
+            std::cout << "loadOBJ: read " << filename << " from cache in " << std::fixed << std::setprecision(2)
+                      << stats.parseSeconds * 1000.0 << " ms" << std::defaultfloat << std::endl;
+            loadMaterials(out, filename);
+            return true;
+        }
+    }
+
+    // Load all vertices, texture coordinates, normals and faces and ignore other entries.
+    auto parseStart = std::chrono::steady_clock::now();
+    ObjData data;
+    parseOBJ(file.begin(), file.end(), data);
+    stats.bytes = file.size();
+    stats.parseSeconds = secondsSince(parseStart);
+    std::cout << "loadOBJ: parsed " << filename << " (" << std::fixed << std::setprecision(2) << file.size() / (1024.0 * 1024.0)
+              << " MB) in " << stats.parseSeconds * 1000.0 << " ms, " << stats.megabytesPerSecond() << " MB/s" << std::defaultfloat << std::endl;
+
+    // build unique vertices and triangulate polygons
+    auto buildStart = std::chrono::steady_clock::now();
+    ObjMesh mesh;
+    buildObjMesh(data, mesh);
+    stats.buildSeconds = secondsSince(buildStart);
+    if (mesh.droppedFaces > 0)
+        qWarning("The OBJ file contains %zu invalid faces! Ignoring these entries, this will lead to holes in your mesh!", mesh.droppedFaces);
+    if (mesh.nonConvexFaces > 0)
+        std::cout << "loadOBJ: triangulated " << mesh.nonConvexFaces << " non-convex polygons by ear clipping" << std::endl;
+
+    out.vertices = std::move(mesh.vertices);
+    out.triangles = std::move(mesh.triangles);
+    if (mesh.hasNormals) out.normals = std::move(mesh.normals);
+    if (mesh.hasTexCoords) out.texCoords = std::move(mesh.texCoords);
+    out.subMeshes = std::move(mesh.subMeshes);
+    out.materialLibraries = std::move(mesh.materialLibraries);
+    out.materials.resize(mesh.materialNames.size());
+    for (size_t i = 0; i < out.materials.size(); ++i) out.materials[i].name = std::move(mesh.materialNames[i]);
+    loadMaterials(out, filename);
+
+    // update bounding box
+    out.boundingBoxMin = mesh.boundingBoxMin;
+    out.boundingBoxMax = mesh.boundingBoxMax;
+    out.boundingBoxMid = 0.5f*out.boundingBoxMin + 0.5f*out.boundingBoxMax;
+    out.boundingBoxSize = out.boundingBoxMax - out.boundingBoxMin;
+
+    // many exporters repeat the position at every face corner, which would break smooth normals. without normals in the
+    // file, exact duplicates are merged before the normals are calculated. normals of the file may have hard edges at
+    // duplicated positions, so those meshes are kept as they are.
+    if (out.normals.size() != out.vertices.size()) {
+        auto weldStart = std::chrono::steady_clock::now();
+        const MeshWeldStats weld = weldVertices(out, 0.0f);
+        stats.weldedVertices = weld.verticesBefore - weld.verticesAfter;
+        stats.weldSeconds = secondsSince(weldStart);
+    }
+
+    // normals and tangents share the adjacency of the welded triangles
+    MeshAdjacency adjacency;
+    auto buildAdjacency = [&]() {
+        if (!adjacency.isBuilt()) adjacency.build(out.triangles.data(), out.triangles.size(), out.vertices.size(), false);
+    };
+
+    // calculate normals if they are not present in the file
+    if (out.normals.size() != out.vertices.size()) {
+        auto normalStart = std::chrono::steady_clock::now();
+        buildAdjacency();
+        calculateNormalsByArea(out, adjacency);
+        stats.normalSeconds = secondsSince(normalStart);
+    }
+
+    // calculate texture coordinates if they are not present in the file
+    if (out.texCoords.size() != out.vertices.size()) {
+        auto texCoordStart = std::chrono::steady_clock::now();
+        calculateTexCoordsSphereMapping(out);
+        stats.texCoordSeconds = secondsSince(texCoordStart);
+    }
+
+    // tangents for bump mapping, the file format has none
+    auto tangentStart = std::chrono::steady_clock::now();
+    buildAdjacency();
+    stats.splitVertices = calculateTangents(out, adjacency);
+    stats.tangentSeconds = secondsSince(tangentStart);
+
+    // the cache stores the optimized orders and the meshlets, so this only runs when the file is parsed
+    auto optimizeStart = std::chrono::steady_clock::now();
+    optimizeTriangleOrder(out, options.overdrawThreshold);
+    if (options.useMeshlets) buildMeshlets(out);
+    optimizeVertexOrder(out);
+    stats.optimizeSeconds = secondsSince(optimizeStart);
+    buildLevelsOfDetail(out, options.numLODLevels);
+    stats.totalSeconds = secondsSince(loadStart);
+
+    // store the result for the next run
+    if (options.useMeshCache && !writeMeshCache(out, meshCachePath(filename), cacheKey))
+        std::cout << "loadOBJ: could not write mesh cache for " << filename << std::endl;
+    return true;
+}
+
+void loadMaterials(MeshGeometry& mesh, const char* objFileName) {
+    if (mesh.materials.empty()) return;
+    // library and texture file names are relative to the file that references them
+    auto directoryOf = [](const std::string& path) {
+        const size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    };
+    auto isAbsolute = [](const std::string& path) {
+        return !path.empty() && (path[0] == '/' || path[0] == '\\' || (path.size() > 1 && path[1] == ':'));
+    };
+    std::vector<ObjMaterial> library;
+    for (const auto& name : mesh.materialLibraries) {
+        const std::string path = isAbsolute(name) ? name : directoryOf(objFileName) + name;
+        MappedFile file(path.c_str());
+        if (!file.isOpen()) {
+            std::cout << "loadOBJ: can not find material library " << path << std::endl;
+            continue;
+        }
+        const size_t first = library.size();
+        parseMTL(file.begin(), file.end(), library);
+        for (size_t i = first; i < library.size(); ++i) {
+            if (!library[i].diffuseMap.empty() && !isAbsolute(library[i].diffuseMap))
+                library[i].diffuseMap = directoryOf(path) + library[i].diffuseMap;
+        }
+    }
+    for (auto& material : mesh.materials) {
+        const std::string name = material.name;
+        auto it = std::find_if(library.begin(), library.end(), [&name](const ObjMaterial& m) { return m.name == name; });
+        if (it == library.end()) {
+            std::cout << "loadOBJ: material " << name << " is not defined, using the default material" << std::endl;
+            continue;
+        }
+        material = *it;
+    }
+}
+
+// ================
+// === RAW DATA ===
+// ================
+
+MeshWeldStats weldVertices(MeshGeometry& mesh, float epsilon) {
+    MeshWeldStats stats;
+    stats.verticesBefore = mesh.vertices.size();
+    stats.verticesAfter = mesh.vertices.size();
+    if (mesh.vertices.empty()) return stats;
+
+    // attributes that only exist for some meshes take part only if there is one per vertex
+    const bool withNormals = mesh.normals.size() == mesh.vertices.size();
+    const bool withColors = mesh.colors.size() == mesh.vertices.size();
+    const bool withTexCoords = mesh.texCoords.size() == mesh.vertices.size();
+    const bool withTangents = mesh.tangents.size() == mesh.vertices.size();
+    // texture coordinates and colors must match exactly (up to rounding), otherwise the seam is kept
+    const float ATTRIBUTE_EPSILON = 1e-6f;
+
+    // epsilon 0 merges exact duplicates only, the grid still needs cells of some size. cells of at least a millionth of
+    // the largest coordinate keep the cell coordinates far inside int64_t, also for flat or degenerate meshes.
+    const float squaredEpsilon = epsilon * epsilon;
+    float extent = 0.0f;
+    for (const auto& vertex : mesh.vertices)
+        extent = std::max(extent, std::max(std::fabs(vertex[0]), std::max(std::fabs(vertex[1]), std::fabs(vertex[2]))));
+    const float cellSize = std::max(epsilon, std::max(1e-6f * extent, FLT_MIN));
+    WeldGrid grid(mesh.vertices.size(), cellSize);
+
+    // the first vertex of each cluster is kept and represents all later ones within epsilon
+    std::vector<unsigned int> remap(mesh.vertices.size());
+    std::vector<unsigned int> mergedCount;
+    unsigned int numKept = 0;
+    for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+        const Vec3f& v = mesh.vertices[i];
+        unsigned int representative = 0;
+        const bool found = grid.findNear(v, [&](unsigned int id) {
+            if ((mesh.vertices[id] - v).sqlength() > squaredEpsilon) return false;
+            if (withTexCoords && (std::fabs(mesh.texCoords[id].u - mesh.texCoords[i].u) > ATTRIBUTE_EPSILON || std::fabs(mesh.texCoords[id].v - mesh.texCoords[i].v) > ATTRIBUTE_EPSILON)) return false;
+            if (withColors && (mesh.colors[id] - mesh.colors[i]).sqlength() > ATTRIBUTE_EPSILON * ATTRIBUTE_EPSILON) return false;
+            // calculateTangents splits vertices at mirrored texture coordinates
+            if (withTangents && mesh.tangents[id].handedness != mesh.tangents[i].handedness) return false;
+            representative = id;
+            return true;
+        });
+        if (found) {
+            remap[i] = representative;
+            // sum up normals and tangents, they are averaged below
+            if (withNormals) mesh.normals[representative] += mesh.normals[i];
+            if (withTangents) mesh.tangents[representative].direction += mesh.tangents[i].direction;
+            ++mergedCount[representative];
+            continue;
+        }
+        // keep the vertex, kept vertices are compacted in place since numKept <= i
+        remap[i] = numKept;
+        mesh.vertices[numKept] = v;
+        if (withNormals) mesh.normals[numKept] = mesh.normals[i];
+        if (withColors) mesh.colors[numKept] = mesh.colors[i];
+        if (withTexCoords) mesh.texCoords[numKept] = mesh.texCoords[i];
+        if (withTangents) mesh.tangents[numKept] = mesh.tangents[i];
+        mergedCount.push_back(1);
+        grid.insert(v, numKept);
+        ++numKept;
+    }
+    mesh.vertices.resize(numKept);
+    if (withNormals) mesh.normals.resize(numKept);
+    if (withColors) mesh.colors.resize(numKept);
+    if (withTexCoords) mesh.texCoords.resize(numKept);
+    if (withTangents) mesh.tangents.resize(numKept);
+    for (unsigned int i = 0; i < numKept; ++i) {
+        if (mergedCount[i] == 1) continue;
+        if (withNormals) mesh.normals[i].normalize();
+        // only vertices with the same handedness are merged, it stays as it is
+        if (withTangents) {
+            const float length = mesh.tangents[i].direction.length();
+            if (length > 0.0f) mesh.tangents[i].direction /= length;
+        }
+    }
+
+    // remap the triangles and remove the collapsed ones, within each material range
+    std::vector<ObjSubMesh> ranges = mesh.subMeshes;
+    if (ranges.empty()) ranges.push_back(ObjSubMesh{ -1, 0, static_cast<unsigned int>(mesh.triangles.size()) });
+    size_t numTriangles = 0;
+    for (auto& range : ranges) {
+        const size_t first = numTriangles;
+        for (size_t t = range.firstTriangle; t < range.firstTriangle + range.numTriangles; ++t) {
+            const Vec3ui triangle(remap[mesh.triangles[t][0]], remap[mesh.triangles[t][1]], remap[mesh.triangles[t][2]]);
+            if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[2] == triangle[0]) {
+                ++stats.degenerateTriangles;
+                continue;
+            }
+            mesh.triangles[numTriangles++] = triangle;
+        }
+        range.firstTriangle = static_cast<unsigned int>(first);
+        range.numTriangles = static_cast<unsigned int>(numTriangles - first);
+    }
+    mesh.triangles.resize(numTriangles);
+    if (!mesh.subMeshes.empty()) mesh.subMeshes = ranges;
+    // the simplified levels index the old vertices
+    mesh.levelsOfDetail.clear();
+    mesh.lodTriangles.clear();
+    // the meshlet ranges lost their collapsed triangles
+    if (!mesh.meshlets.empty()) buildMeshlets(mesh);
+
+    stats.verticesAfter = numKept;
+    std::cout << "weldVertices: " << stats.verticesBefore << " -> " << stats.verticesAfter << " vertices, removed "
+              << stats.degenerateTriangles << " degenerate triangles" << std::endl;
+    return stats;
+}
+
+void optimizeTriangleOrder(MeshGeometry& mesh, float overdrawThreshold) {
+    if (mesh.triangles.empty()) return;
+    auto start = std::chrono::steady_clock::now();
+    const VertexCacheStats before = analyzeVertexCache(mesh.triangles.data(), mesh.triangles.size(), mesh.vertices.size());
+    // triangles must stay inside their material range
+    auto optimizeRange = [&](size_t first, size_t count) {
+        optimizeVertexCache(mesh.triangles.data() + first, count, mesh.vertices.size());
+        if (overdrawThreshold >= 1.0f)
+            optimizeOverdraw(mesh.triangles.data() + first, count, mesh.vertices.data(), mesh.vertices.size(), overdrawThreshold);
+    };
+    if (mesh.subMeshes.empty()) {
+        optimizeRange(0, mesh.triangles.size());
+    } else {
+        for (const auto& range : mesh.subMeshes) optimizeRange(range.firstTriangle, range.numTriangles);
+    }
+    // the meshlets are ranges of the old order
+    mesh.meshlets.clear();
+    mesh.meshletMaterials.clear();
+    const VertexCacheStats after = analyzeVertexCache(mesh.triangles.data(), mesh.triangles.size(), mesh.vertices.size());
+    std::cout << "optimizeTriangleOrder: " << mesh.triangles.size() << " triangles in " << std::fixed << std::setprecision(2)
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+              << " ms, ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr
+              << " (FIFO of " << VERTEX_CACHE_SIZE << ", overdraw threshold " << overdrawThreshold << ")" << std::defaultfloat << std::endl;
+}
+
+void buildMeshlets(MeshGeometry& mesh) {
+    mesh.meshlets.clear();
+    mesh.meshletMaterials.clear();
+    if (mesh.triangles.empty()) return;
+    std::vector<ObjSubMesh> ranges = mesh.subMeshes;
+    if (ranges.empty()) ranges.push_back(ObjSubMesh{ -1, 0, static_cast<unsigned int>(mesh.triangles.size()) });
+    for (const auto& range : ranges) {
+        std::vector<Meshlet> rangeMeshlets = buildMeshlets(mesh.triangles.data() + range.firstTriangle, range.numTriangles, mesh.vertices.data(), mesh.vertices.size());
+        for (auto& meshlet : rangeMeshlets) meshlet.firstTriangle += range.firstTriangle;
+        mesh.meshlets.insert(mesh.meshlets.end(), rangeMeshlets.begin(), rangeMeshlets.end());
+        mesh.meshletMaterials.resize(mesh.meshlets.size(), range.material);
+    }
+}
+
+void optimizeVertexOrder(MeshGeometry& mesh) {
+    if (mesh.triangles.empty()) return;
+    const std::vector<unsigned int> remap = optimizeVertexFetch(mesh.triangles.data(), mesh.triangles.size(), mesh.vertices.size());
+    remapVertexAttribute(mesh.vertices, remap);
+    remapVertexAttribute(mesh.normals, remap);
+    remapVertexAttribute(mesh.colors, remap);
+    remapVertexAttribute(mesh.texCoords, remap);
+    remapVertexAttribute(mesh.tangents, remap);
+    for (auto& triangle : mesh.lodTriangles)
+        triangle = Vec3ui(remap[triangle[0]], remap[triangle[1]], remap[triangle[2]]);
+}
+
+void buildLevelsOfDetail(MeshGeometry& mesh, unsigned int numLevels) {
+    mesh.levelsOfDetail.clear();
+    mesh.lodTriangles.clear();
+    if (mesh.triangles.empty() || numLevels == 0) return;
+    auto start = std::chrono::steady_clock::now();
+    // every level is simplified from the full mesh, so that its error is measured against it. triangles must stay
+    // inside their material range, the borders between ranges stay in place.
+    std::vector<ObjSubMesh> ranges = mesh.subMeshes;
+    if (ranges.empty()) ranges.push_back(ObjSubMesh{ -1, 0, static_cast<unsigned int>(mesh.triangles.size()) });
+    size_t previousTriangles = mesh.triangles.size();
+    float previousError = 0.0f;
+    for (unsigned int level = 1; level <= numLevels; ++level) {
+        const size_t first = mesh.lodTriangles.size();
+        MeshLevelOfDetail lod{ {}, 0, previousError };
+        for (const auto& range : ranges) {
+            float error;
+            std::vector<Vec3ui> simplified = simplifyMesh(mesh.triangles.data() + range.firstTriangle, range.numTriangles, mesh.vertices.data(),
+                                                          mesh.vertices.size(), range.numTriangles >> level, error);
+            optimizeVertexCache(simplified.data(), simplified.size(), mesh.vertices.size());
+            lod.ranges.push_back(ObjSubMesh{ range.material, static_cast<unsigned int>(mesh.lodTriangles.size()), static_cast<unsigned int>(simplified.size()) });
+            mesh.lodTriangles.insert(mesh.lodTriangles.end(), simplified.begin(), simplified.end());
+            lod.error = std::max(lod.error, error);
+        }
+        lod.numTriangles = mesh.lodTriangles.size() - first;
+        // a level that saves little is not worth its memory, the following ones would not get further
+        if (4 * lod.numTriangles > 3 * previousTriangles) {
+            mesh.lodTriangles.resize(first);
+            break;
+        }
+        previousTriangles = lod.numTriangles;
+        previousError = lod.error;
+        mesh.levelsOfDetail.push_back(std::move(lod));
+    }
+    std::cout << "buildLevelsOfDetail: " << mesh.triangles.size();
+    for (const auto& lod : mesh.levelsOfDetail) std::cout << " -> " << lod.numTriangles << " (error " << lod.error << ")";
+    std::cout << " triangles in " << std::fixed << std::setprecision(2)
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::defaultfloat << std::endl;
+}
+
+void calculateNormalsByArea(MeshGeometry& mesh, const MeshAdjacency& adjacency) {
+    // the normal of every triangle is computed once, then every vertex sums up the normals of its triangles from the
+    // adjacency. the triangles of a vertex are listed in ascending order, once per corner, so each vertex adds them like
+    // a serial scatter-add: the result is bit-identical for any number of threads.
+    const size_t numVertices = mesh.vertices.size();
+    const size_t numTriangles = mesh.triangles.size();
+    // batching the cross products four at a time with SSE was slower, gathering the indexed vertices into the
+    // registers costs more than the arithmetic it saves
+    std::vector<Vec3f> triangleNormals(numTriangles);
+    parallelFor(numTriangles, NORMAL_BLOCK_SIZE, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t) {
+            const Vec3ui& triangle = mesh.triangles[t];
+            triangleNormals[t] = cross(mesh.vertices[triangle[1]] - mesh.vertices[triangle[0]], mesh.vertices[triangle[2]] - mesh.vertices[triangle[0]]);
+        }
+    });
+    mesh.normals.resize(numVertices);
+    parallelFor(numVertices, NORMAL_BLOCK_SIZE, [&](size_t begin, size_t end) {
+        // sum up triangle normals, weighted by area, in each vertex
+        for (size_t v = begin; v < end; ++v) {
+            Vec3f sum(0.0f, 0.0f, 0.0f);
+            for (unsigned int t : adjacency.getTriangles(static_cast<unsigned int>(v))) sum += triangleNormals[t];
+            mesh.normals[v] = sum;
+        }
+
+        // normalize normals, four at once
+        size_t v = begin;
+#ifdef MESHGEOMETRY_USE_SSE
+        for (; v + 4 <= end; v += 4)
+            store(normalize(loadVec3x4(mesh.normals[v], mesh.normals[v + 1], mesh.normals[v + 2], mesh.normals[v + 3])), &mesh.normals[v]);
+#endif
+        for (; v < end; ++v) mesh.normals[v].normalize();
+    });
+}
+
+void sphereMapping(const Vec3f& vertex, const Vec3f& mid, float& u, float& v) {
+    const auto dist = vertex - mid;
+    u = (M_1_PI / 2) * std::atan2(dist.x(), dist.z()) + 0.5;
+    v = M_1_PI * std::asin(dist.y() / std::sqrt(dist.x() * dist.x() + dist.y() * dist.y() + dist.z() * dist.z()));
+}
+
+void calculateTexCoordsSphereMapping(MeshGeometry& mesh) {
+    mesh.texCoords.clear();
+    // texCoords by central projection on unit sphere
+    // optional ...
+    for (const auto& vertex : mesh.vertices) {
+        float u, v;
+        sphereMapping(vertex, mesh.boundingBoxMid, u, v);
+        mesh.texCoords.push_back(ObjTexCoord{ u, v });
+    }
+
+}
+
+size_t calculateTangents(MeshGeometry& mesh, const MeshAdjacency& adjacency) {
+    mesh.tangents.clear();
+    const size_t numVertices = mesh.vertices.size();
+    if (mesh.texCoords.size() != numVertices || mesh.normals.size() != numVertices) return 0;
+
+    // tangent and bitangent of a triangle, the directions in which u and v grow. false if the texture coordinates
+    // are degenerate.
+    auto triangleFrame = [&mesh](const Vec3ui& triangle, Vec3f& tangent, Vec3f& bitangent) {
+        const Vec3f e1 = mesh.vertices[triangle[1]] - mesh.vertices[triangle[0]], e2 = mesh.vertices[triangle[2]] - mesh.vertices[triangle[0]];
+        const float du1 = mesh.texCoords[triangle[1]].u - mesh.texCoords[triangle[0]].u, dv1 = mesh.texCoords[triangle[1]].v - mesh.texCoords[triangle[0]].v;
+        const float du2 = mesh.texCoords[triangle[2]].u - mesh.texCoords[triangle[0]].u, dv2 = mesh.texCoords[triangle[2]].v - mesh.texCoords[triangle[0]].v;
+        const float determinant = du1 * dv2 - du2 * dv1;
+        if (determinant == 0.0f) return false;
+        // only the directions matter, like MikkTSpace every triangle contributes with unit length vectors. the
+        // unscaled vectors are tiny on small triangles, so they are normalized without Vec3::normalize's epsilon.
+        const float sign = determinant > 0.0f ? 1.0f : -1.0f;
+        tangent = sign * (e1 * dv2 - e2 * dv1);
+        bitangent = sign * (e2 * du1 - e1 * du2);
+        const float tangentLength = tangent.length(), bitangentLength = bitangent.length();
+        if (!(tangentLength > 0.0f) || !(bitangentLength > 0.0f)) return false;
+        tangent /= tangentLength;
+        bitangent /= bitangentLength;
+        return true;
+    };
+    // tangent of a triangle in the tangent plane of its corner k, and the handedness there. false if it is parallel
+    // to the normal.
+    auto cornerTangent = [&mesh](const Vec3ui& triangle, unsigned int k, const Vec3f& tangent, const Vec3f& bitangent,
+                                 Vec3f& projected, int& handedness) {
+        const Vec3f& n = mesh.normals[triangle[k]];
+        projected = tangent - (n * tangent) * n;
+        if (!projected.normalize()) return false;
+        handedness = cross(n, projected) * bitangent < 0.0f ? 1 : 0;
+        return true;
+    };
+
+    // frames of all triangles, computed once
+    struct TriangleFrame {
+        Vec3f tangent, bitangent;
+        bool valid;
+    };
+    const size_t numTriangles = mesh.triangles.size();
+    std::vector<TriangleFrame> frames(numTriangles);
+    parallelFor(numTriangles, NORMAL_BLOCK_SIZE, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; ++t)
+            frames[t].valid = triangleFrame(mesh.triangles[t], frames[t].tangent, frames[t].bitangent);
+    });
+
+    // sums of the tangents with positive (0) and negative (1) handedness of every vertex. every vertex gathers from
+    // its own triangles, in ascending order like a serial loop over the triangles would add them.
+    struct TangentSums {
+        Vec3f tangent[2];
+        float weight[2];
+    };
+    std::vector<TangentSums> sums(numVertices);
+    parallelFor(numVertices, NORMAL_BLOCK_SIZE, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            TangentSums sum{ { Vec3f(0.0f), Vec3f(0.0f) }, { 0.0f, 0.0f } };
+            unsigned int previous = NO_HALF_EDGE;
+            for (unsigned int t : adjacency.getTriangles(static_cast<unsigned int>(v))) {
+                // a triangle that uses v at several corners is listed once per corner
+                if (t == previous || !frames[t].valid) continue;
+                previous = t;
+                const Vec3ui& triangle = mesh.triangles[t];
+                for (unsigned int k = 0; k < 3; ++k) {
+                    Vec3f projected;
+                    int handedness;
+                    if (triangle[k] != v || !cornerTangent(triangle, k, frames[t].tangent, frames[t].bitangent, projected, handedness)) continue;
+                    // weighted by the angle of the triangle at the corner
+                    const Vec3f& corner = mesh.vertices[triangle[k]];
+                    const Vec3f a = (mesh.vertices[triangle[(k + 1) % 3]] - corner).normalized(), b = (mesh.vertices[triangle[(k + 2) % 3]] - corner).normalized();
+                    const float angle = std::acos(std::min(std::max(a * b, -1.0f), 1.0f));
+                    sum.tangent[handedness] += angle * projected;
+                    sum.weight[handedness] += angle;
+                }
+            }
+            sums[v] = sum;
+        }
+    });
+
+    // the larger side of every vertex keeps it, the other side gets a copy with the mirrored tangent
+    const bool withColors = mesh.colors.size() == numVertices;
+    mesh.tangents.resize(numVertices);
+    std::vector<int> mainSide(numVertices, 0);
+    std::vector<unsigned int> mirrored(numVertices, 0);
+    auto tangentOf = [&mesh](unsigned int v, const Vec3f& sum, int side) {
+        const Vec3f& n = mesh.normals[v];
+        Vec3f tangent = sum - (n * sum) * n;
+        // without usable texture coordinates any direction in the tangent plane will do
+        if (!tangent.normalize()) tangent = cross(n, std::fabs(n[0]) < 0.9f ? Vec3f(1.0f, 0.0f, 0.0f) : Vec3f(0.0f, 1.0f, 0.0f)).normalized();
+        return MeshTangent{ tangent, side == 0 ? 1.0f : -1.0f };
+    };
+    for (unsigned int v = 0; v < numVertices; ++v) {
+        const TangentSums& sum = sums[v];
+        mainSide[v] = sum.weight[1] > sum.weight[0] ? 1 : 0;
+        mesh.tangents[v] = tangentOf(v, sum.tangent[mainSide[v]], mainSide[v]);
+        if (sum.weight[0] > 0.0f && sum.weight[1] > 0.0f) {
+            mirrored[v] = static_cast<unsigned int>(mesh.vertices.size());
+            mesh.vertices.push_back(mesh.vertices[v]);
+            mesh.normals.push_back(mesh.normals[v]);
+            mesh.texCoords.push_back(mesh.texCoords[v]);
+            if (withColors) mesh.colors.push_back(mesh.colors[v]);
+            mesh.tangents.push_back(tangentOf(v, sum.tangent[1 - mainSide[v]], 1 - mainSide[v]));
+        }
+    }
+    if (mesh.vertices.size() == numVertices) return 0;
+    // the corners on the other side use the copy
+    for (size_t t = 0; t < numTriangles; ++t) {
+        Vec3ui& triangle = mesh.triangles[t];
+        if ((!mirrored[triangle[0]] && !mirrored[triangle[1]] && !mirrored[triangle[2]]) || !frames[t].valid) continue;
+        Vec3ui split = triangle;
+        for (unsigned int k = 0; k < 3; ++k) {
+            Vec3f projected;
+            int handedness;
+            if (mirrored[triangle[k]] && cornerTangent(triangle, k, frames[t].tangent, frames[t].bitangent, projected, handedness) && handedness != mainSide[triangle[k]])
+                split[k] = mirrored[triangle[k]];
+        }
+        triangle = split;
+    }
+    return mesh.vertices.size() - numVertices;
+}
+
+void calculateBoundingBox(MeshGeometry& mesh) {
+    // clear bounding box data
+    mesh.boundingBoxMin = Vec3f(FLT_MAX, FLT_MAX, FLT_MAX);
+    mesh.boundingBoxMax = Vec3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    mesh.boundingBoxMid.zero();
+    mesh.boundingBoxSize.zero();
+    // iterate over vertices
+    for (auto& vertex : mesh.vertices) {
+        mesh.boundingBoxMin[0] = std::min(vertex[0], mesh.boundingBoxMin[0]);
+        mesh.boundingBoxMin[1] = std::min(vertex[1], mesh.boundingBoxMin[1]);
+        mesh.boundingBoxMin[2] = std::min(vertex[2], mesh.boundingBoxMin[2]);
+        mesh.boundingBoxMax[0] = std::max(vertex[0], mesh.boundingBoxMax[0]);
+        mesh.boundingBoxMax[1] = std::max(vertex[1], mesh.boundingBoxMax[1]);
+        mesh.boundingBoxMax[2] = std::max(vertex[2], mesh.boundingBoxMax[2]);
+    }
+    mesh.boundingBoxMid = 0.5f*mesh.boundingBoxMin + 0.5f*mesh.boundingBoxMax;
+    mesh.boundingBoxSize = mesh.boundingBoxMax - mesh.boundingBoxMin;
+}
+
+// ===============
+// === TERRAIN ===
+// ===============
+
+std::vector<std::vector<double>> generateHeightmap(int l, int w, int iterations, int displacementType)
+{
+    std::vector<std::vector<double>> heightmap(l, std::vector<double>(w));
+
+    float d = std::sqrt(w * w + l * l);
+    double displacement = 0.1;
+    float waveSize = d / 10.0f;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        float v = std::rand();
+        // convert v to radian
+        v = v * M_PI / 180.0f;
+        float a = std::sin(v);
+        float b = std::cos(v);
+        // rand() / RAND_MAX gives a random number between 0 and 1.
+        // therefore c will be a random number between -d/2 and d/2
+        float c = (static_cast<float>(rand()) / RAND_MAX) * d - d / 2.0f;
+
+        for (int x = 0; x < heightmap.size(); x++)
+        {
+            for (int z = 0; z < heightmap[0].size(); z++)
+            {
+                float dist = a * x + b * z - c;
+
+                // cosine function
+            	if (displacementType == 0) {
+                    float cosValue = std::cos(dist / waveSize * M_PI);
+                    heightmap[x][z] += displacement / 2.0f * cosValue;
+                }
+                // sine function
+                else if (displacementType == 1) {
+                    float sinValue = std::sin(dist / waveSize * M_PI);
+                    heightmap[x][z] += displacement / 2.0f * sinValue;
+                }
+                // step function
+                else {
+                    heightmap[x][z] += dist > 0 ? displacement : -displacement;
+                }
+            }
+        }
+    }
+
+    return heightmap;
+}
+
+void generateTerrainGrid(int l, int w, const std::vector<std::vector<double>>& heightmap, MeshGeometry& mesh) {
+    mesh.vertices.clear();
+    mesh.triangles.clear();
+
+    // center vertices around the origin
+    for (int x = -l/2; x < l/2; x++)
+    for (int z = -w/2; z < w/2; z++)
+    {
+	    double height = heightmap[x + l/2][z + w/2];
+
+    	// for each cell (x,z) add vertices (x, height, z)
+        mesh.vertices.emplace_back(x, height, z);
+    }
+
+    // for each cell create two triangles:
+    // triangle 1 has the cell, the cell to the right and the cell below
+    // triangle 2 has the cell to the right, the cell below and the cell below of the cell to the right
+    for (int x = 0; x < l - 1; x++) {
+        for (int z = 0; z < w - 1; z++) {
+            int cell = x * w + z;
+            int right = cell + 1;
+            int below = cell + w;
+            int belowRight = below + 1;
+
+            mesh.triangles.emplace_back(cell, right, below);
+            mesh.triangles.emplace_back(right, below, belowRight);
+        }
+    }
+
+    calculateBoundingBox(mesh);
+}
@@ -0,0 +1,140 @@
+// ========================================================================= //
+// GRIS - Graphisch Interaktive Systeme                                      //
+// Technische Universität Darmstadt                                          //
+// Fraunhoferstrasse 5                                                       //
+// D-64283 Darmstadt, Germany                                                //
+//                                                                           //
+// Content: CPU side of a triangle mesh, without OpenGL                      //
+//   * OBJ load pipeline with the .meshbin cache                             //
+//   * normals, texture coordinates and tangents                             //
+//   * welding, optimized orders, meshlets and levels of detail              //
+//   * terrain grids from fault heightmaps                                   //
+// ========================================================================= //
+
+#ifndef MESHGEOMETRY_H
+#define MESHGEOMETRY_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "vec3.h"
+#include "objparser.h"
+#include "meshoptimizer.h"
+#include "meshadjacency.h"
+
+// tangent in direction of increasing u and the sign of the bitangent: bitangent = handedness * cross(normal, tangent)
+struct MeshTangent {
+    Vec3f direction;
+    float handedness;
+};
+
+// Simplified version of a mesh with the same vertices. Its ranges index MeshGeometry::lodTriangles.
+struct MeshLevelOfDetail {
+    std::vector<ObjSubMesh> ranges;
+    size_t numTriangles;
+    float error; // largest deviation from the full mesh in object space
+};
+
+// Vertex attributes, triangles and everything derived from them that is computed on the CPU. TriangleMesh adds the
+// GL objects, the benchmarks use it as it is.
+struct MeshGeometry {
+    std::vector<Vec3f> vertices;           // vertex positions
+    std::vector<Vec3f> normals;            // normals per vertex
+    std::vector<Vec3ui> triangles;         // indices of vertices that form a triangle
+    std::vector<Vec3f> colors;             // r,g,b in [0,1]
+    std::vector<ObjTexCoord> texCoords;    // u,v in [0,1]
+    std::vector<MeshTangent> tangents;     // tangent and handedness per vertex
+    std::vector<ObjSubMesh> subMeshes;     // triangles sorted by material, empty if the mesh has no materials
+    std::vector<ObjMaterial> materials;    // indexed by ObjSubMesh::material
+    std::vector<std::string> materialLibraries; // MTL files of the loaded OBJ file
+    // coarser with every level, level i + 1 of the mesh is levelsOfDetail[i]
+    std::vector<MeshLevelOfDetail> levelsOfDetail;
+    std::vector<Vec3ui> lodTriangles;
+    // clusters of the triangles and their materials, empty if meshlets are disabled
+    std::vector<Meshlet> meshlets;
+    std::vector<int> meshletMaterials;
+
+    // bounding box data
+    Vec3f boundingBoxMin;
+    Vec3f boundingBoxMax;
+    Vec3f boundingBoxMid;
+    Vec3f boundingBoxSize;
+};
+
+// Processing options of loadOBJGeometry. All but useMeshCache change the processed mesh and are part of the cache key.
+struct MeshLoadOptions {
+    // read and write .meshbin caches next to loaded OBJ files
+    bool useMeshCache{true};
+    // ACMR factor optimizeTriangleOrder may give up for less overdraw, values below 1 disable the overdraw pass
+    float overdrawThreshold{OVERDRAW_THRESHOLD};
+    // group the triangles into meshlets
+    bool useMeshlets{false};
+    // number of simplified levels, 0 disables levels of detail
+    unsigned int numLODLevels{0};
+};
+
+// result of weldVertices
+struct MeshWeldStats {
+    size_t verticesBefore{0};
+    size_t verticesAfter{0};
+    size_t degenerateTriangles{0};
+};
+
+// Reads an OBJ file into out, which must be empty: parses it, merges the exact duplicates of files without normals,
+// calculates missing normals and texture coordinates, calculates tangents, optimizes the triangle and vertex order
+// and builds the meshlets and levels of detail the options ask for. The processed mesh is cached in
+// filename.meshbin and reused as long as the OBJ file does not change. stats receives the stage times. returns false
+// if the file can not be read.
+bool loadOBJGeometry(const char* filename, const MeshLoadOptions& options, MeshGeometry& out, ObjParseStats& stats);
+
+// Reads the materialLibraries of an OBJ file and fills in the materials by name.
+void loadMaterials(MeshGeometry& mesh, const char* objFileName);
+
+// Merges vertices whose positions are at most epsilon apart, using a spatial hash grid. Vertices with different
+// texture coordinates or colors are kept apart so that seams survive, normals and tangents of merged vertices are
+// averaged. Triangles that collapse are removed, the levels of detail are dropped and the meshlets rebuilt.
+MeshWeldStats weldVertices(MeshGeometry& mesh, float epsilon);
+
+// Reorders the triangles of every material range for the post-transform vertex cache, then sorts clusters of them
+// against overdraw if threshold is at least 1, and prints ACMR/ATVR before and after. Drops the meshlets.
+void optimizeTriangleOrder(MeshGeometry& mesh, float overdrawThreshold);
+
+// Groups the triangles of every material range into meshlets and reorders the triangles so that every meshlet is one
+// range. Call it after optimizeTriangleOrder and before optimizeVertexOrder.
+void buildMeshlets(MeshGeometry& mesh);
+
+// Renumbers the vertices in the order the triangles use them and permutes all vertex attributes accordingly.
+void optimizeVertexOrder(MeshGeometry& mesh);
+
+// Builds numLevels simplified versions of the mesh, each with at most half the triangles of the one before. Stops
+// early if the simplification gets stuck.
+void buildLevelsOfDetail(MeshGeometry& mesh, unsigned int numLevels);
+
+// Calculates normals, weighted by area. adjacency must belong to the current triangles.
+void calculateNormalsByArea(MeshGeometry& mesh, const MeshAdjacency& adjacency);
+
+// Texture coordinate of a vertex by central projection on the unit sphere around mid.
+void sphereMapping(const Vec3f& vertex, const Vec3f& mid, float& u, float& v);
+
+// Calculates texture coordinates by central projection around the bounding box center.
+void calculateTexCoordsSphereMapping(MeshGeometry& mesh);
+
+// Calculates tangents from the texture coordinates and normals, following MikkTSpace: the tangents of the triangles
+// are projected into the tangent plane of each vertex and weighted by the angle of the triangle at the vertex.
+// Vertices shared by triangles with mirrored texture coordinates are split, so that each keeps one handedness.
+// adjacency must belong to the current triangles, it is outdated afterwards if vertices were split. returns the number
+// of vertices added by the split.
+size_t calculateTangents(MeshGeometry& mesh, const MeshAdjacency& adjacency);
+
+// Calculates the axis aligned bounding box data.
+void calculateBoundingBox(MeshGeometry& mesh);
+
+// Heightmap of l x w nodes, displaced by the fault algorithm with cosine (0), sine (1) or step (2) faults.
+std::vector<std::vector<double>> generateHeightmap(int l, int w, int iterations, int displacementType);
+
+// Replaces the vertices and triangles of mesh by a grid of l x w nodes centered around the origin, with the heights of
+// heightmap. Rows run along z, each of the w nodes long. Updates the bounding box.
+void generateTerrainGrid(int l, int w, const std::vector<std::vector<double>>& heightmap, MeshGeometry& mesh);
+
+#endif // MESHGEOMETRY_H
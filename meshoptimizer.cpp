@@ -0,0 +1,661 @@
+// ========================================================================= //
+// GRIS - Graphisch Interaktive Systeme                                      //
+// Technische Universität Darmstadt                                          //
+// Fraunhoferstrasse 5                                                       //
+// D-64283 Darmstadt, Germany                                                //
+//                                                                           //
+// Content: Reordering of index buffers for faster rendering                 //
+// ========================================================================= //
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "meshoptimizer.h"
+#include "meshadjacency.h"
+
+namespace {
+
+// Parameters of Forsyth's scoring function. The LRU cache the algorithm models is larger than the simulated FIFO,
+// this keeps recently used vertices attractive a bit longer.
+const int FORSYTH_CACHE_SIZE = 32;
+const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+const float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+const unsigned int FORSYTH_MAX_TABULATED_VALENCE = 64;
+
+// Score of a vertex at a cache position (-1 = not in the cache) that is still used by liveTriangles triangles.
+// Both parts of the score are tabulated, the function is evaluated for every vertex that moves in the cache.
+float vertexScore(int cachePosition, unsigned int liveTriangles) {
+    struct Tables {
+        float cache[FORSYTH_CACHE_SIZE];
+        float valence[FORSYTH_MAX_TABULATED_VALENCE];
+        Tables() {
+            for (int i = 0; i < FORSYTH_CACHE_SIZE; ++i) {
+                // the vertices of the last triangle get the same score, so the order within a triangle does not matter
+                cache[i] = i < 3 ? FORSYTH_LAST_TRIANGLE_SCORE
+                                 : std::pow(1.0f - (i - 3) / static_cast<float>(FORSYTH_CACHE_SIZE - 3), FORSYTH_CACHE_DECAY_POWER);
+            }
+            valence[0] = 0.0f;
+            for (unsigned int i = 1; i < FORSYTH_MAX_TABULATED_VALENCE; ++i)
+                valence[i] = FORSYTH_VALENCE_BOOST_SCALE * std::pow(static_cast<float>(i), -FORSYTH_VALENCE_BOOST_POWER);
+        }
+    };
+    static const Tables tables;
+
+    // vertices without remaining triangles are never chosen
+    if (liveTriangles == 0) return -1.0f;
+    const float cacheScore = cachePosition >= 0 ? tables.cache[cachePosition] : 0.0f;
+    const float valenceScore = liveTriangles < FORSYTH_MAX_TABULATED_VALENCE
+        ? tables.valence[liveTriangles]
+        : FORSYTH_VALENCE_BOOST_SCALE * std::pow(static_cast<float>(liveTriangles), -FORSYTH_VALENCE_BOOST_POWER);
+    // boosting vertices with few remaining triangles finishes off their fans instead of leaving lone triangles behind
+    return cacheScore + valenceScore;
+}
+
+// FIFO post-transform cache. A vertex is in the cache if it was inserted less than size insertions ago.
+class FifoCache {
+    std::vector<size_t> insertedAt;
+    size_t insertions;
+    size_t size;
+
+public:
+    FifoCache(size_t numVertices, size_t size) : insertedAt(numVertices, 0), insertions(size), size(size) {}
+
+    // draws a triangle and returns the number of vertices that had to be transformed
+    unsigned int draw(const Vec3ui& triangle) {
+        unsigned int misses = 0;
+        for (unsigned int k = 0; k < 3; ++k) {
+            if (insertions - insertedAt[triangle[k]] >= size) {
+                insertedAt[triangle[k]] = ++insertions;
+                ++misses;
+            }
+        }
+        return misses;
+    }
+    // evicts all vertices
+    void reset() { insertions += size; }
+};
+
+// Sum of weighted squared distances to a set of planes, stored as the upper half of a symmetric 4x4 matrix.
+struct Quadric {
+    double a2{0.0}, b2{0.0}, c2{0.0}, ab{0.0}, ac{0.0}, bc{0.0}, ad{0.0}, bd{0.0}, cd{0.0}, d2{0.0};
+    double weight{0.0};
+
+    // plane n * p + d = 0 with unit normal n
+    void addPlane(const Vec3f& n, float d, double w) {
+        a2 += w * n[0] * n[0]; b2 += w * n[1] * n[1]; c2 += w * n[2] * n[2];
+        ab += w * n[0] * n[1]; ac += w * n[0] * n[2]; bc += w * n[1] * n[2];
+        ad += w * n[0] * d; bd += w * n[1] * d; cd += w * n[2] * d;
+        d2 += w * d * d;
+        weight += w;
+    }
+    void add(const Quadric& q) {
+        a2 += q.a2; b2 += q.b2; c2 += q.c2; ab += q.ab; ac += q.ac; bc += q.bc;
+        ad += q.ad; bd += q.bd; cd += q.cd; d2 += q.d2;
+        weight += q.weight;
+    }
+    // weighted mean of the squared distances of p to the planes
+    double error(const Vec3f& p) const {
+        const double x = p[0], y = p[1], z = p[2];
+        const double e = a2 * x * x + b2 * y * y + c2 * z * z + 2.0 * (ab * x * y + ac * x * z + bc * y * z)
+                       + 2.0 * (ad * x + bd * y + cd * z) + d2;
+        return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+    }
+};
+
+// Borders are kept in place by planes through the border edges, perpendicular to their triangle. They are weighted
+// stronger than the triangle planes.
+const double SIMPLIFY_BORDER_WEIGHT = 10.0;
+
+// Collapses may turn the normal of a triangle by at most the angle with this cosine.
+const float SIMPLIFY_MIN_NORMAL_COSINE = 0.25f;
+
+struct PositionHash {
+    size_t operator()(const Vec3f& p) const {
+        uint32_t bits[3];
+        std::memcpy(bits, &p, sizeof(bits));
+        return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+    }
+};
+struct PositionEqual {
+    bool operator()(const Vec3f& a, const Vec3f& b) const { return a[0] == b[0] && a[1] == b[1] && a[2] == b[2]; }
+};
+
+} // namespace
+
+VertexCacheStats analyzeVertexCache(const Vec3ui* triangles, size_t numTriangles, size_t numVertices, unsigned int cacheSize) {
+    VertexCacheStats stats;
+    if (numTriangles == 0) return stats;
+    FifoCache cache(numVertices, cacheSize);
+    std::vector<bool> referenced(numVertices, false);
+    size_t numReferenced = 0;
+    for (size_t t = 0; t < numTriangles; ++t) {
+        for (unsigned int k = 0; k < 3; ++k) {
+            if (!referenced[triangles[t][k]]) {
+                referenced[triangles[t][k]] = true;
+                ++numReferenced;
+            }
+        }
+        stats.transformedVertices += cache.draw(triangles[t]);
+    }
+    stats.acmr = static_cast<float>(stats.transformedVertices) / numTriangles;
+    stats.atvr = static_cast<float>(stats.transformedVertices) / numReferenced;
+    return stats;
+}
+
+void optimizeVertexCache(Vec3ui* triangles, size_t numTriangles, size_t numVertices) {
+    if (numTriangles == 0) return;
+
+    // triangles of each vertex. the first liveTriangles[v] entries of a vertex are the triangles not emitted yet.
+    std::vector<unsigned int> liveTriangles(numVertices, 0);
+    for (size_t t = 0; t < numTriangles; ++t)
+        for (unsigned int k = 0; k < 3; ++k) ++liveTriangles[triangles[t][k]];
+    std::vector<size_t> firstTriangle(numVertices + 1, 0);
+    for (size_t v = 0; v < numVertices; ++v) firstTriangle[v + 1] = firstTriangle[v] + liveTriangles[v];
+    std::vector<unsigned int> vertexTriangles(3 * numTriangles);
+    {
+        std::vector<size_t> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+        for (size_t t = 0; t < numTriangles; ++t)
+            for (unsigned int k = 0; k < 3; ++k) vertexTriangles[fill[triangles[t][k]]++] = static_cast<unsigned int>(t);
+    }
+
+    std::vector<float> vertexScores(numVertices);
+    for (size_t v = 0; v < numVertices; ++v) vertexScores[v] = vertexScore(-1, liveTriangles[v]);
+    auto triangleScore = [&](size_t t) {
+        return vertexScores[triangles[t][0]] + vertexScores[triangles[t][1]] + vertexScores[triangles[t][2]];
+    };
+    std::vector<bool> emitted(numTriangles, false);
+
+    std::vector<Vec3ui> order;
+    order.reserve(numTriangles);
+    // LRU cache, the three extra entries hold the vertices that are pushed out by the current triangle
+    std::vector<unsigned int> cache, nextCache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    nextCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+    size_t best = 0;
+    for (size_t t = 1; t < numTriangles; ++t)
+        if (triangleScore(t) > triangleScore(best)) best = t;
+    size_t scanPosition = 0;
+    while (order.size() < numTriangles) {
+        // no triangle around the cache is left, continue with the next triangle in input order. every triangle is
+        // passed by the scan at most once, which keeps the algorithm linear.
+        if (best == numTriangles) {
+            while (emitted[scanPosition]) ++scanPosition;
+            best = scanPosition;
+        }
+
+        const Vec3ui triangle = triangles[best];
+        order.push_back(triangle);
+        emitted[best] = true;
+        for (unsigned int k = 0; k < 3; ++k) {
+            const unsigned int v = triangle[k];
+            unsigned int* live = vertexTriangles.data() + firstTriangle[v];
+            const unsigned int* position = std::find(live, live + liveTriangles[v], static_cast<unsigned int>(best));
+            std::swap(live[position - live], live[liveTriangles[v] - 1]);
+            --liveTriangles[v];
+        }
+
+        // move the vertices of the triangle to the front of the cache
+        nextCache.clear();
+        for (unsigned int k = 0; k < 3; ++k)
+            if (std::find(nextCache.begin(), nextCache.end(), triangle[k]) == nextCache.end()) nextCache.push_back(triangle[k]);
+        for (unsigned int v : cache)
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) nextCache.push_back(v);
+        for (size_t i = 0; i < nextCache.size(); ++i) {
+            const int cachePosition = i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1;
+            vertexScores[nextCache[i]] = vertexScore(cachePosition, liveTriangles[nextCache[i]]);
+        }
+
+        // only the triangles of vertices whose score changed need a new score, the best of them is emitted next
+        best = numTriangles;
+        float bestScore = -1.0f;
+        for (unsigned int v : nextCache) {
+            const unsigned int* live = vertexTriangles.data() + firstTriangle[v];
+            for (unsigned int i = 0; i < liveTriangles[v]; ++i) {
+                const unsigned int t = live[i];
+                const float score = triangleScore(t);
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = t;
+                }
+            }
+        }
+        if (nextCache.size() > FORSYTH_CACHE_SIZE) nextCache.resize(FORSYTH_CACHE_SIZE);
+        std::swap(cache, nextCache);
+    }
+    std::copy(order.begin(), order.end(), triangles);
+}
+
+void optimizeOverdraw(Vec3ui* triangles, size_t numTriangles, const Vec3f* vertices, size_t numVertices, float threshold) {
+    if (numTriangles == 0) return;
+    FifoCache cache(numVertices, VERTEX_CACHE_SIZE);
+
+    // hard boundaries: the cache misses all vertices of the triangle, starting a new cluster here costs nothing
+    std::vector<size_t> hardBoundaries;
+    for (size_t t = 0; t < numTriangles; ++t)
+        if (cache.draw(triangles[t]) == 3) hardBoundaries.push_back(t);
+    hardBoundaries.push_back(numTriangles);
+
+    // soft boundaries: split a cluster as soon as its ACMR is close enough to the ACMR of the whole hard cluster.
+    // the cache is reset at every boundary, so the clusters stay efficient in any order.
+    std::vector<size_t> clusters;
+    for (size_t i = 0; i + 1 < hardBoundaries.size(); ++i) {
+        const size_t first = hardBoundaries[i], last = hardBoundaries[i + 1];
+        cache.reset();
+        size_t misses = 0;
+        for (size_t t = first; t < last; ++t) misses += cache.draw(triangles[t]);
+        const float limit = threshold * misses / (last - first);
+
+        cache.reset();
+        clusters.push_back(first);
+        size_t clusterMisses = 0, clusterTriangles = 0;
+        for (size_t t = first; t + 1 < last; ++t) {
+            clusterMisses += cache.draw(triangles[t]);
+            ++clusterTriangles;
+            if (clusterMisses <= limit * clusterTriangles) {
+                clusters.push_back(t + 1);
+                cache.reset();
+                clusterMisses = clusterTriangles = 0;
+            }
+        }
+    }
+    clusters.push_back(numTriangles);
+
+    // area weighted centroid and normal of every cluster
+    const size_t numClusters = clusters.size() - 1;
+    std::vector<Vec3f> centroids(numClusters), clusterNormals(numClusters);
+    std::vector<float> areas(numClusters, 0.0f);
+    Vec3f meshCentroid;
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < numClusters; ++c) {
+        for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+            const Vec3f& a = vertices[triangles[t][0]];
+            const Vec3f& b = vertices[triangles[t][1]];
+            const Vec3f& d = vertices[triangles[t][2]];
+            const Vec3f normal = cross(b - a, d - a);
+            const float area = normal.length();
+            centroids[c] += (a + b + d) * (area / 3.0f);
+            clusterNormals[c] += normal;
+            areas[c] += area;
+        }
+        meshCentroid += centroids[c];
+        meshArea += areas[c];
+    }
+    if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+    std::vector<float> sortKeys(numClusters, 0.0f);
+    for (size_t c = 0; c < numClusters; ++c) {
+        if (areas[c] <= 0.0f) continue;
+        sortKeys[c] = (centroids[c] / areas[c] - meshCentroid) * clusterNormals[c].normalized();
+    }
+    std::vector<size_t> order(numClusters);
+    for (size_t c = 0; c < numClusters; ++c) order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<Vec3ui> sorted;
+    sorted.reserve(numTriangles);
+    for (size_t c : order) sorted.insert(sorted.end(), triangles + clusters[c], triangles + clusters[c + 1]);
+    std::copy(sorted.begin(), sorted.end(), triangles);
+}
+
+std::vector<unsigned int> optimizeVertexFetch(Vec3ui* triangles, size_t numTriangles, size_t numVertices) {
+    const unsigned int UNUSED = ~0u;
+    std::vector<unsigned int> remap(numVertices, UNUSED);
+    unsigned int next = 0;
+    for (size_t t = 0; t < numTriangles; ++t) {
+        for (unsigned int k = 0; k < 3; ++k) {
+            unsigned int& index = remap[triangles[t][k]];
+            if (index == UNUSED) index = next++;
+            triangles[t][k] = index;
+        }
+    }
+    for (auto& index : remap)
+        if (index == UNUSED) index = next++;
+    return remap;
+}
+
+GridStrips buildGridStrips(unsigned int rows, unsigned int columns, bool risingDiagonal) {
+    GridStrips strips;
+    if (rows < 2 || columns < 2) return strips;
+    // 0xFFFF is the restart index, so a chunk can use 65535 vertices
+    const size_t maxChunkVertices = 0xFFFF;
+    const bool shortIndices = 2 * static_cast<size_t>(columns) <= maxChunkVertices;
+    // strip of the cells between row and row + 1, relative to the first vertex of the chunk
+    auto appendRowStrip = [&](auto& indices, unsigned int row, unsigned int chunkRow) {
+        using Index = typename std::decay<decltype(indices)>::type::value_type;
+        const size_t upper = static_cast<size_t>(row - chunkRow) * columns, lower = upper + columns;
+        for (unsigned int column = 0; column < columns; ++column) {
+            // the diagonal runs between the second vertex of a column and the first vertex of the next column
+            indices.push_back(static_cast<Index>((risingDiagonal ? lower : upper) + column));
+            indices.push_back(static_cast<Index>((risingDiagonal ? upper : lower) + column));
+        }
+    };
+
+    unsigned int row = 0;
+    while (row + 1 < rows) {
+        StripChunk chunk;
+        chunk.firstIndex = shortIndices ? strips.shortIndices.size() : strips.longIndices.size();
+        chunk.baseVertex = static_cast<int>(static_cast<size_t>(row) * columns);
+        chunk.numTriangles = 0;
+        const unsigned int chunkRow = row;
+        // the last row of a strip is also the first row of the next one, the chunks overlap by one row of vertices
+        while (row + 1 < rows && (!shortIndices || static_cast<size_t>(row + 2 - chunkRow) * columns <= maxChunkVertices)) {
+            if (row != chunkRow) {
+                if (shortIndices) strips.shortIndices.push_back(0xFFFF);
+                else strips.longIndices.push_back(0xFFFFFFFFu);
+            }
+            if (shortIndices) appendRowStrip(strips.shortIndices, row, chunkRow);
+            else appendRowStrip(strips.longIndices, row, chunkRow);
+            chunk.numTriangles += 2 * (columns - 1);
+            ++row;
+        }
+        chunk.numIndices = (shortIndices ? strips.shortIndices.size() : strips.longIndices.size()) - chunk.firstIndex;
+        strips.chunks.push_back(chunk);
+    }
+    return strips;
+}
+
+std::vector<Vec3ui> simplifyMesh(const Vec3ui* triangles, size_t numTriangles, const Vec3f* vertices, size_t numVertices,
+                                 size_t targetTriangles, float& error) {
+    error = 0.0f;
+    std::vector<Vec3ui> result;
+    result.reserve(numTriangles);
+    for (size_t t = 0; t < numTriangles; ++t) {
+        const Vec3ui& triangle = triangles[t];
+        if (triangle[0] != triangle[1] && triangle[1] != triangle[2] && triangle[0] != triangle[2]) result.push_back(triangle);
+    }
+
+    // vertices with the same position as another vertex are seams, moving them would open cracks
+    std::vector<bool> locked(numVertices, false);
+    {
+        std::unordered_map<Vec3f, unsigned int, PositionHash, PositionEqual> firstAtPosition;
+        for (size_t v = 0; v < numVertices; ++v) {
+            auto inserted = firstAtPosition.emplace(vertices[v], static_cast<unsigned int>(v));
+            if (!inserted.second) locked[v] = locked[inserted.first->second] = true;
+        }
+    }
+
+    // triangles and neighbours of each vertex of the current result
+    MeshAdjacency adjacency;
+    auto buildAdjacency = [&]() { adjacency.build(result.data(), result.size(), numVertices, false); };
+    // number of triangles of a that also use b
+    auto sharedTriangles = [&](unsigned int a, unsigned int b) {
+        unsigned int count = 0;
+        for (unsigned int t : adjacency.getTriangles(a)) {
+            const Vec3ui& triangle = result[t];
+            if (triangle[0] == b || triangle[1] == b || triangle[2] == b) ++count;
+        }
+        return count;
+    };
+
+    // quadrics of the triangle planes and of the borders. the border planes are also kept to measure the error.
+    std::vector<Quadric> quadrics(numVertices);
+    struct BorderPlane {
+        unsigned int vertex;
+        Vec3f normal;
+        float d;
+    };
+    std::vector<BorderPlane> borderPlanes;
+    buildAdjacency();
+    for (const auto& triangle : result) {
+        Vec3f normal = cross(vertices[triangle[1]] - vertices[triangle[0]], vertices[triangle[2]] - vertices[triangle[0]]);
+        const float doubleArea = normal.length();
+        if (doubleArea <= 0.0f) continue;
+        normal /= doubleArea;
+        for (unsigned int k = 0; k < 3; ++k)
+            quadrics[triangle[k]].addPlane(normal, -(normal * vertices[triangle[0]]), 0.5 * doubleArea);
+        for (unsigned int k = 0; k < 3; ++k) {
+            const unsigned int a = triangle[k], b = triangle[(k + 1) % 3];
+            if (sharedTriangles(a, b) != 1) continue;
+            const Vec3f edge = vertices[b] - vertices[a];
+            const Vec3f borderNormal = cross(edge, normal).normalized();
+            const double w = SIMPLIFY_BORDER_WEIGHT * edge.sqlength();
+            quadrics[a].addPlane(borderNormal, -(borderNormal * vertices[a]), w);
+            quadrics[b].addPlane(borderNormal, -(borderNormal * vertices[a]), w);
+            borderPlanes.push_back(BorderPlane{ a, borderNormal, -(borderNormal * vertices[a]) });
+            borderPlanes.push_back(BorderPlane{ b, borderNormal, -(borderNormal * vertices[a]) });
+        }
+    }
+
+    struct Collapse {
+        unsigned int from, to;
+        double cost;
+    };
+    std::vector<Collapse> collapses;
+    std::vector<unsigned int> remap(numVertices);
+    std::vector<bool> touched(numVertices);
+    // vertex every original vertex has been moved onto
+    std::vector<unsigned int> target(numVertices);
+    for (unsigned int v = 0; v < numVertices; ++v) target[v] = v;
+    while (result.size() > targetTriangles) {
+        // cheapest allowed collapse of every vertex
+        collapses.clear();
+        for (unsigned int a = 0; a < numVertices; ++a) {
+            if (locked[a] || adjacency.getTriangles(a).empty()) continue;
+            const IndexRange neighbours = adjacency.getNeighbours(a);
+            bool border = false, manifold = true;
+            for (unsigned int b : neighbours) {
+                const unsigned int shared = sharedTriangles(a, b);
+                border = border || shared == 1;
+                manifold = manifold && shared <= 2;
+            }
+            if (!manifold) continue;
+            Collapse best{ a, a, 0.0 };
+            for (unsigned int b : neighbours) {
+                if (border && sharedTriangles(a, b) != 1) continue;
+                const double cost = quadrics[a].error(vertices[b]);
+                if (best.to == a || cost < best.cost) best = Collapse{ a, b, cost };
+            }
+            if (best.to != a) collapses.push_back(best);
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+        // collapse independent vertices, the triangles around a collapse do not change otherwise during the pass
+        for (unsigned int v = 0; v < numVertices; ++v) remap[v] = v;
+        std::fill(touched.begin(), touched.end(), false);
+        size_t remaining = result.size(), numCollapses = 0;
+        for (const Collapse& collapse : collapses) {
+            if (remaining <= targetTriangles) break;
+            const unsigned int a = collapse.from, b = collapse.to;
+            if (touched[a] || touched[b]) continue;
+
+            // link condition: a and b may only share the neighbours of their common triangles. the neighbour lists are
+            // sorted, so they are intersected in one pass.
+            const IndexRange neighbours = adjacency.getNeighbours(a), otherNeighbours = adjacency.getNeighbours(b);
+            size_t common = 0;
+            for (const unsigned int *i = neighbours.begin(), *j = otherNeighbours.begin(); i != neighbours.end() && j != otherNeighbours.end();) {
+                if (*i < *j) ++i;
+                else if (*j < *i) ++j;
+                else { ++common; ++i; ++j; }
+            }
+            const unsigned int shared = sharedTriangles(a, b);
+            if (common != shared) continue;
+
+            // no remaining triangle of a may flip or turn by more than about 75 degrees, that also rules out slivers
+            bool flips = false;
+            for (unsigned int t : adjacency.getTriangles(a)) {
+                if (flips) break;
+                const Vec3ui& triangle = result[t];
+                if (triangle[0] == b || triangle[1] == b || triangle[2] == b) continue;
+                Vec3f corners[3], moved[3];
+                for (unsigned int k = 0; k < 3; ++k) {
+                    corners[k] = vertices[triangle[k]];
+                    moved[k] = triangle[k] == a ? vertices[b] : corners[k];
+                }
+                const Vec3f before = cross(corners[1] - corners[0], corners[2] - corners[0]);
+                const Vec3f after = cross(moved[1] - moved[0], moved[2] - moved[0]);
+                flips = before * after <= SIMPLIFY_MIN_NORMAL_COSINE * before.length() * after.length();
+            }
+            if (flips) continue;
+
+            remap[a] = b;
+            quadrics[b].add(quadrics[a]);
+            remaining -= shared;
+            ++numCollapses;
+            for (unsigned int t : adjacency.getTriangles(a))
+                for (unsigned int k = 0; k < 3; ++k) touched[result[t][k]] = true;
+        }
+        if (numCollapses == 0) break;
+        for (auto& v : target) v = remap[v];
+
+        size_t kept = 0;
+        for (const auto& triangle : result) {
+            const Vec3ui collapsed(remap[triangle[0]], remap[triangle[1]], remap[triangle[2]]);
+            if (collapsed[0] != collapsed[1] && collapsed[1] != collapsed[2] && collapsed[0] != collapsed[2]) result[kept++] = collapsed;
+        }
+        result.resize(kept);
+        buildAdjacency();
+    }
+
+    // the quadric costs only order the collapses, they are weighted means that merging dilutes. the error is the
+    // largest distance of a moved vertex from the planes of its original triangles and borders.
+    auto moveError = [&](unsigned int v, const Vec3f& normal, float d) {
+        if (target[v] != v) error = std::max(error, std::fabs(normal * vertices[target[v]] + d));
+    };
+    for (size_t t = 0; t < numTriangles; ++t) {
+        const Vec3ui& triangle = triangles[t];
+        if (target[triangle[0]] == triangle[0] && target[triangle[1]] == triangle[1] && target[triangle[2]] == triangle[2]) continue;
+        Vec3f normal = cross(vertices[triangle[1]] - vertices[triangle[0]], vertices[triangle[2]] - vertices[triangle[0]]);
+        const float doubleArea = normal.length();
+        if (doubleArea <= 0.0f) continue;
+        normal /= doubleArea;
+        for (unsigned int k = 0; k < 3; ++k) moveError(triangle[k], normal, -(normal * vertices[triangle[0]]));
+    }
+    for (const auto& plane : borderPlanes) moveError(plane.vertex, plane.normal, plane.d);
+    return result;
+}
+
+std::vector<Meshlet> buildMeshlets(Vec3ui* triangles, size_t numTriangles, const Vec3f* vertices, size_t numVertices,
+                                   unsigned int maxVertices, unsigned int maxTriangles) {
+    std::vector<Meshlet> meshlets;
+    if (numTriangles == 0) return meshlets;
+    maxVertices = std::max(maxVertices, 3u);
+    maxTriangles = std::max(maxTriangles, 1u);
+
+    // unit normals. degenerate triangles keep a zero normal, so they fail the MESHLET_MIN_NORMAL_COSINE test like
+    // triangles facing away, never join a meshlet and only start one of their own. they are left out of the cone.
+    // Vec3::normalize gives up below EPS, which small models reach easily with the cross product.
+    std::vector<Vec3f> normals(numTriangles, Vec3f(0.0f));
+    for (size_t t = 0; t < numTriangles; ++t) {
+        const Vec3ui& triangle = triangles[t];
+        const Vec3f normal = cross(vertices[triangle[1]] - vertices[triangle[0]], vertices[triangle[2]] - vertices[triangle[0]]);
+        const float length = normal.length();
+        if (length > 0.0f) normals[t] = normal / length;
+    }
+
+    // triangles around each position. texture and normal seams split a mesh into many small pieces of connected
+    // vertices, the meshlets grow across them.
+    std::vector<unsigned int> positionOf(numVertices);
+    {
+        std::unordered_map<Vec3f, unsigned int, PositionHash, PositionEqual> firstAtPosition;
+        for (size_t v = 0; v < numVertices; ++v)
+            positionOf[v] = firstAtPosition.emplace(vertices[v], static_cast<unsigned int>(v)).first->second;
+    }
+    MeshAdjacency positionAdjacency;
+    {
+        std::vector<Vec3ui> positionTriangles(numTriangles);
+        for (size_t t = 0; t < numTriangles; ++t)
+            for (unsigned int k = 0; k < 3; ++k) positionTriangles[t][k] = positionOf[triangles[t][k]];
+        positionAdjacency.build(positionTriangles.data(), numTriangles, numVertices, false);
+    }
+
+    // bounds of the triangles [first, first + count) of order
+    std::vector<Vec3ui> order;
+    order.reserve(numTriangles);
+    auto finish = [&](size_t first, size_t count, const std::vector<size_t>& members) {
+        Meshlet meshlet{ first, count, Vec3f(0.0f), 0.0f, Vec3f(0.0f), 1.0f };
+        Vec3f lower(FLT_MAX), upper(-FLT_MAX);
+        for (size_t t = first; t < first + count; ++t)
+            for (unsigned int k = 0; k < 3; ++k)
+                for (unsigned int c = 0; c < 3; ++c) {
+                    lower[c] = std::min(lower[c], vertices[order[t][k]][c]);
+                    upper[c] = std::max(upper[c], vertices[order[t][k]][c]);
+                }
+        meshlet.center = 0.5f * (lower + upper);
+        for (size_t t = first; t < first + count; ++t)
+            for (unsigned int k = 0; k < 3; ++k)
+                meshlet.radius = std::max(meshlet.radius, (vertices[order[t][k]] - meshlet.center).length());
+        Vec3f normalSum(0.0f);
+        for (size_t t : members) normalSum += normals[t];
+        if (normalSum.normalize()) {
+            float minDot = 1.0f;
+            for (size_t t : members)
+                if (normals[t].sqlength() > 0.0f) minDot = std::min(minDot, normals[t] * normalSum);
+            meshlet.coneAxis = normalSum;
+            meshlet.coneCutoff = minDot <= 0.0f ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+        }
+        meshlets.push_back(meshlet);
+    };
+
+    // meshlet that used a vertex or position last and meshlet a triangle is a candidate of, so that each is counted once
+    std::vector<size_t> vertexMeshlet(numVertices, SIZE_MAX), positionMeshlet(numVertices, SIZE_MAX);
+    std::vector<size_t> candidateMeshlet(numTriangles, SIZE_MAX);
+    std::vector<bool> emitted(numTriangles, false);
+    std::vector<size_t> members, candidates;
+    size_t scanPosition = 0;
+    while (order.size() < numTriangles) {
+        // grow a meshlet from the next triangle in input order
+        while (emitted[scanPosition]) ++scanPosition;
+        const size_t current = meshlets.size();
+        members.clear();
+        candidates.clear();
+        Vec3f normalSum(0.0f);
+        unsigned int numMeshletVertices = 0;
+        auto newVertices = [&](size_t t) {
+            unsigned int count = 0;
+            for (unsigned int k = 0; k < 3; ++k) count += vertexMeshlet[triangles[t][k]] != current;
+            return count;
+        };
+        size_t next = scanPosition;
+        while (next != SIZE_MAX) {
+            numMeshletVertices += newVertices(next);
+            emitted[next] = true;
+            order.push_back(triangles[next]);
+            members.push_back(next);
+            normalSum += normals[next];
+            for (unsigned int k = 0; k < 3; ++k) {
+                vertexMeshlet[triangles[next][k]] = current;
+                const unsigned int position = positionOf[triangles[next][k]];
+                if (positionMeshlet[position] == current) continue;
+                positionMeshlet[position] = current;
+                for (unsigned int neighbour : positionAdjacency.getTriangles(position)) {
+                    if (emitted[neighbour] || candidateMeshlet[neighbour] == current) continue;
+                    candidateMeshlet[neighbour] = current;
+                    candidates.push_back(neighbour);
+                }
+            }
+            if (members.size() == maxTriangles) break;
+
+            // the neighbour that adds the fewest vertices, among those the one closest to the average normal. a
+            // neighbour facing away from the average normal would make the cone useless for culling.
+            const Vec3f axis = normalSum.normalized();
+            next = SIZE_MAX;
+            float bestScore = FLT_MAX;
+            size_t kept = 0;
+            for (size_t candidate : candidates) {
+                if (emitted[candidate]) continue;
+                candidates[kept++] = candidate;
+                const unsigned int added = newVertices(candidate);
+                const float alignment = normals[candidate] * axis;
+                if (numMeshletVertices + added > maxVertices || alignment < MESHLET_MIN_NORMAL_COSINE) continue;
+                const float score = static_cast<float>(added) + MESHLET_CONE_WEIGHT * (1.0f - alignment);
+                if (score < bestScore) {
+                    bestScore = score;
+                    next = candidate;
+                }
+            }
+            candidates.resize(kept);
+        }
+        finish(order.size() - members.size(), members.size(), members);
+    }
+    std::copy(order.begin(), order.end(), triangles);
+    return meshlets;
+}
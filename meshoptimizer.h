@@ -0,0 +1,137 @@
+// ========================================================================= //
+// GRIS - Graphisch Interaktive Systeme                                      //
+// Technische Universität Darmstadt                                          //
+// Fraunhoferstrasse 5                                                       //
+// D-64283 Darmstadt, Germany                                                //
+//                                                                           //
+// Content: Reordering of index buffers for faster rendering                 //
+//   * vertex cache optimization of the triangle order (Forsyth)             //
+//   * ACMR/ATVR analysis with a simulated FIFO post-transform cache         //
+//   * cluster sorting against overdraw                                      //
+//   * vertex renumbering in first-use order for linear vertex fetches       //
+//   * triangle strips with primitive restart for grid meshes                //
+//   * quadric error simplification for levels of detail                     //
+//   * meshlets with bounding spheres and normal cones for culling           //
+// ========================================================================= //
+
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "vec3.h"
+
+// Overdraw optimization may raise the ACMR of a cluster by at most this factor.
+const float OVERDRAW_THRESHOLD = 1.05f;
+
+// Size of the simulated post-transform cache. Current GPUs do not have a classic FIFO cache any more, but the
+// vertex reuse within a batch behaves similar to a small FIFO.
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+// Vertex shader invocations of a triangle order.
+struct VertexCacheStats {
+    size_t transformedVertices{0};
+    // average cache miss ratio: transformed vertices per triangle, 0.5 is ideal for large grids, 3 is the worst case
+    float acmr{0.0f};
+    // average transform to vertex ratio: transformed vertices per referenced vertex, 1 is ideal
+    float atvr{0.0f};
+};
+
+// Simulates a FIFO cache of cacheSize vertices while the triangles are drawn in order.
+VertexCacheStats analyzeVertexCache(const Vec3ui* triangles, size_t numTriangles, size_t numVertices,
+                                    unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders the triangles so that consecutive triangles share vertices, following Tom Forsyth's "Linear-Speed Vertex
+// Cache Optimisation". The vertices and the winding of the triangles stay untouched. Runs in linear time.
+void optimizeVertexCache(Vec3ui* triangles, size_t numTriangles, size_t numVertices);
+
+// Reduces overdraw of a vertex cache optimized triangle order, following Sander et al. "Fast Triangle Reordering for
+// Vertex Locality and Reduced Overdraw". The order is split into clusters where the simulated cache runs empty anyway,
+// and further where the ACMR of the cluster so far is at most threshold times the ACMR of the surrounding cluster.
+// Clusters are then sorted so that clusters facing away from the center of the mesh come first, they are likely to
+// occlude the others from any view direction. The order within a cluster is kept.
+void optimizeOverdraw(Vec3ui* triangles, size_t numTriangles, const Vec3f* vertices, size_t numVertices,
+                      float threshold = OVERDRAW_THRESHOLD);
+
+// Renumbers the vertices in the order the triangles first use them, so that vertex fetches walk through memory.
+// Rewrites the indices and returns the new index of every old vertex. Vertices no triangle uses are moved to the end.
+std::vector<unsigned int> optimizeVertexFetch(Vec3ui* triangles, size_t numTriangles, size_t numVertices);
+
+// Moves every element of an attribute array to its new index. Arrays that do not have one element per vertex are
+// left untouched.
+template<typename T>
+void remapVertexAttribute(std::vector<T>& data, const std::vector<unsigned int>& remap) {
+    if (data.size() != remap.size()) return;
+    std::vector<T> remapped(data.size());
+    for (size_t i = 0; i < data.size(); ++i) remapped[remap[i]] = data[i];
+    data.swap(remapped);
+}
+
+// Simplified levels of detail may deviate from the full mesh by at most this many pixels on screen.
+const float LOD_PIXEL_ERROR = 1.0f;
+
+// Limits of a meshlet. 64 vertices and 124 triangles is the layout mesh shaders prefer, for CPU culling it keeps the
+// clusters small enough to be culled separately and large enough to make the culling cheap.
+const unsigned int MESHLET_MAX_VERTICES = 64;
+const unsigned int MESHLET_MAX_TRIANGLES = 124;
+// A meshlet only grows by triangles whose normal has at least this cosine to the average normal so far.
+const float MESHLET_MIN_NORMAL_COSINE = 0.5f;
+// Weight of the normal deviation against the number of new vertices when a meshlet grows.
+const float MESHLET_CONE_WEIGHT = 1.0f;
+
+// Part of a strip index buffer that is drawn with one glDrawElementsBaseVertex call.
+struct StripChunk {
+    size_t firstIndex;
+    size_t numIndices;
+    int baseVertex;
+    size_t numTriangles;
+};
+
+// Index buffer of a grid mesh as triangle strips, one strip per pair of neighbouring rows, separated by the restart
+// index (all bits set). If every chunk can address its vertices with 16 bits relative to its base vertex, shortIndices
+// is filled, otherwise longIndices holds one chunk for the whole grid.
+struct GridStrips {
+    std::vector<uint16_t> shortIndices;
+    std::vector<uint32_t> longIndices;
+    std::vector<StripChunk> chunks;
+};
+
+// Builds the strips of a grid of rows x columns vertices that are numbered row by row. Each cell is split along the
+// diagonal from (row, column + 1) to (row + 1, column), or from (row, column) to (row + 1, column + 1) if risingDiagonal
+// is set. The winding of the strip follows the first triangle of each row, (row + 1, 0), (row, 0), (row + 1, 1) or
+// (row, 0), (row + 1, 0), (row, 1).
+GridStrips buildGridStrips(unsigned int rows, unsigned int columns, bool risingDiagonal);
+
+// Simplifies a mesh to at most targetTriangles triangles by edge collapses in order of their quadric error (Garland
+// and Heckbert). Every collapse moves a vertex onto one of its neighbours, so the result indexes the same vertices and
+// can share their VBO. Vertices that share their position with another vertex (texture or normal seams) and
+// non-manifold vertices stay in place, border vertices only move along the border. Collapses that would flip a
+// triangle are skipped, so the target may not be reached. error receives the largest distance between the final position
+// of a moved vertex and the planes of its original triangles and border edges, in the units of the vertex positions.
+std::vector<Vec3ui> simplifyMesh(const Vec3ui* triangles, size_t numTriangles, const Vec3f* vertices, size_t numVertices,
+                                 size_t targetTriangles, float& error);
+
+// Consecutive triangles of a mesh with the bounds to cull them together.
+struct Meshlet {
+    size_t firstTriangle;
+    size_t numTriangles;
+    // bounding sphere
+    Vec3f center;
+    float radius;
+    // the triangle normals are within the cone around coneAxis whose opening angle has the sine coneCutoff. all
+    // triangles face away from a camera at eye if dot(center - eye, coneAxis) >= coneCutoff * |center - eye| + radius.
+    // coneCutoff is 1 if the normals spread over more than a half space, then the meshlet is never backfacing.
+    Vec3f coneAxis;
+    float coneCutoff;
+};
+
+// Groups the triangles into meshlets of at most maxVertices distinct vertices and maxTriangles triangles each, and
+// reorders them so that every meshlet is one range of the index buffer. A meshlet grows from the next unused triangle in
+// input order by the neighbouring triangle that adds the fewest vertices and deviates least from the average normal, so
+// the cones stay narrow enough for backface culling and the vertex reuse within a meshlet stays high.
+std::vector<Meshlet> buildMeshlets(Vec3ui* triangles, size_t numTriangles, const Vec3f* vertices, size_t numVertices,
+                                   unsigned int maxVertices = MESHLET_MAX_VERTICES, unsigned int maxTriangles = MESHLET_MAX_TRIANGLES);
+
+#endif // MESHOPTIMIZER_H
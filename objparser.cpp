@@ -0,0 +1,679 @@
+// ========================================================================= //
+// GRIS - Graphisch Interaktive Systeme                                      //
+// Technische Universität Darmstadt                                          //
+// Fraunhoferstrasse 5                                                       //
+// D-64283 Darmstadt, Germany                                                //
+//                                                                           //
+// Content: Memory-mapped, allocation-free scanner for OBJ files             //
+// ========================================================================= //
+
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <string>
+
+#include "objparser.h"
+#include "parallel.h"
+
+MappedFile::MappedFile(const char* fileName) : file(fileName) {
+    if (!file.open(QFile::ReadOnly)) return;
+    opened = true;
+    length = static_cast<size_t>(file.size());
+    if (length == 0) return;
+    mapped = file.map(0, file.size());
+    if (mapped) {
+        first = reinterpret_cast<const char*>(mapped);
+    } else {
+        // some file systems do not support mapping, read the whole file instead
+        fallback = file.readAll();
+        first = fallback.constData();
+        length = static_cast<size_t>(fallback.size());
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (mapped) file.unmap(mapped);
+}
+
+void ObjData::clear() {
+    vertices.clear();
+    texCoords.clear();
+    normals.clear();
+    corners.clear();
+    faceSizes.clear();
+    boundingBoxMin = Vec3f(FLT_MAX, FLT_MAX, FLT_MAX);
+    boundingBoxMax = Vec3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    droppedFaces = 0;
+    materialNames.clear();
+    materialRuns.clear();
+    materialLibraries.clear();
+}
+
+namespace {
+
+inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f'; }
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+inline const char* skipBlanks(const char* p, const char* end) {
+    while (p < end && isBlank(*p)) ++p;
+    return p;
+}
+
+inline const char* skipLine(const char* p, const char* end) {
+    const void* nl = std::memchr(p, '\n', end - p);
+    return nl ? static_cast<const char*>(nl) + 1 : end;
+}
+
+// Parses a signed integer like "ss >> num" does. Returns false if p does not start with an integer.
+inline bool parseInt(const char*& p, const char* end, int& out) {
+    const char* q = p;
+    bool negative = false;
+    if (q < end && (*q == '-' || *q == '+')) negative = *q++ == '-';
+    if (q >= end || !isDigit(*q)) return false;
+    long long value = 0;
+    while (q < end && isDigit(*q)) {
+        if (value < 1000000000000LL) value = value * 10 + (*q - '0');
+        ++q;
+    }
+    out = static_cast<int>(negative ? -value : value);
+    p = q;
+    return true;
+}
+
+// Parses a decimal floating point number. The result is correctly rounded, just like strtof, so that the
+// parsed values are bit-identical to the ones the old iostream based loader produced.
+bool parseFloat(const char*& p, const char* end, float& out) {
+    static const float powersOfTen[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+    const char* start = p;
+    const char* q = p;
+    bool negative = false;
+    if (q < end && (*q == '-' || *q == '+')) negative = *q++ == '-';
+
+    uint64_t mantissa = 0;
+    int significantDigits = 0, exponent = 0;
+    bool anyDigit = false;
+    while (q < end && isDigit(*q)) {
+        anyDigit = true;
+        if (mantissa != 0 || *q != '0') {
+            if (significantDigits < 19) mantissa = mantissa * 10 + (*q - '0');
+            else ++exponent;
+            ++significantDigits;
+        }
+        ++q;
+    }
+    if (q < end && *q == '.') {
+        ++q;
+        while (q < end && isDigit(*q)) {
+            anyDigit = true;
+            if (mantissa != 0 || *q != '0') {
+                if (significantDigits < 19) {
+                    mantissa = mantissa * 10 + (*q - '0');
+                    --exponent;
+                }
+                ++significantDigits;
+            } else {
+                --exponent;
+            }
+            ++q;
+        }
+    }
+    if (!anyDigit) return false;
+    if (q < end && (*q == 'e' || *q == 'E')) {
+        const char* e = q + 1;
+        int exp10 = 0;
+        if (parseInt(e, end, exp10)) {
+            exponent += exp10;
+            q = e;
+        }
+    }
+    p = q;
+
+    // Fast path (Clinger): mantissa and power of ten are exact floats, so a single rounding step is correct.
+    if (mantissa == 0) {
+        out = negative ? -0.0f : 0.0f;
+        return true;
+    }
+    if (significantDigits <= 19 && mantissa <= (1u << 24) && exponent >= -10 && exponent <= 10) {
+        float value = static_cast<float>(mantissa);
+        value = exponent < 0 ? value / powersOfTen[-exponent] : value * powersOfTen[exponent];
+        out = negative ? -value : value;
+        return true;
+    }
+
+    // Slow path for long mantissas and large exponents.
+    char buffer[128];
+    const size_t tokenLength = static_cast<size_t>(q - start);
+    if (tokenLength < sizeof(buffer)) {
+        std::memcpy(buffer, start, tokenLength);
+        buffer[tokenLength] = '\0';
+        out = std::strtof(buffer, nullptr);
+    } else {
+        out = std::strtof(std::string(start, tokenLength).c_str(), nullptr);
+    }
+    return true;
+}
+
+// Returns the rest of the line without surrounding blanks.
+inline std::string restOfLine(const char* p, const char* end) {
+    p = skipBlanks(p, end);
+    const char* q = p < end ? static_cast<const char*>(std::memchr(p, '\n', end - p)) : nullptr;
+    if (!q) q = end;
+    while (q > p && isBlank(q[-1])) --q;
+    return std::string(p, q);
+}
+
+// Index of name in names, name is appended if it is not in there yet.
+int findOrAdd(std::vector<std::string>& names, const std::string& name) {
+    const auto it = std::find(names.begin(), names.end(), name);
+    if (it != names.end()) return static_cast<int>(it - names.begin());
+    names.push_back(name);
+    return static_cast<int>(names.size() - 1);
+}
+
+inline bool parseVec3(const char*& p, const char* end, Vec3f& out) {
+    for (unsigned int i = 0; i < 3; ++i) {
+        p = skipBlanks(p, end);
+        if (!parseFloat(p, end, out[i])) return false;
+    }
+    return true;
+}
+
+inline bool parseTexCoord(const char*& p, const char* end, ObjTexCoord& out) {
+    p = skipBlanks(p, end);
+    if (!parseFloat(p, end, out.u)) return false;
+    // the v coordinate is optional
+    const char* q = skipBlanks(p, end);
+    if (parseFloat(q, end, out.v)) p = q;
+    else out.v = 0.0f;
+    return true;
+}
+
+// Parses one attribute index of a face corner and converts it to a 0-based index. Negative indices refer to the
+// numAttributes entries that precede the face.
+inline bool parseIndex(const char*& p, const char* end, size_t numAttributes, int& index, bool& relative) {
+    int num;
+    if (!parseInt(p, end, num)) return false;
+    relative = num < 0;
+    // convert negative indices to positive indices
+    if (relative) num = static_cast<int>(numAttributes) + 1 + num;
+    // Store and convert OBJ's 1-based indices to the required 0-based indices!
+    index = num - 1;
+    return true;
+}
+
+// Scans [begin, end) and appends its entries to out. Negative face indices are resolved relative to the attributes
+// already in out. If the text is only one chunk of a file, the attributes of the preceding chunks are unknown at
+// this point, so such indices are recorded in relativeSlots (3 * corner + 0/1/2 for v/vt/vn) to be offset later.
+void scanOBJ(const char* begin, const char* end, ObjData& out, std::vector<size_t>* relativeSlots) {
+    const char* p = begin;
+    while (p < end) {
+        p = skipBlanks(p, end);
+        if (p >= end) break;
+        const char* keyword = p;
+        while (p < end && !isBlank(*p) && *p != '\n') ++p;
+        const size_t keywordLength = p - keyword;
+
+        if (keywordLength == 1 && keyword[0] == 'v') {
+            // read and store a vertex, update bounding box
+            Vec3f v;
+            if (parseVec3(p, end, v)) {
+                out.vertices.push_back(v);
+                out.boundingBoxMin[0] = std::min(v[0], out.boundingBoxMin[0]);
+                out.boundingBoxMin[1] = std::min(v[1], out.boundingBoxMin[1]);
+                out.boundingBoxMin[2] = std::min(v[2], out.boundingBoxMin[2]);
+                out.boundingBoxMax[0] = std::max(v[0], out.boundingBoxMax[0]);
+                out.boundingBoxMax[1] = std::max(v[1], out.boundingBoxMax[1]);
+                out.boundingBoxMax[2] = std::max(v[2], out.boundingBoxMax[2]);
+            }
+        } else if (keywordLength == 2 && keyword[0] == 'v' && keyword[1] == 'n') {
+            // read and store a vertex normal
+            Vec3f n;
+            if (parseVec3(p, end, n)) out.normals.push_back(n);
+        } else if (keywordLength == 2 && keyword[0] == 'v' && keyword[1] == 't') {
+            // read and store a texture coordinate
+            ObjTexCoord t;
+            if (parseTexCoord(p, end, t)) out.texCoords.push_back(t);
+        } else if (keywordLength == 1 && keyword[0] == 'f') {
+            // read a face, every corner is v, v/vt, v//vn or v/vt/vn
+            const size_t firstCorner = out.corners.size();
+            for (;;) {
+                p = skipBlanks(p, end);
+                ObjCorner corner{ -1, -1, -1 };
+                bool relative[3] = { false, false, false };
+                const char* q = p;
+                if (!parseIndex(q, end, out.vertices.size(), corner.v, relative[0])) break;
+                if (q < end && *q == '/') {
+                    ++q;
+                    if (q < end && *q != '/' && !parseIndex(q, end, out.texCoords.size(), corner.vt, relative[1])) break;
+                    if (q < end && *q == '/') {
+                        ++q;
+                        if (!parseIndex(q, end, out.normals.size(), corner.vn, relative[2])) break;
+                    }
+                }
+                if (q < end && !isBlank(*q) && *q != '\n') break;
+                p = q;
+                if (relativeSlots) {
+                    for (size_t i = 0; i < 3; ++i)
+                        if (relative[i]) relativeSlots->push_back(3 * out.corners.size() + i);
+                }
+                out.corners.push_back(corner);
+            }
+            const size_t numCorners = out.corners.size() - firstCorner;
+            if (numCorners >= 3) {
+                out.faceSizes.push_back(static_cast<unsigned int>(numCorners));
+            } else {
+                // points and lines do not form a surface
+                out.corners.resize(firstCorner);
+                if (relativeSlots) {
+                    while (!relativeSlots->empty() && relativeSlots->back() >= 3 * firstCorner) relativeSlots->pop_back();
+                }
+                ++out.droppedFaces;
+            }
+        } else if (keywordLength == 6 && std::memcmp(keyword, "usemtl", 6) == 0) {
+            // the following faces use this material
+            const int material = findOrAdd(out.materialNames, restOfLine(p, end));
+            out.materialRuns.push_back(ObjMaterialRun{ out.faceSizes.size(), material });
+        } else if (keywordLength == 6 && std::memcmp(keyword, "mtllib", 6) == 0) {
+            // one or more library file names
+            for (;;) {
+                p = skipBlanks(p, end);
+                const char* name = p;
+                while (p < end && !isBlank(*p) && *p != '\n') ++p;
+                if (p == name) break;
+                findOrAdd(out.materialLibraries, std::string(name, p));
+            }
+        }
+        // Skip comments, other entries and the rest of the line
+        p = skipLine(p, end);
+    }
+}
+
+// A line-aligned part of the file, parsed independently of the others.
+struct ObjChunk {
+    const char* begin;
+    const char* end;
+    ObjData data;
+    std::vector<size_t> relativeSlots;
+    // offsets of this chunk in the merged arrays
+    size_t vertexOffset, texCoordOffset, normalOffset, cornerOffset, faceOffset;
+};
+
+template<typename T>
+void moveInto(std::vector<T>& source, std::vector<T>& target, size_t offset) {
+    std::copy(source.begin(), source.end(), target.begin() + offset);
+    // release the chunk memory as early as possible
+    std::vector<T>().swap(source);
+}
+
+// Hash set of (v, vt, vn) tuples with open addressing and linear probing. Maps every tuple to the id of the
+// mesh vertex that was created for it. The table is at most half full, it doubles and rehashes when it gets fuller.
+class CornerTable {
+    struct Entry {
+        ObjCorner key;
+        unsigned int id;
+    };
+    static const unsigned int EMPTY = ~0u;
+    std::vector<Entry> entries;
+    size_t mask;
+    size_t size{0};
+
+    static size_t hash(const ObjCorner& c) {
+        uint64_t h = static_cast<uint32_t>(c.v) * 0x9E3779B97F4A7C15ull;
+        h ^= static_cast<uint32_t>(c.vt) * 0xC2B2AE3D27D4EB4Full;
+        h ^= static_cast<uint32_t>(c.vn) * 0x165667B19E3779F9ull;
+        return static_cast<size_t>(h ^ (h >> 32));
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<Entry> old(capacity, Entry{ { 0, 0, 0 }, EMPTY });
+        old.swap(entries);
+        mask = capacity - 1;
+        for (const Entry& e : old) {
+            if (e.id == EMPTY) continue;
+            size_t i = hash(e.key) & mask;
+            while (entries[i].id != EMPTY) i = (i + 1) & mask;
+            entries[i] = e;
+        }
+    }
+
+public:
+    // expectedEntries is an estimate of the number of distinct tuples, e.g. the number of positions
+    explicit CornerTable(size_t expectedEntries) {
+        size_t capacity = 16;
+        while (capacity < 2 * expectedEntries) capacity *= 2;
+        entries.assign(capacity, Entry{ { 0, 0, 0 }, EMPTY });
+        mask = capacity - 1;
+    }
+
+    // returns the id of the tuple, newId is assigned if the tuple is new
+    unsigned int insert(const ObjCorner& c, unsigned int newId, bool& inserted) {
+        for (size_t i = hash(c) & mask;; i = (i + 1) & mask) {
+            Entry& e = entries[i];
+            if (e.id == EMPTY) {
+                if (2 * (size + 1) > entries.size()) {
+                    rehash(2 * entries.size());
+                    return insert(c, newId, inserted);
+                }
+                e.key = c;
+                e.id = newId;
+                ++size;
+                inserted = true;
+                return newId;
+            }
+            if (e.key.v == c.v && e.key.vt == c.vt && e.key.vn == c.vn) {
+                inserted = false;
+                return e.id;
+            }
+        }
+    }
+};
+
+// Splits polygons into triangles: a fan for convex polygons, ear clipping for all others.
+class Triangulator {
+    struct Point { float x, y; };
+    std::vector<Point> points;
+    std::vector<unsigned int> ring;
+
+    static float cross(const Point& a, const Point& b, const Point& c) {
+        return (b.x - a.x) * (c.y - b.y) - (b.y - a.y) * (c.x - b.x);
+    }
+    static bool inside(const Point& p, const Point& a, const Point& b, const Point& c, float sign) {
+        return sign * cross(a, b, p) >= 0.0f && sign * cross(b, c, p) >= 0.0f && sign * cross(c, a, p) >= 0.0f;
+    }
+
+public:
+    size_t nonConvexPolygons{0};
+
+    // ids are the mesh vertices of the polygon corners, in order
+    void triangulate(const unsigned int* ids, const Vec3f* positions, unsigned int n, std::vector<Vec3ui>& triangles) {
+        if (n == 3) {
+            triangles.emplace_back(ids[0], ids[1], ids[2]);
+            return;
+        }
+        // project onto the plane of the polygon by dropping the dominant axis of its Newell normal
+        Vec3f normal;
+        for (unsigned int i = 0; i < n; ++i) {
+            const Vec3f& a = positions[i];
+            const Vec3f& b = positions[(i + 1) % n];
+            normal[0] += (a[1] - b[1]) * (a[2] + b[2]);
+            normal[1] += (a[2] - b[2]) * (a[0] + b[0]);
+            normal[2] += (a[0] - b[0]) * (a[1] + b[1]);
+        }
+        unsigned int axis = 0;
+        if (std::fabs(normal[1]) > std::fabs(normal[axis])) axis = 1;
+        if (std::fabs(normal[2]) > std::fabs(normal[axis])) axis = 2;
+        const unsigned int u = (axis + 1) % 3, v = (axis + 2) % 3;
+        const float sign = normal[axis] < 0.0f ? -1.0f : 1.0f;
+        points.resize(n);
+        for (unsigned int i = 0; i < n; ++i) points[i] = { positions[i][u], positions[i][v] };
+
+        bool convex = normal[axis] != 0.0f;
+        for (unsigned int i = 0; convex && i < n; ++i)
+            convex = sign * cross(points[i], points[(i + 1) % n], points[(i + 2) % n]) >= 0.0f;
+        if (convex) {
+            for (unsigned int i = 1; i + 1 < n; ++i) triangles.emplace_back(ids[0], ids[i], ids[i + 1]);
+            return;
+        }
+
+        ++nonConvexPolygons;
+        ring.resize(n);
+        for (unsigned int i = 0; i < n; ++i) ring[i] = i;
+        while (ring.size() > 3) {
+            const size_t m = ring.size();
+            bool clipped = false;
+            for (size_t i = 0; i < m && !clipped; ++i) {
+                const unsigned int prev = ring[(i + m - 1) % m], cur = ring[i], next = ring[(i + 1) % m];
+                // reflex and degenerate corners are no ears
+                if (sign * cross(points[prev], points[cur], points[next]) <= 0.0f) continue;
+                bool isEar = true;
+                for (size_t j = 0; j < m && isEar; ++j) {
+                    const unsigned int other = ring[j];
+                    if (other != prev && other != cur && other != next)
+                        isEar = !inside(points[other], points[prev], points[cur], points[next], sign);
+                }
+                if (!isEar) continue;
+                triangles.emplace_back(ids[prev], ids[cur], ids[next]);
+                ring.erase(ring.begin() + i);
+                clipped = true;
+            }
+            // self-intersecting or degenerate polygon, close the rest with a fan
+            if (!clipped) break;
+        }
+        for (size_t i = 1; i + 1 < ring.size(); ++i) triangles.emplace_back(ids[ring[0]], ids[ring[i]], ids[ring[i + 1]]);
+    }
+};
+
+} // namespace
+
+void parseOBJ(const char* begin, const char* end, ObjData& out, unsigned int maxThreads) {
+    out.clear();
+    const size_t size = end - begin;
+    if (maxThreads == 0) maxThreads = workerThreadCount();
+    const unsigned int numChunks = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(maxThreads, size / OBJ_MIN_CHUNK_BYTES)));
+    if (numChunks == 1) {
+        scanOBJ(begin, end, out, nullptr);
+        return;
+    }
+
+    // split the text at line ends, each chunk starts right after a newline
+    std::vector<ObjChunk> chunks(numChunks);
+    const char* chunkBegin = begin;
+    for (unsigned int i = 0; i < numChunks; ++i) {
+        chunks[i].begin = chunkBegin;
+        chunkBegin = i + 1 == numChunks ? end : std::max(chunkBegin, skipLine(begin + size * (i + 1) / numChunks, end));
+        chunks[i].end = chunkBegin;
+    }
+    runParallel(numChunks, [&chunks](unsigned int i) {
+        scanOBJ(chunks[i].begin, chunks[i].end, chunks[i].data, &chunks[i].relativeSlots);
+    });
+
+    // prefix sums give every chunk its place in the merged arrays
+    size_t numVertices = 0, numTexCoords = 0, numNormals = 0, numCorners = 0, numFaces = 0;
+    for (auto& chunk : chunks) {
+        chunk.vertexOffset = numVertices;
+        chunk.texCoordOffset = numTexCoords;
+        chunk.normalOffset = numNormals;
+        chunk.cornerOffset = numCorners;
+        chunk.faceOffset = numFaces;
+        numVertices += chunk.data.vertices.size();
+        numTexCoords += chunk.data.texCoords.size();
+        numNormals += chunk.data.normals.size();
+        numCorners += chunk.data.corners.size();
+        numFaces += chunk.data.faceSizes.size();
+        out.droppedFaces += chunk.data.droppedFaces;
+        // materials are few, the names of all chunks are merged into one table. runs continue across chunk borders,
+        // so faces at the start of a chunk keep the material of the previous chunk.
+        for (const auto& run : chunk.data.materialRuns)
+            out.materialRuns.push_back(ObjMaterialRun{ chunk.faceOffset + run.firstFace, findOrAdd(out.materialNames, chunk.data.materialNames[run.material]) });
+        for (const auto& library : chunk.data.materialLibraries) findOrAdd(out.materialLibraries, library);
+        for (unsigned int k = 0; k < 3; ++k) {
+            out.boundingBoxMin[k] = std::min(chunk.data.boundingBoxMin[k], out.boundingBoxMin[k]);
+            out.boundingBoxMax[k] = std::max(chunk.data.boundingBoxMax[k], out.boundingBoxMax[k]);
+        }
+    }
+    out.vertices.resize(numVertices);
+    out.texCoords.resize(numTexCoords);
+    out.normals.resize(numNormals);
+    out.corners.resize(numCorners);
+    out.faceSizes.resize(numFaces);
+
+    // copy the chunks into place and resolve their relative indices against the attributes of all previous chunks
+    runParallel(numChunks, [&chunks, &out](unsigned int i) {
+        ObjChunk& chunk = chunks[i];
+        ObjCorner* corners = out.corners.data() + chunk.cornerOffset;
+        std::copy(chunk.data.corners.begin(), chunk.data.corners.end(), corners);
+        const int offsets[3] = { static_cast<int>(chunk.vertexOffset), static_cast<int>(chunk.texCoordOffset), static_cast<int>(chunk.normalOffset) };
+        for (size_t slot : chunk.relativeSlots) {
+            ObjCorner& corner = corners[slot / 3];
+            switch (slot % 3) {
+                case 0: corner.v += offsets[0]; break;
+                case 1: corner.vt += offsets[1]; break;
+                default: corner.vn += offsets[2]; break;
+            }
+        }
+        std::vector<ObjCorner>().swap(chunk.data.corners);
+        moveInto(chunk.data.vertices, out.vertices, chunk.vertexOffset);
+        moveInto(chunk.data.texCoords, out.texCoords, chunk.texCoordOffset);
+        moveInto(chunk.data.normals, out.normals, chunk.normalOffset);
+        moveInto(chunk.data.faceSizes, out.faceSizes, chunk.faceOffset);
+    });
+}
+
+void ObjBlockParser::parse(const char* begin, const char* end, ObjData& block) {
+    block.clear();
+    relativeSlots.clear();
+    scanOBJ(begin, end, block, &relativeSlots);
+    const int offsets[3] = { static_cast<int>(numVertices), static_cast<int>(numTexCoords), static_cast<int>(numNormals) };
+    for (size_t slot : relativeSlots) {
+        ObjCorner& corner = block.corners[slot / 3];
+        switch (slot % 3) {
+            case 0: corner.v += offsets[0]; break;
+            case 1: corner.vt += offsets[1]; break;
+            default: corner.vn += offsets[2]; break;
+        }
+    }
+    numVertices += block.vertices.size();
+    numTexCoords += block.texCoords.size();
+    numNormals += block.normals.size();
+}
+
+void buildObjMesh(ObjData& data, ObjMesh& out) {
+    out = ObjMesh();
+    out.droppedFaces = data.droppedFaces;
+
+    // without vt/vn references every position is a mesh vertex, no tuples need to be built
+    bool anyTexCoords = false, anyNormals = false, allTexCoords = true, allNormals = true;
+    for (const auto& corner : data.corners) {
+        anyTexCoords |= corner.vt >= 0;
+        anyNormals |= corner.vn >= 0;
+        allTexCoords &= corner.vt >= 0;
+        allNormals &= corner.vn >= 0;
+    }
+    const bool useTuples = anyTexCoords || anyNormals;
+    out.hasTexCoords = anyTexCoords && allTexCoords;
+    out.hasNormals = anyNormals && allNormals;
+
+    const int numPositions = static_cast<int>(data.vertices.size());
+    const int numTexCoords = static_cast<int>(data.texCoords.size());
+    const int numNormals = static_cast<int>(data.normals.size());
+    auto isValid = [&](const ObjCorner& c) {
+        return c.v >= 0 && c.v < numPositions && c.vt < numTexCoords && c.vn < numNormals;
+    };
+
+    size_t numTriangles = 0;
+    for (unsigned int n : data.faceSizes) numTriangles += n - 2;
+    out.triangles.reserve(numTriangles);
+
+    // most files have about as many distinct tuples as entries of their largest attribute array. sizing the table by
+    // the corners would take several times the memory of the mesh.
+    CornerTable table(useTuples ? std::max(data.vertices.size(), std::max(data.texCoords.size(), data.normals.size())) : 0);
+    Triangulator triangulator;
+    std::vector<unsigned int> ids;
+    std::vector<Vec3f> positions;
+    // material of every triangle, only needed if the file uses materials
+    const bool useMaterials = !data.materialRuns.empty();
+    std::vector<int> triangleMaterials;
+    if (useMaterials) triangleMaterials.reserve(numTriangles);
+    size_t nextRun = 0;
+    int material = -1;
+    const ObjCorner* corner = data.corners.data();
+    for (size_t face = 0; face < data.faceSizes.size(); ++face) {
+        const unsigned int n = data.faceSizes[face];
+        const ObjCorner* faceCorners = corner;
+        corner += n;
+        while (nextRun < data.materialRuns.size() && data.materialRuns[nextRun].firstFace <= face)
+            material = data.materialRuns[nextRun++].material;
+        bool valid = true;
+        for (unsigned int i = 0; i < n && valid; ++i) valid = isValid(faceCorners[i]);
+        if (!valid) {
+            ++out.droppedFaces;
+            continue;
+        }
+
+        ids.resize(n);
+        positions.resize(n);
+        for (unsigned int i = 0; i < n; ++i) {
+            const ObjCorner& c = faceCorners[i];
+            positions[i] = data.vertices[c.v];
+            if (!useTuples) {
+                ids[i] = static_cast<unsigned int>(c.v);
+                continue;
+            }
+            bool inserted;
+            ids[i] = table.insert(c, static_cast<unsigned int>(out.vertices.size()), inserted);
+            if (inserted) {
+                out.vertices.push_back(data.vertices[c.v]);
+                if (out.hasNormals) out.normals.push_back(data.normals[c.vn]);
+                if (out.hasTexCoords) out.texCoords.push_back(data.texCoords[c.vt]);
+            }
+        }
+        triangulator.triangulate(ids.data(), positions.data(), n, out.triangles);
+        if (useMaterials) triangleMaterials.resize(out.triangles.size(), material);
+    }
+    out.nonConvexFaces = triangulator.nonConvexPolygons;
+
+    if (useMaterials) {
+        // counting sort by material keeps the triangle order within each material
+        const size_t numMaterials = data.materialNames.size();
+        std::vector<unsigned int> offsets(numMaterials + 2, 0);
+        for (int m : triangleMaterials) ++offsets[m + 2];
+        for (size_t m = 1; m < offsets.size(); ++m) offsets[m] += offsets[m - 1];
+        for (size_t m = 0; m + 1 < offsets.size(); ++m) {
+            if (offsets[m + 1] > offsets[m])
+                out.subMeshes.push_back(ObjSubMesh{ static_cast<int>(m) - 1, offsets[m], offsets[m + 1] - offsets[m] });
+        }
+        std::vector<Vec3ui> sorted(out.triangles.size());
+        for (size_t i = 0; i < out.triangles.size(); ++i) sorted[offsets[triangleMaterials[i] + 1]++] = out.triangles[i];
+        out.triangles = std::move(sorted);
+        out.materialNames = std::move(data.materialNames);
+        out.materialLibraries = std::move(data.materialLibraries);
+    }
+
+    if (!useTuples) {
+        out.vertices = std::move(data.vertices);
+        // loose normals are used as per-vertex normals, just like files without face references expect it
+        out.normals = std::move(data.normals);
+        out.hasNormals = out.normals.size() == out.vertices.size();
+    }
+    out.boundingBoxMin = data.boundingBoxMin;
+    out.boundingBoxMax = data.boundingBoxMax;
+}
+
+void parseMTL(const char* begin, const char* end, std::vector<ObjMaterial>& out) {
+    ObjMaterial* material = nullptr;
+    const char* p = begin;
+    while (p < end) {
+        p = skipBlanks(p, end);
+        if (p >= end) break;
+        const char* keyword = p;
+        while (p < end && !isBlank(*p) && *p != '\n') ++p;
+        const std::string key(keyword, p);
+
+        if (key == "newmtl") {
+            out.push_back(ObjMaterial());
+            material = &out.back();
+            material->name = restOfLine(p, end);
+        } else if (material) {
+            Vec3f color;
+            float value;
+            if (key == "Ka" && parseVec3(p, end, color)) material->ambient = color;
+            else if (key == "Kd" && parseVec3(p, end, color)) material->diffuse = color;
+            else if (key == "Ks" && parseVec3(p, end, color)) material->specular = color;
+            else if (key == "Ns" && parseFloat(p = skipBlanks(p, end), end, value)) material->shininess = value;
+            else if (key == "d" && parseFloat(p = skipBlanks(p, end), end, value)) material->opacity = value;
+            else if (key == "Tr" && parseFloat(p = skipBlanks(p, end), end, value)) material->opacity = 1.0f - value;
+            else if (key == "map_Kd") {
+                // the file name is the last token, options like "-s 1 1 1" come first
+                const std::string line = restOfLine(p, end);
+                const size_t split = line.find_last_of(" \t");
+                material->diffuseMap = split == std::string::npos ? line : line.substr(split + 1);
+            }
+        }
+        // Skip comments, other entries and the rest of the line
+        p = skipLine(p, end);
+    }
+}
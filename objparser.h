@@ -0,0 +1,175 @@
+// ========================================================================= //
+// GRIS - Graphisch Interaktive Systeme                                      //
+// Technische Universität Darmstadt                                          //
+// Fraunhoferstrasse 5                                                       //
+// D-64283 Darmstadt, Germany                                                //
+//                                                                           //
+// Content: Memory-mapped, allocation-free scanner for OBJ files             //
+// ========================================================================= //
+
+#ifndef OBJPARSER_H
+#define OBJPARSER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <QFile>
+#include <QByteArray>
+
+#include "vec3.h"
+
+// Read-only view of a whole file. The file is memory-mapped if possible, otherwise it is read into memory.
+// The view stays valid as long as the MappedFile object lives.
+class MappedFile {
+    QFile file;
+    QByteArray fallback;
+    uchar* mapped{nullptr};
+    const char* first{nullptr};
+    size_t length{0};
+    bool opened{false};
+
+public:
+    explicit MappedFile(const char* fileName);
+    ~MappedFile();
+    MappedFile(const MappedFile& other) = delete;
+    MappedFile& operator= (const MappedFile& other) = delete;
+
+    bool isOpen() const { return opened; }
+    const char* begin() const { return first; }
+    const char* end() const { return first + length; }
+    size_t size() const { return length; }
+};
+
+struct ObjTexCoord {
+    float u, v;
+};
+
+// One corner of a face as 0-based indices into the attribute arrays. vt and vn are -1 if the corner does not
+// reference a texture coordinate or normal.
+struct ObjCorner {
+    int v, vt, vn;
+};
+
+// Faces from firstFace on use the material with the given index into ObjData::materialNames, up to the next run.
+// Faces before the first run have no material (-1).
+struct ObjMaterialRun {
+    size_t firstFace;
+    int material;
+};
+
+// Range of triangles that share one material. material is -1 for triangles without a material.
+struct ObjSubMesh {
+    int material;
+    unsigned int firstTriangle;
+    unsigned int numTriangles;
+};
+
+// Material of an MTL file. Only the entries the renderer can use are kept.
+struct ObjMaterial {
+    std::string name;
+    Vec3f ambient{0.0f, 0.0f, 0.0f};
+    Vec3f diffuse{0.8f, 0.8f, 0.8f};
+    Vec3f specular{0.0f, 0.0f, 0.0f};
+    float shininess{0.0f};
+    float opacity{1.0f};
+    // file name of map_Kd, as written in the MTL file
+    std::string diffuseMap;
+};
+
+// Everything loadOBJ extracts from the text of an OBJ file, as it is written in the file.
+struct ObjData {
+    std::vector<Vec3f> vertices;
+    std::vector<ObjTexCoord> texCoords;
+    std::vector<Vec3f> normals;
+    // corners of all faces, one face after the other
+    std::vector<ObjCorner> corners;
+    // number of corners of each face
+    std::vector<unsigned int> faceSizes;
+    Vec3f boundingBoxMin;
+    Vec3f boundingBoxMax;
+    // number of faces that were skipped because they are points or lines
+    size_t droppedFaces{0};
+    // "usemtl" names in order of first use, the faces that use them and the "mtllib" file names
+    std::vector<std::string> materialNames;
+    std::vector<ObjMaterialRun> materialRuns;
+    std::vector<std::string> materialLibraries;
+
+    ObjData() { clear(); }
+    void clear();
+};
+
+// Triangle mesh built from ObjData. Every distinct (v, vt, vn) tuple becomes one vertex.
+struct ObjMesh {
+    std::vector<Vec3f> vertices;
+    std::vector<Vec3f> normals;
+    std::vector<ObjTexCoord> texCoords;
+    std::vector<Vec3ui> triangles;
+    Vec3f boundingBoxMin;
+    Vec3f boundingBoxMax;
+    // normals/texCoords hold one entry per vertex
+    bool hasNormals{false};
+    bool hasTexCoords{false};
+    // faces that were skipped because they are points, lines or reference missing attributes
+    size_t droppedFaces{0};
+    // polygons that needed ear clipping instead of a triangle fan
+    size_t nonConvexFaces{0};
+    // triangles are sorted by material, one range per used material. empty if the file uses no materials.
+    std::vector<ObjSubMesh> subMeshes;
+    std::vector<std::string> materialNames;
+    std::vector<std::string> materialLibraries;
+};
+
+// Throughput and stage times of the last load. Tracked by loadOBJ so that loader regressions show up.
+struct ObjParseStats {
+    size_t bytes{0};
+    double parseSeconds{0.0};
+    // the mesh was read from its .meshbin cache instead of being parsed, parseSeconds is the cache read time
+    bool fromCache{false};
+    // the other stages of loadOBJ, zero if a stage was not needed
+    double buildSeconds{0.0};    // vertex tuples and triangulation
+    double weldSeconds{0.0};
+    size_t weldedVertices{0};    // duplicate vertices merged by weldVertices
+    double normalSeconds{0.0};
+    double texCoordSeconds{0.0};
+    double tangentSeconds{0.0};
+    size_t splitVertices{0};     // vertices added by calculateTangents at mirrored texture coordinates
+    double optimizeSeconds{0.0}; // triangle and vertex order
+    double totalSeconds{0.0};
+
+    double megabytesPerSecond() const { return parseSeconds > 0.0 ? bytes / (1024.0 * 1024.0) / parseSeconds : 0.0; }
+};
+
+// Files are split into chunks of at least this size for parallel parsing.
+const size_t OBJ_MIN_CHUNK_BYTES = 1 << 20;
+// Default CPU memory budget of TriangleMesh::loadOBJStreaming.
+const size_t OBJ_STREAM_RING_BYTES = 64 << 20;
+
+// Parses the OBJ text in [begin, end) into out. Only "v", "vt", "vn" and "f" entries are evaluated, everything else
+// is skipped. Apart from the growth of the output arrays, no memory is allocated per line.
+// Large files are split into line-aligned chunks that are parsed on up to maxThreads threads (0 = one per core)
+// and merged afterwards. The result is identical to parsing the file on a single thread.
+void parseOBJ(const char* begin, const char* end, ObjData& out, unsigned int maxThreads = 0);
+
+// Parses a file block by block, e.g. while it is streamed from disk. Each block must consist of complete lines.
+// Relative indices are resolved against the entries of all previous blocks, so the corners of every block hold
+// indices into the whole file.
+class ObjBlockParser {
+    size_t numVertices{0}, numTexCoords{0}, numNormals{0};
+    std::vector<size_t> relativeSlots;
+
+public:
+    // clears block and parses [begin, end) into it
+    void parse(const char* begin, const char* end, ObjData& block);
+};
+
+// Parses the MTL text in [begin, end) and appends its materials to out.
+void parseMTL(const char* begin, const char* end, std::vector<ObjMaterial>& out);
+
+// Builds the triangle mesh of parsed OBJ data. Files whose faces only reference positions keep their vertex order,
+// otherwise vertices are created in order of first use by hashing the (v, vt, vn) tuples of all corners. Convex
+// polygons are split into a triangle fan, non-convex ones by ear clipping. Triangles are grouped by material in order
+// of the first "usemtl" of each material. data is left in a moved-from state.
+void buildObjMesh(ObjData& data, ObjMesh& out);
+
+#endif // OBJPARSER_H
@@ -9,10 +9,12 @@
 // Content: Widget for showing OpenGL scene, SOLUTION                        //
 // ========================================================================= //
 
+#include <algorithm>
 #include <cmath>
 
 #include <QtDebug>
 #include <QMatrix4x4>
+#include <QStringList>
 #include <QOpenGLVersionFunctionsFactory>
 
 #include "shader.h"
@@ -33,6 +35,10 @@ OpenGLView::OpenGLView(QWidget* parent) : QOpenGLWidget(parent) {
 void OpenGLView::setGridSize(int gridSize)
 {
     this->gridSize = gridSize;
+    // a grid of gridSize x gridSize cells with 100 airplanes each
+    numAirplanes = 100 * gridSize * gridSize;
+    if (!airplaneTemplate.isLoading() && airplaneTemplate.getNumTriangles() > 0)
+        createAirplanes();
     emit triangleCountChanged(getTriangleCount());
 }
 
@@ -55,9 +61,9 @@ void OpenGLView::initializeGL()
     GLuint normalTexture = loadImageIntoTexture(f, "../Textures/rough_block_wall_nor_1k.jpg", true);
     GLuint displacementTexture = loadImageIntoTexture(f, "../Textures/rough_block_wall_disp_1k.jpg", true);
 
-    //Load the sphere of the light
+    //Load the sphere of the light, it is uploaded by paintGL as soon as it is loaded
     sphereMesh.setGLFunctionPtr(f);
-    sphereMesh.loadOBJ("Models/sphere.obj");
+    sphereMesh.loadOBJAsync("Models/sphere.obj");
     sphereMesh.setStaticColor(Vec3f(1.0f, 1.0f, 0.0f));
 
     int displacementType = rand() % 5;
@@ -66,21 +72,15 @@ void OpenGLView::initializeGL()
     terrainMesh.generateTerrain(length, width, heightmap, displacementType);
     terrainMesh.setColoringMode(TriangleMesh::ColoringType::COLOR_ARRAY);
 
-    // load obj once
-    TriangleMesh airplaneTemplate(f);
-    airplaneTemplate.loadOBJ("Models/doppeldecker.obj", false);
-
-    airplaneMeshes = std::vector<TriangleMesh>(numAirplanes);
-    for (int i = 0; i < numAirplanes; i++)
-    {
-        float r = static_cast <float>(rand()) / static_cast <float>(RAND_MAX), g = static_cast <float>(rand()) / static_cast <float>(RAND_MAX), b = static_cast <float>(rand()) / static_cast <float>(RAND_MAX);
-        airplaneMeshes[i].setGLFunctionPtr(f);
-        airplaneMeshes[i].copyObject(airplaneTemplate, true); // copy from template
-        airplaneMeshes[i].setStaticColor(Vec3f(r, g, b));
-        airplaneMeshes[i].setAirplanePosition(heightmap, length, width);
-        airplaneMeshes[i].setTexture(testTexture);
-        airplaneMeshes[i].setColoringMode(TriangleMesh::ColoringType::TEXTURE);
-    }
+    // load obj once, the airplanes are created by paintGL as soon as it is loaded
+    airplaneTextureID = testTexture;
+    airplaneTemplate.setGLFunctionPtr(f);
+    airplaneTemplate.setLevelsOfDetail(4);
+    airplaneTemplate.toggleQuantizedVertices(true); // many small copies, compact vertex formats are accurate enough
+    airplaneTemplate.toggleMeshlets(true); // skip the clusters that are off screen or face away from the camera
+    airplaneTemplate.loadOBJAsync("Models/doppeldecker.obj");
+    airplaneTemplate.setTexture(airplaneTextureID);
+    airplaneTemplate.setColoringMode(TriangleMesh::ColoringType::TEXTURE);
 
     bumpSphereMesh.generateSphere(f);
     bumpSphereMesh.setStaticColor(Vec3f(0.8f, 0.8f, 0.8f));
@@ -95,21 +95,18 @@ void OpenGLView::initializeGL()
     //load shaders
     GLuint lightShaderID = readShaders(f, "Shader/only_mvp.vert", "Shader/constant_color.frag");
     if (lightShaderID) {
-        programIDs.push_back(lightShaderID);
+        addProgram(lightShaderID, "Shader/constant_color.frag");
         state.setStandardProgram(lightShaderID);
     }
     GLuint shaderID = readShaders(f, "Shader/only_mvp.vert", "Shader/lambert.frag");
-    if (shaderID != 0) programIDs.push_back(shaderID);
+    if (shaderID != 0) addProgram(shaderID, "Shader/lambert.frag");
     currentProgramID = lightShaderID;
+    currentProgramIndex = 0;
 
     bumpProgramID = readShaders(f, "Shader/bump.vert", "Shader/bump.frag");
 
     skyboxProgramID = readShaders(f, "Shader/skybox.vert", "Shader/skybox.frag");
 
-    f->glUseProgram(skyboxProgramID);
-    skyboxViewLoc = f->glGetUniformLocation(skyboxProgramID, "view");
-    skyboxProjLoc = f->glGetUniformLocation(skyboxProgramID, "projection");
-
     emit shaderCompiled(0);
     emit shaderCompiled(1);
 
@@ -123,12 +120,10 @@ void OpenGLView::resizeGL(int width, int height) {
     state.loadIdentityProjectionMatrix();
     state.getCurrentProjectionMatrix().perspective(65.f, aspectRatio, 0.5f, 10000.f);
 
-    //set projection matrix in OpenGL shader
-    state.switchToStandardProgram();
-    f->glUniformMatrix4fv(state.getProjectionUniform(), 1, GL_FALSE, state.getCurrentProjectionMatrix().constData());
-    state.setCurrentProgram(bumpProgramID);
-    f->glUniformMatrix4fv(state.getProjectionUniform(), 1, GL_FALSE, state.getCurrentProjectionMatrix().constData());
+    //paintGL uploads the projection matrix to the Camera uniform block, only shaders that declare their own projection
+    //uniform are set here
     for (GLuint progID : programIDs) {
+        if (getProgramReflection(progID).getLocation(Uniform::PROJECTION) == -1) continue;
         state.setCurrentProgram(progID);
         f->glUniformMatrix4fv(state.getProjectionUniform(), 1, GL_FALSE, state.getCurrentProjectionMatrix().constData());
     }
@@ -211,15 +206,9 @@ void OpenGLView::drawSkybox() {
     f->glDepthFunc(GL_LEQUAL);
     f->glDepthMask(GL_FALSE);
 
+    //the shader removes the translation from the view matrix of the Camera block
     state.setCurrentProgram(skyboxProgramID);
 
-    QMatrix4x4 view = state.getCurrentModelViewMatrix();
-    view.setColumn(3, QVector4D(0.0f, 0.0f, 0.0f, 1.0f));
-
-    f->glUniformMatrix4fv(skyboxViewLoc, 1, GL_FALSE, view.constData());
-    f->glUniformMatrix4fv(skyboxProjLoc, 1, GL_FALSE,
-        state.getCurrentProjectionMatrix().constData());
-
     f->glBindVertexArray(skyboxVAO);
     f->glActiveTexture(GL_TEXTURE0);
     f->glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxID);
@@ -231,6 +220,11 @@ void OpenGLView::drawSkybox() {
 }
 
 void OpenGLView::paintGL() {
+    // upload meshes whose asynchronous load finished since the last frame
+    sphereMesh.finishAsyncLoad();
+    if (airplaneTemplate.finishAsyncLoad())
+        createAirplanes();
+
     f->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     state.loadIdentityModelViewMatrix();
 
@@ -238,13 +232,14 @@ void OpenGLView::paintGL() {
     QVector3D cameraLookAt = cameraPos + cameraDir;
     static QVector3D upVector(0.0f, 1.0f, 0.0f);
     state.getCurrentModelViewMatrix().lookAt(cameraPos, cameraLookAt, upVector);
-    drawSkybox();
-    state.switchToStandardProgram();
-    drawCS();
-
     if (lightMoves) 
         moveLight();
+    // camera and light of this frame for all programs
+    state.uploadCameraUniforms();
 
+    drawSkybox();
+    state.switchToStandardProgram();
+    drawCS();
     drawLight();
 
     unsigned int trianglesDrawn = 0, drawnObjectsCount = 0, culledObjectsCount = 0;
@@ -253,7 +248,6 @@ void OpenGLView::paintGL() {
     // draw bump mapping sphere
     state.setCurrentProgram(bumpProgramID);
     state.pushModelViewMatrix();
-    state.setLightUniform();
     state.getCurrentModelViewMatrix().translate(0, 5, 0);
     isBoundingBoxVisible = bumpSphereMesh.isBoundingBoxVisible(state);
     if (!isBoundingBoxVisible)
@@ -269,24 +263,46 @@ void OpenGLView::paintGL() {
     state.setLightUniform();
 
     // draw airplanes count triangles and objects drawn.
-    float angle = 360.0f / numAirplanes;
-    for (int i = 0; i < airplaneMeshes.size(); i++)
+    std::vector<unsigned int> lodHistogram(airplaneTemplate.getNumLevelsOfDetail(), 0);
+    // the airplanes are drawn instanced with the fragment shader of the selected program. if instanced.vert does not
+    // link with it, they are drawn one by one with the selected program itself.
+    const GLuint instancedProgramID = currentProgramIndex < instancedProgramIDs.size() ? instancedProgramIDs[currentProgramIndex] : 0;
+    if (!airplaneBoundingBoxes && !airplaneNormals && instancedProgramID != 0)
     {
-        state.pushModelViewMatrix();
-
-        state.getCurrentModelViewMatrix().translate(airplaneMeshes[i].position.x(), airplaneMeshes[i].position.y(), airplaneMeshes[i].position.z());
-        state.getCurrentModelViewMatrix().rotate(angle * i, 0.f, 1.f, 0.f);
-
-        isBoundingBoxVisible = airplaneMeshes[i].isBoundingBoxVisible(state);
-        if (!isBoundingBoxVisible)
-            culledObjectsCount++;
-        else
+        // all visible airplanes with one draw call per level of detail
+        state.setCurrentProgram(instancedProgramID);
+        trianglesDrawn += airplaneTemplate.drawInstanced(state, airplaneInstances, static_cast<float>(height()), lodHistogram);
+        unsigned int drawnAirplanes = 0;
+        for (unsigned int count : lodHistogram)
+            drawnAirplanes += count;
+        drawnObjectsCount += drawnAirplanes;
+        culledObjectsCount += airplaneInstances.size() - drawnAirplanes;
+        state.setCurrentProgram(currentProgramID);
+    }
+    else
+    {
+        for (const auto& instance : airplaneInstances)
         {
-            drawnObjectsCount++;
-            trianglesDrawn += airplaneMeshes[i].drawAndCountTriangles(state);
+            state.pushModelViewMatrix();
+
+            QMatrix4x4 model;
+            std::copy(instance.model, instance.model + 16, model.data());
+            state.getCurrentModelViewMatrix() *= model;
+
+            isBoundingBoxVisible = airplaneTemplate.isBoundingBoxVisible(state);
+            if (!isBoundingBoxVisible)
+                culledObjectsCount++;
+            else
+            {
+                drawnObjectsCount++;
+                // distant airplanes are drawn with fewer triangles
+                lodHistogram[airplaneTemplate.selectLevelOfDetail(state, static_cast<float>(height()))]++;
+                airplaneTemplate.setStaticColor(instance.color);
+                trianglesDrawn += airplaneTemplate.drawAndCountTriangles(state);
+            }
+
+            state.popModelViewMatrix();
         }
-
-        state.popModelViewMatrix();
     }
 
     // isBoundingBoxVisible = terrainMesh.isBoundingBoxVisible(state);
@@ -309,6 +325,13 @@ void OpenGLView::paintGL() {
         culledObjectsLastRun = culledObjectsCount;
         emit culledObjectsCountChanged(culledObjectsCount);
     }
+    if (lodHistogram != lodHistogramLastRun) {
+        lodHistogramLastRun = lodHistogram;
+        QStringList levels;
+        for (size_t level = 0; level < lodHistogram.size(); ++level)
+            levels << QString("L%1 %2").arg(level).arg(lodHistogram[level]);
+        emit lodHistogramChanged(levels.join(" "));
+    }
 
     frameCounter++;
     update();
@@ -365,6 +388,7 @@ void OpenGLView::setDefaults() {
     // last run: 0 objects and 0 triangles
     objectsLastRun = 0;
     trianglesLastRun = 0;
+    lodHistogramLastRun.clear();
 
     // random seed for rand function
     srand(time(NULL));
@@ -424,6 +448,7 @@ void OpenGLView::changeShader(unsigned int index) {
     try {
         GLuint progID = programIDs.at(index);
         currentProgramID = progID;
+        currentProgramIndex = index;
     } catch (std::out_of_range& ex) {
         qFatal("Tried to access shader index that has not been loaded! %s", ex.what());
     }
@@ -434,11 +459,16 @@ void OpenGLView::changeShader(unsigned int index) {
 void OpenGLView::compileShader(const QString& vertexShaderPath, const QString& fragmentShaderPath) {
     GLuint programHandle = readShaders(f, vertexShaderPath, fragmentShaderPath);
     if (programHandle) {
-        programIDs.push_back(programHandle);
+        addProgram(programHandle, fragmentShaderPath);
         emit shaderCompiled(programIDs.size() - 1);
     }
 }
 
+void OpenGLView::addProgram(GLuint programID, const QString& fragmentShaderPath) {
+    programIDs.push_back(programID);
+    instancedProgramIDs.push_back(readShaders(f, "Shader/instanced.vert", fragmentShaderPath));
+}
+
 void OpenGLView::changeColoringMode(TriangleMesh::ColoringType type)
 {
     terrainMesh.setColoringMode(type);
@@ -446,8 +476,8 @@ void OpenGLView::changeColoringMode(TriangleMesh::ColoringType type)
 
 void OpenGLView::toggleBoundingBox(bool enable)
 {
-    for (auto& mesh: airplaneMeshes)
-	    mesh.toggleBB(enable);
+    airplaneBoundingBoxes = enable;
+    airplaneTemplate.toggleBB(enable);
 
 	terrainMesh.toggleBB(enable);
     bumpSphereMesh.toggleBB(enable);
@@ -455,8 +485,8 @@ void OpenGLView::toggleBoundingBox(bool enable)
 
 void OpenGLView::toggleNormals(bool enable)
 {
-    for (auto& mesh : airplaneMeshes)
-        mesh.toggleNormals(enable);
+    airplaneNormals = enable;
+    airplaneTemplate.toggleNormals(enable);
 
     terrainMesh.toggleNormals(enable);
     bumpSphereMesh.toggleNormals(enable);
@@ -487,25 +517,69 @@ void OpenGLView::recreateTerrain()
     terrainMesh.generateTerrain(length, width, heightmap, displacementType);
     terrainMesh.setColoringMode(TriangleMesh::ColoringType::COLOR_ARRAY);
 
-    GLuint testTexture = loadImageIntoTexture(f, "../Textures/TEST_GRID.bmp");
-    airplaneMeshes.clear();
+    // if the template is still loading, paintGL creates the airplanes later
+    if (!airplaneTemplate.isLoading())
+        createAirplanes();
+
+    doneCurrent();
+}
+
+// Draws the terrain and the bump sphere with one VBO per attribute and with one interleaved VBO, and prints the GPU
+// time of each layout measured with timer queries. The meshes keep the separate layout afterwards.
+void OpenGLView::benchmarkVertexLayouts()
+{
+    const int warmUpDraws = 10, timedDraws = 200;
+    makeCurrent();
 
-    TriangleMesh airplaneTemplate(f);
-    airplaneTemplate.loadOBJ("Models/doppeldecker.obj", false);
+    GLuint query;
+    f->glGenQueries(1, &query);
+    struct Case { const char* name; TriangleMesh* mesh; GLuint program; };
+    for (const Case& c : { Case{ "terrain", &terrainMesh, currentProgramID }, Case{ "bump sphere", &bumpSphereMesh, bumpProgramID } }) {
+        for (bool interleaved : { false, true }) {
+            c.mesh->toggleInterleavedVertices(interleaved);
+            c.mesh->recreateVBOs();
+
+            state.setCurrentProgram(c.program);
+            state.loadIdentityModelViewMatrix();
+            state.getCurrentModelViewMatrix().lookAt(cameraPos, cameraPos + cameraDir, QVector3D(0.0f, 1.0f, 0.0f));
+            state.uploadCameraUniforms();
+            state.setLightUniform();
+            unsigned int triangles = 0;
+            for (int i = 0; i < warmUpDraws; ++i) triangles = c.mesh->drawAndCountTriangles(state);
+            f->glFinish();
+
+            f->glBeginQuery(GL_TIME_ELAPSED, query);
+            for (int i = 0; i < timedDraws; ++i) c.mesh->drawAndCountTriangles(state);
+            f->glEndQuery(GL_TIME_ELAPSED);
+            GLuint64 nanoseconds = 0;
+            f->glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+            std::cout << "benchmarkVertexLayouts: " << c.name << " (" << triangles << " triangles), "
+                      << (interleaved ? "interleaved" : "separate") << " VBOs: " << nanoseconds / 1000.0 / timedDraws << " us per draw" << std::endl;
+        }
+        c.mesh->toggleInterleavedVertices(false);
+        c.mesh->recreateVBOs();
+    }
+    f->glDeleteQueries(1, &query);
 
-    airplaneMeshes = std::vector<TriangleMesh>(numAirplanes);
+    doneCurrent();
+    update();
+}
+
+void OpenGLView::createAirplanes()
+{
+    // the airplanes share the VBOs of the template, an airplane is only its model matrix and color
+    airplaneInstances.resize(numAirplanes);
+    const float angle = 360.0f / numAirplanes;
     for (int i = 0; i < numAirplanes; i++)
     {
         float r = static_cast <float>(rand()) / static_cast <float>(RAND_MAX), g = static_cast <float>(rand()) / static_cast <float>(RAND_MAX), b = static_cast <float>(rand()) / static_cast <float>(RAND_MAX);
-        airplaneMeshes[i].setGLFunctionPtr(f);
-        airplaneMeshes[i].copyObject(airplaneTemplate, true); // copy from template
-    	airplaneMeshes[i].setStaticColor(Vec3f(r, g, b));
-    	airplaneMeshes[i].setAirplanePosition(heightmap, length, width);
-        airplaneMeshes[i].setTexture(testTexture);
-        airplaneMeshes[i].setColoringMode(TriangleMesh::ColoringType::TEXTURE);
+        const Vec3f position = terrainMesh.randomPositionAbove(2.f);
+        QMatrix4x4 model;
+        model.translate(position.x(), position.y(), position.z());
+        model.rotate(angle * i, 0.f, 1.f, 0.f);
+        std::copy(model.constData(), model.constData() + 16, airplaneInstances[i].model);
+        airplaneInstances[i].color = Vec3f(r, g, b);
     }
-
-    doneCurrent();
 }
 
 // This creates a VAO that represents the coordinate system
@@ -47,6 +47,7 @@ public slots:
     void toggleNormalMapping(bool enable);
     void toggleDisplacementMapping(bool enable);
     void recreateTerrain();
+    void benchmarkVertexLayouts();
 
 protected:
     void initializeGL() override;
@@ -58,6 +59,7 @@ signals:
     void triangleCountChanged(unsigned int newTriangles);
     void drawnObjectsCountChanged(unsigned int drawnObjects);
     void culledObjectsCountChanged(unsigned int culledObjects);
+    void lodHistogramChanged(const QString& histogram);
     void shaderCompiled(unsigned int index);
 
 private:
@@ -74,7 +76,13 @@ private:
 
     // rendered objects
     unsigned int objectsLastRun, trianglesLastRun, drawnObjectsLastRun, culledObjectsLastRun;
-    std::vector<TriangleMesh> airplaneMeshes;
+    // drawn airplanes per level of detail
+    std::vector<unsigned int> lodHistogramLastRun;
+    std::vector<TriangleMesh::Instance> airplaneInstances;
+    TriangleMesh airplaneTemplate; // loaded once, drawn once per instance
+    // bounding boxes and normals can not be drawn instanced, the airplanes are drawn one by one while they are shown
+    bool airplaneBoundingBoxes = false, airplaneNormals = false;
+    GLuint airplaneTextureID = 0;
     std::vector<std::vector<double>> heightmap;
     TriangleMesh terrainMesh;
     TriangleMesh sphereMesh; // sun
@@ -98,7 +106,10 @@ private:
 
     //shaders
     GLuint currentProgramID;
+    unsigned int currentProgramIndex = 0;
     std::vector<GLuint> programIDs;
+    //instanced.vert linked with the fragment shader of each program in programIDs, 0 if they do not link
+    std::vector<GLuint> instancedProgramIDs;
     GLuint bumpProgramID;
     GLuint skyboxProgramID;
 
@@ -109,9 +120,6 @@ private:
     GLuint skyboxVAO = 0;
     GLuint skyboxVBO = 0;
 
-    GLint skyboxViewLoc;
-    GLint skyboxProjLoc;
-
     GLuint genCSVAO();
 
     void skeletonSkybox();
@@ -120,6 +128,9 @@ private:
     void drawCS();
     void drawLight();
     void moveLight();
+    void createAirplanes();
+    //adds a program to programIDs together with its instanced variant
+    void addProgram(GLuint programID, const QString& fragmentShaderPath);
     unsigned int getTriangleCount() const;
 };
 
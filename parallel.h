@@ -0,0 +1,52 @@
+// ========================================================================= //
+// GRIS - Graphisch Interaktive Systeme                                      //
+// Technische Universität Darmstadt                                          //
+// Fraunhoferstrasse 5                                                       //
+// D-64283 Darmstadt, Germany                                                //
+//                                                                           //
+// Content: Minimal helpers for running mesh processing on several threads  //
+// ========================================================================= //
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Number of threads the parallel mesh algorithms use at most.
+inline unsigned int workerThreadCount() {
+    const unsigned int n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+// Runs task(i) for every i in [0, numTasks), each on its own thread. The calling thread runs task 0 itself
+// and returns after all tasks finished.
+template<typename Task>
+void runParallel(unsigned int numTasks, const Task& task) {
+    if (numTasks == 0) return;
+    std::vector<std::thread> threads;
+    threads.reserve(numTasks - 1);
+    for (unsigned int i = 1; i < numTasks; ++i) threads.emplace_back([&task, i]() { task(i); });
+    task(0);
+    for (auto& thread : threads) thread.join();
+}
+
+// Splits [0, count) into contiguous blocks of at least minBlockSize elements and calls fn(begin, end) for
+// every block, in parallel if there is more than one block.
+template<typename Fn>
+void parallelFor(size_t count, size_t minBlockSize, const Fn& fn) {
+    if (count == 0) return;
+    const size_t maxBlocks = std::max<size_t>(1, count / std::max<size_t>(1, minBlockSize));
+    const unsigned int numBlocks = static_cast<unsigned int>(std::min<size_t>(workerThreadCount(), maxBlocks));
+    if (numBlocks <= 1) {
+        fn(size_t(0), count);
+        return;
+    }
+    runParallel(numBlocks, [&](unsigned int block) {
+        fn(count * block / numBlocks, count * (block + 1) / numBlocks);
+    });
+}
+
+#endif // PARALLEL_H
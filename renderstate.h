@@ -5,12 +5,14 @@
 #ifndef UEBUNG_03_RENDERSTATE_H
 #define UEBUNG_03_RENDERSTATE_H
 
+#include <algorithm>
 #include <stack>
 #include <QMatrix3x3>
 #include <QMatrix4x4>
 #include <QOpenGLFunctions_3_3_Core>
 
 #include "vec3.h"
+#include "shader.h"
 
 class RenderState {
     Vec3f lightPos;
@@ -18,10 +20,11 @@ class RenderState {
     std::stack<QMatrix4x4> modelViewMatrixStack;
     std::stack<QMatrix4x4> projectionMatrixStack;
     QOpenGLFunctions_3_3_Core* f;
-    GLint modelViewMatrixUniformStandard{-1}, projectionMatrixUniformStandard{-1}, normalMatrixUniformStandard{-1}, lightPositionUniformStandard{-1},
-            cameraPositionUniformStandard{-1}, textureUniformStandard{-1}, normalMapUniformStandard{-1}, useTextureUniformStandard{-1};
-    GLint modelViewMatrixUniform{-1}, projectionMatrixUniform{-1}, normalMatrixUniform{-1}, lightPositionUniform{-1},
-        cameraPositionUniform{-1}, textureUniform{-1}, normalMapUniform{-1}, useTextureUniform{-1};
+    //uniform locations of the programs, read when they were linked
+    const ProgramReflection* activeReflection{&getProgramReflection(0)};
+    const ProgramReflection* standardReflection{&getProgramReflection(0)};
+    //uniform buffer of the Camera block, created by the first uploadCameraUniforms
+    GLuint cameraBuffer{};
 
     static void loadIdentity(std::stack<QMatrix4x4>& stack) {
         if (!stack.empty()) {
@@ -82,62 +85,82 @@ public:
     void setCurrentProgram(GLuint nextProgram) {
         f->glUseProgram(nextProgram);
         activeProgram = nextProgram;
-        modelViewMatrixUniform = f->glGetUniformLocation(activeProgram, "modelView");
-        projectionMatrixUniform = f->glGetUniformLocation(activeProgram, "projection");
-        normalMatrixUniform = f->glGetUniformLocation(activeProgram, "normalMatrix");
-        lightPositionUniform = f->glGetUniformLocation(activeProgram, "lightPosition");
-        cameraPositionUniform = f->glGetUniformLocation(activeProgram, "cameraPosition");
-        textureUniform = f->glGetUniformLocation(activeProgram, "diffuseTexture");
-        normalMapUniform = f->glGetUniformLocation(activeProgram, "normalMap");
-        useTextureUniform = f->glGetUniformLocation(activeProgram, "useTexture");
+        activeReflection = &getProgramReflection(activeProgram);
     }
 
     void setStandardProgram(GLuint standardProgram) {
         f->glUseProgram(standardProgram);
         activeProgram = standardProgram;
         this->standardProgram = standardProgram;
-
-        modelViewMatrixUniformStandard = f->glGetUniformLocation(activeProgram, "modelView");
-        projectionMatrixUniformStandard = f->glGetUniformLocation(activeProgram, "projection");
-        normalMatrixUniformStandard = f->glGetUniformLocation(activeProgram, "normalMatrix");
-        lightPositionUniformStandard = f->glGetUniformLocation(activeProgram, "lightPosition");
-        cameraPositionUniformStandard = f->glGetUniformLocation(activeProgram, "cameraPosition");
-        textureUniformStandard = f->glGetUniformLocation(activeProgram, "diffuseTexture");
-        normalMapUniformStandard = f->glGetUniformLocation(activeProgram, "normalMap");
-        useTextureUniformStandard = f->glGetUniformLocation(activeProgram, "useTexture");
+        standardReflection = &getProgramReflection(standardProgram);
+        activeReflection = standardReflection;
     }
 
     void switchToStandardProgram() {
         f->glUseProgram(standardProgram);
         activeProgram = standardProgram;
+        activeReflection = standardReflection;
+    }
 
-        modelViewMatrixUniform = modelViewMatrixUniformStandard;
-        projectionMatrixUniform = projectionMatrixUniformStandard;
-        normalMatrixUniform = normalMatrixUniformStandard;
-        lightPositionUniform = lightPositionUniformStandard;
-        cameraPositionUniform = cameraPositionUniformStandard;
-        textureUniform = textureUniformStandard;
-        normalMapUniform = normalMapUniformStandard;
-        useTextureUniform = useTextureUniformStandard;
-    }
-
-    GLint getModelViewUniform() const { return modelViewMatrixUniform; }
-    GLint getProjectionUniform() const { return projectionMatrixUniform; }
-    GLint getNormalMatrixUniform() const { return normalMatrixUniform; }
-    GLint getLightPositionUniform() const { return lightPositionUniform; }
-    GLint getCameraPositionUniform() const { return cameraPositionUniform; }
-    GLint getTextureUniform() const { return textureUniform; }
-    GLint getNormalMapUniform() const { return normalMapUniform; }
-    GLint getUseTextureUniform() const { return useTextureUniform; }
+    //location of a uniform in the active program, -1 if it does not use it
+    GLint getUniformLocation(Uniform uniform) const { return activeReflection->getLocation(uniform); }
+    const ProgramReflection& getActiveReflection() const { return *activeReflection; }
+
+    GLint getModelViewUniform() const { return getUniformLocation(Uniform::MODEL_VIEW); }
+    GLint getProjectionUniform() const { return getUniformLocation(Uniform::PROJECTION); }
+    GLint getNormalMatrixUniform() const { return getUniformLocation(Uniform::NORMAL_MATRIX); }
+    GLint getLightPositionUniform() const { return getUniformLocation(Uniform::LIGHT_POSITION); }
+    GLint getCameraPositionUniform() const { return getUniformLocation(Uniform::CAMERA_POSITION); }
+    GLint getTextureUniform() const { return getUniformLocation(Uniform::DIFFUSE_TEXTURE); }
+    GLint getNormalMapUniform() const { return getUniformLocation(Uniform::NORMAL_MAP); }
+    GLint getUseTextureUniform() const { return getUniformLocation(Uniform::USE_TEXTURE); }
+    GLint getPositionScaleUniform() const { return getUniformLocation(Uniform::POSITION_SCALE); }
+    GLint getPositionOffsetUniform() const { return getUniformLocation(Uniform::POSITION_OFFSET); }
 
     Vec3f& getLightPos() {
         return lightPos;
     }
 
-    void setLightUniform() {
+    //light position in the camera coordinates of the current model view matrix
+    QVector3D getLightPosInCameraCoordinates() const {
         QVector4D Qlp4d(lightPos.x(), lightPos.y(), lightPos.z(), 1.0f);
         Qlp4d = getCurrentModelViewMatrix().map(Qlp4d);
-        const QVector3D Qlp = Qlp4d.toVector3DAffine();
+        return Qlp4d.toVector3DAffine();
+    }
+
+    //Uploads the current projection matrix, the current model view matrix as view matrix and the light position to the
+    //Camera uniform block, which all programs share through CAMERA_UNIFORM_BINDING. Call it once per frame after the
+    //camera is set, programs then only need the uniforms of the objects they draw.
+    void uploadCameraUniforms() {
+        //std140 layout of the block, each matrix is four vec4 columns
+        struct CameraBlock {
+            GLfloat projection[16];
+            GLfloat view[16];
+            GLfloat lightPosition[4];
+        } block;
+        std::copy(getCurrentProjectionMatrix().constData(), getCurrentProjectionMatrix().constData() + 16, block.projection);
+        std::copy(getCurrentModelViewMatrix().constData(), getCurrentModelViewMatrix().constData() + 16, block.view);
+        const QVector3D Qlp = getLightPosInCameraCoordinates();
+        block.lightPosition[0] = Qlp.x();
+        block.lightPosition[1] = Qlp.y();
+        block.lightPosition[2] = Qlp.z();
+        block.lightPosition[3] = 1.0f;
+
+        if (cameraBuffer == 0) {
+            f->glGenBuffers(1, &cameraBuffer);
+            f->glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer);
+            f->glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), nullptr, GL_DYNAMIC_DRAW);
+            f->glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_UNIFORM_BINDING, cameraBuffer);
+        }
+        f->glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer);
+        f->glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &block);
+    }
+
+    //Sets the lightPosition uniform of a program that declares it outside of the Camera block, e.g. a loaded shader
+    //written before the block existed. Programs using the block get the light from uploadCameraUniforms.
+    void setLightUniform() {
+        if (getLightPositionUniform() == -1) return;
+        const QVector3D Qlp = getLightPosInCameraCoordinates();
         f->glUniform3f(getLightPositionUniform(), Qlp.x(), Qlp.y(), Qlp.z());
     }
 };
@@ -1,5 +1,83 @@
 #include "shader.h"
 
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+
+//Names of the Uniform values in the shaders
+const char* const UNIFORM_NAMES[] = {
+    "modelView",
+    "projection",
+    "view",
+    "normalMatrix",
+    "lightPosition",
+    "cameraPosition",
+    "useTexture",
+    "diffuseTexture",
+    "normalMap",
+    "positionScale",
+    "positionOffset",
+    "useDiffuse",
+    "useNormal",
+    "useDisplacement",
+    "normalTexture",
+    "displacementTexture",
+};
+static_assert(sizeof(UNIFORM_NAMES) / sizeof(UNIFORM_NAMES[0]) == static_cast<size_t>(Uniform::COUNT), "a Uniform has no name");
+
+//Reflections of all programs linked by compileShaders, by program
+std::unordered_map<GLuint, ProgramReflection>& programReflections() {
+    static std::unordered_map<GLuint, ProgramReflection> reflections;
+    return reflections;
+}
+
+}
+
+ProgramReflection::ProgramReflection() {
+    locations.fill(-1);
+}
+
+ProgramReflection::ProgramReflection(QOpenGLFunctions_3_3_Core* f, GLuint program) {
+    locations.fill(-1);
+    GLint numUniforms = 0, maxNameLength = 0;
+    f->glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &numUniforms);
+    f->glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+    std::vector<GLchar> name(std::max(maxNameLength, 1));
+    for (GLint i = 0; i < numUniforms; ++i) {
+        ActiveUniform uniform;
+        GLsizei length = 0;
+        f->glGetActiveUniform(program, static_cast<GLuint>(i), static_cast<GLsizei>(name.size()), &length, &uniform.size, &uniform.type, name.data());
+        uniform.name.assign(name.data(), length);
+        //arrays are reported as name[0], their location is the one of the first element
+        if (uniform.name.size() > 3 && uniform.name.compare(uniform.name.size() - 3, 3, "[0]") == 0)
+            uniform.name.resize(uniform.name.size() - 3);
+        uniform.location = f->glGetUniformLocation(program, name.data());
+        for (size_t u = 0; u < locations.size(); ++u) {
+            if (uniform.name == UNIFORM_NAMES[u]) locations[u] = uniform.location;
+        }
+        uniforms.push_back(std::move(uniform));
+    }
+}
+
+GLint ProgramReflection::getLocation(const std::string& name) const {
+    for (const auto& uniform : uniforms) {
+        if (uniform.name == name) return uniform.location;
+    }
+    return -1;
+}
+
+const ProgramReflection& getProgramReflection(GLuint program) {
+    static const ProgramReflection none;
+    auto reflection = programReflections().find(program);
+    return reflection != programReflections().end() ? reflection->second : none;
+}
+
+void deleteProgram(QOpenGLFunctions_3_3_Core* f, GLuint program) {
+    programReflections().erase(program);
+    f->glDeleteProgram(program);
+}
+
 GLint getProgramLogLength(QOpenGLFunctions_3_3_Core* f, GLuint obj) {
     GLint infologLength = 0;
     f->glGetProgramiv(obj, GL_INFO_LOG_LENGTH, &infologLength);
@@ -115,6 +193,11 @@ GLuint compileShaders(QOpenGLFunctions_3_3_Core* f, const char* vertexShaderSrc,
         
         f->glDeleteProgram(program);
         program = 0;
+    } else {
+        GLuint cameraBlock = f->glGetUniformBlockIndex(program, CAMERA_UNIFORM_BLOCK);
+        if (cameraBlock != GL_INVALID_INDEX) f->glUniformBlockBinding(program, cameraBlock, CAMERA_UNIFORM_BINDING);
+        //a new program may reuse the name of a deleted one
+        programReflections()[program] = ProgramReflection(f, program);
     }
     return program;
 }
@@ -12,8 +12,10 @@
 #ifndef UEBUNG_03_SHADER_H
 #define UEBUNG_03_SHADER_H
 
+#include <array>
 #include <iostream>      // cout
 #include <string>
+#include <vector>
 
 #include <QDebug>
 #include <QtGlobal>
@@ -29,6 +31,64 @@ const GLuint NORMAL_LOCATION = 1;
 const GLuint COLOR_LOCATION = 2;
 const GLuint TEXCOORD_LOCATION = 3;
 const GLuint TANGENT_LOCATION = 4;
+//Per-instance attributes of instanced drawing, the model matrix takes four locations
+const GLuint INSTANCE_MODEL_LOCATION = 5;
+const GLuint INSTANCE_COLOR_LOCATION = 9;
+//Uniform block with projection, view and light position that all programs share, see RenderState::uploadCameraUniforms.
+//GLSL 3.30 can not set the binding in the shader, compileShaders binds the block of every program to this point.
+const char* const CAMERA_UNIFORM_BLOCK = "Camera";
+const GLuint CAMERA_UNIFORM_BINDING = 0;
+
+//Uniforms the renderer sets, their names in the shaders are listed in shader.cpp
+enum class Uniform {
+    MODEL_VIEW,
+    PROJECTION,
+    VIEW,
+    NORMAL_MATRIX,
+    LIGHT_POSITION,
+    CAMERA_POSITION,
+    USE_TEXTURE,
+    DIFFUSE_TEXTURE,
+    NORMAL_MAP,
+    POSITION_SCALE,
+    POSITION_OFFSET,
+    USE_DIFFUSE,
+    USE_NORMAL,
+    USE_DISPLACEMENT,
+    NORMAL_TEXTURE,
+    DISPLACEMENT_TEXTURE,
+    COUNT
+};
+
+//Active uniforms of a linked program, read once with glGetActiveUniform when the program is linked, so that drawing
+//never has to ask OpenGL for a location. Uniforms the program does not use have the location -1.
+class ProgramReflection {
+public:
+    struct ActiveUniform {
+        std::string name; //without [0] for arrays
+        GLint location;   //-1 for members of uniform blocks
+        GLenum type;
+        GLint size;       //number of array elements
+    };
+
+    //reflection of no program, all locations are -1
+    ProgramReflection();
+    ProgramReflection(QOpenGLFunctions_3_3_Core* f, GLuint program);
+
+    GLint getLocation(Uniform uniform) const { return locations[static_cast<size_t>(uniform)]; }
+    //location of any active uniform, for uniforms that are not in Uniform
+    GLint getLocation(const std::string& name) const;
+    const std::vector<ActiveUniform>& getUniforms() const { return uniforms; }
+
+private:
+    std::array<GLint, static_cast<size_t>(Uniform::COUNT)> locations;
+    std::vector<ActiveUniform> uniforms;
+};
+
+//Reflection of a program linked by compileShaders or readShaders, the reflection of no program for all others.
+const ProgramReflection& getProgramReflection(GLuint program);
+//Deletes a program linked by compileShaders or readShaders and its reflection.
+void deleteProgram(QOpenGLFunctions_3_3_Core* f, GLuint program);
 
 GLint getProgramLogLength(QOpenGLFunctions_3_3_Core* f, GLuint obj);
 GLint getShaderLogLength(QOpenGLFunctions_3_3_Core* f, GLuint obj);
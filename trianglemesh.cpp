@@ -15,13 +15,15 @@
 #include <cmath>
 #include <array>
 #include <cfloat>
+#include <chrono>
 #include <algorithm>
 #include <random>
 #include <array>
+#include <cstddef>
+#include <cstring>
+#include <limits>
 
-#include <fstream>
 #include <iostream>
-#include <sstream>
 #include <iomanip>
 
 #include <QtMath>
@@ -32,10 +34,229 @@
 #include "utilities.h"
 #include "clipplane.h"
 #include "shader.h"
+#include "objparser.h"
+#include "meshoptimizer.h"
+#include "meshgeometry.h"
+#include "parallel.h"
 
 using glVertexAttrib3fvPtr = void (*)(GLuint index, const GLfloat* v);
 using glVertexAttrib3fPtr = void (*)(GLuint index, GLfloat v1, GLfloat v2, GLfloat v3);
 
+namespace {
+
+// Instances per block of the parallel culling in drawInstanced.
+const size_t INSTANCE_BLOCK_SIZE = 1 << 14;
+
+// Fixed-size part of the staging ring of loadOBJStreaming in front of one buffer object. Appended data is
+// uploaded with glBufferSubData whenever the slot is full, so the buffer is filled front to back.
+class StagingSlot {
+    QOpenGLFunctions_3_3_Core* f;
+    GLuint buffer;
+    char* staging;
+    size_t capacity;
+    size_t used{0};
+    size_t uploaded{0};
+
+public:
+    StagingSlot(QOpenGLFunctions_3_3_Core* f, GLuint buffer, char* staging, size_t capacity)
+        : f(f), buffer(buffer), staging(staging), capacity(capacity) {}
+
+    void push(const void* data, size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        while (size > 0) {
+            const size_t n = std::min(size, capacity - used);
+            std::memcpy(staging + used, bytes, n);
+            used += n;
+            bytes += n;
+            size -= n;
+            if (used == capacity) flush();
+        }
+    }
+
+    void flush() {
+        if (used == 0) return;
+        // GL_COPY_WRITE_BUFFER does not touch the element buffer binding of the current VAO
+        f->glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        f->glBufferSubData(GL_COPY_WRITE_BUFFER, uploaded, used, staging);
+        f->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        uploaded += used;
+        used = 0;
+    }
+};
+
+// Reads file from the start in blocks of about blockBytes and calls fn(begin, end) for the complete lines of every
+// block. The incomplete last line is moved to the front of the next block, the buffer only grows for lines that
+// are longer than a block.
+template<typename Fn>
+bool forEachOBJBlock(QFile& file, size_t blockBytes, std::vector<char>& buffer, const Fn& fn) {
+    if (!file.seek(0)) return false;
+    buffer.resize(blockBytes);
+    size_t filled = 0;
+    while (true) {
+        const qint64 n = file.read(buffer.data() + filled, buffer.size() - filled);
+        if (n < 0) return false;
+        if (n == 0) {
+            if (filled > 0) fn(buffer.data(), buffer.data() + filled);
+            return true;
+        }
+        filled += n;
+        size_t lineEnd = filled;
+        while (lineEnd > 0 && buffer[lineEnd - 1] != '\n') --lineEnd;
+        if (lineEnd == 0) {
+            if (filled == buffer.size()) buffer.resize(2 * buffer.size());
+            continue;
+        }
+        fn(buffer.data(), buffer.data() + lineEnd);
+        std::memmove(buffer.data(), buffer.data() + lineEnd, filled - lineEnd);
+        filled -= lineEnd;
+    }
+}
+
+// Draws one point per triangle corner (instanced over the triangles) into the texel of the corner's vertex.
+// Additive blending sums up the area weighted triangle normals per vertex.
+const char* NORMAL_ACCUMULATION_VS = R"(#version 330 core
+layout(location = 0) in uvec3 triangle;
+uniform samplerBuffer positions;
+uniform uint targetWidth;
+uniform vec2 targetSize;
+out vec3 faceNormal;
+
+vec3 fetchPosition(uint id) {
+    int i = 3 * int(id);
+    return vec3(texelFetch(positions, i).x, texelFetch(positions, i + 1).x, texelFetch(positions, i + 2).x);
+}
+
+void main() {
+    vec3 p0 = fetchPosition(triangle[0]);
+    faceNormal = cross(fetchPosition(triangle[1]) - p0, fetchPosition(triangle[2]) - p0);
+    uint id = triangle[gl_VertexID];
+    vec2 texel = vec2(float(id % targetWidth), float(id / targetWidth)) + 0.5;
+    gl_Position = vec4(2.0 * texel / targetSize - 1.0, 0.0, 1.0);
+}
+)";
+
+const char* NORMAL_ACCUMULATION_FS = R"(#version 330 core
+in vec3 faceNormal;
+out vec4 normalSum;
+
+void main() {
+    normalSum = vec4(faceNormal, 0.0);
+}
+)";
+
+// Full screen triangle that normalizes the summed up normals.
+const char* NORMAL_NORMALIZATION_VS = R"(#version 330 core
+void main() {
+    vec2 corner = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+    gl_Position = vec4(2.0 * corner - 1.0, 0.0, 1.0);
+}
+)";
+
+const char* NORMAL_NORMALIZATION_FS = R"(#version 330 core
+uniform sampler2D normalSums;
+out vec4 normal;
+
+void main() {
+    vec3 n = texelFetch(normalSums, ivec2(gl_FragCoord.xy), 0).xyz;
+    float len = length(n);
+    normal = vec4(len < 1e-5 ? n : n / len, 0.0);
+}
+)";
+
+// Compact vertex formats, see TriangleMesh::toggleQuantizedVertices.
+uint16_t packUnorm16(float value) {
+    return static_cast<uint16_t>(std::lround(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f));
+}
+
+// GL_INT_2_10_10_10_REV, w is stored with 2 bits, so only its sign survives
+uint32_t packSnorm10(const Vec3f& v, float w = 0.0f) {
+    auto component = [](float c) {
+        return static_cast<uint32_t>(static_cast<int32_t>(std::lround(std::min(std::max(c, -1.0f), 1.0f) * 511.0f))) & 0x3FFu;
+    };
+    const uint32_t sign = w > 0.0f ? 1u : (w < 0.0f ? 3u : 0u);
+    return component(v[0]) | component(v[1]) << 10 | component(v[2]) << 20 | sign << 30;
+}
+
+// IEEE half float, rounded to nearest even
+uint16_t packHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+    const uint32_t magnitude = bits & 0x7FFFFFFFu;
+    if (magnitude >= 0x7F800000u) return sign | 0x7C00u | (magnitude > 0x7F800000u ? 0x200u : 0u); // inf, nan
+    if (magnitude >= 0x477FF000u) return sign | 0x7C00u; // rounds to inf
+    if (magnitude < 0x38800000u) {
+        // subnormal half
+        if (magnitude < 0x33000000u) return sign;
+        const uint32_t mantissa = (magnitude & 0x7FFFFFu) | 0x800000u;
+        const uint32_t shift = 126 - (magnitude >> 23);
+        uint32_t half = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) ++half;
+        return sign | static_cast<uint16_t>(half);
+    }
+    uint32_t half = (magnitude - 0x38000000u) >> 13;
+    const uint32_t rest = magnitude & 0x1FFFu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1))) ++half;
+    return sign | static_cast<uint16_t>(half);
+}
+
+uint32_t packRGBA8(const Vec3f& color) {
+    auto component = [](float c) { return static_cast<uint32_t>(std::lround(std::min(std::max(c, 0.0f), 1.0f) * 255.0f)); };
+    return component(color[0]) | component(color[1]) << 8 | component(color[2]) << 16 | 0xFF000000u;
+}
+
+}
+
+TriangleMesh::MeshData::MeshData(const MeshData& other)
+    : MeshGeometry(other), gridRows(other.gridRows), gridColumns(other.gridColumns), gridRisingDiagonal(other.gridRisingDiagonal)
+{
+}
+
+TriangleMesh::MeshData::~MeshData() {
+    if (f) deleteGLObjects(f);
+}
+
+void TriangleMesh::MeshData::deleteGLObjects(QOpenGLFunctions_3_3_Core* f) {
+    // delete VAO
+    if (VAO.val != 0) f->glDeleteVertexArrays(1, &VAO.val);
+    // delete VBO
+    if (VBOv.val != 0) f->glDeleteBuffers(1, &VBOv.val);
+    if (VBOn.val != 0) f->glDeleteBuffers(1, &VBOn.val);
+    if (VBOf.val != 0) f->glDeleteBuffers(1, &VBOf.val);
+    if (VBOc.val != 0) f->glDeleteBuffers(1, &VBOc.val);
+    if (VBOt.val != 0) f->glDeleteBuffers(1, &VBOt.val);
+    if (VBOtan.val != 0) f->glDeleteBuffers(1, &VBOtan.val);
+    if (VBOinterleaved.val != 0) f->glDeleteBuffers(1, &VBOinterleaved.val);
+    if (VAObb.val != 0) f->glDeleteVertexArrays(1, &VAObb.val);
+    if (VBOvbb.val != 0) f->glDeleteBuffers(1, &VBOvbb.val);
+    if (VBOfbb.val != 0) f->glDeleteBuffers(1, &VBOfbb.val);
+    if (VAOn.val != 0) f->glDeleteVertexArrays(1, &VAOn.val);
+    if (VBOvn.val != 0) f->glDeleteBuffers(1, &VBOvn.val);
+    if (VBOinstances.val != 0) f->glDeleteBuffers(1, &VBOinstances.val);
+    for (GLuint& texture : materialTextures) {
+        if (texture != 0) f->glDeleteTextures(1, &texture);
+    }
+    materialTextures.clear();
+    VBOv.val = 0;
+    VBOn.val = 0;
+    VBOf.val = 0;
+    VBOc.val = 0;
+    VBOt.val = 0;
+    VBOtan.val = 0;
+    VBOinterleaved.val = 0;
+    VAO.val = 0;
+    VAObb.val = 0;
+    VBOfbb.val = 0;
+    VBOvbb.val = 0;
+    VAOn.val = 0;
+    VBOvn.val = 0;
+    VBOinstances.val = 0;
+    numGPUTriangles = 0;
+    quantizedVBOs = false;
+    stripChunks.clear();
+}
+
 TriangleMesh::TriangleMesh(QOpenGLFunctions_3_3_Core* f)
     : staticColor(1.f, 1.f, 1.f), f(f)
 {
@@ -43,42 +264,56 @@ TriangleMesh::TriangleMesh(QOpenGLFunctions_3_3_Core* f)
 }
 
 TriangleMesh::~TriangleMesh() {
-    // clear data
-    clear();
+    // the GL objects are deleted with the mesh data, once no other mesh shares it
 }
 
 void TriangleMesh::clear() {
-    // clear mesh data
-    vertices.clear();
-    triangles.clear();
-    normals.clear();
-    colors.clear();
-    texCoords.clear();
+    // start with empty mesh data, the old data stays with the meshes that share it
+    geometry = std::make_shared<MeshData>();
+    currentLOD = 0;
     // clear bounding box data
-    boundingBoxMin = Vec3f(FLT_MAX, FLT_MAX, FLT_MAX);
-    boundingBoxMax = Vec3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
-    boundingBoxMid.zero();
-    boundingBoxSize.zero();
+    geometry->boundingBoxMin = Vec3f(FLT_MAX, FLT_MAX, FLT_MAX);
+    geometry->boundingBoxMax = Vec3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    geometry->boundingBoxMid.zero();
+    geometry->boundingBoxSize.zero();
     // draw mode data
     coloringType = ColoringType::STATIC_COLOR;
     withBB = false;
     withNormals = false;
     textureID.val = 0;
-    cleanupVBO();
+}
+
+void TriangleMesh::detachGeometry() {
+    if (geometry.use_count() > 1) {
+        geometry = std::make_shared<MeshData>(*geometry);
+        currentLOD = 0;
+    }
 }
 
 void TriangleMesh::coutData() {
     std::cout << std::endl;
     std::cout << "=== MESH DATA ===" << std::endl;
-    std::cout << "nr. triangles: " << triangles.size() << std::endl;
-    std::cout << "nr. vertices:  " << vertices.size() << std::endl;
-    std::cout << "nr. normals:   " << normals.size() << std::endl;
-    std::cout << "nr. colors:    " << colors.size() << std::endl;
-    std::cout << "nr. texCoords: " << texCoords.size() << std::endl;
-    std::cout << "BB: (" << boundingBoxMin << ") - (" << boundingBoxMax << ")" << std::endl;
-    std::cout << "  BBMid: (" << boundingBoxMid << ")" << std::endl;
-    std::cout << "  BBSize: (" << boundingBoxSize << ")" << std::endl;
-    std::cout << "  VAO ID: " << VAO() << ", VBO IDs: f=" << VBOf() << ", v=" << VBOv() << ", n=" << VBOn() << ", c=" << VBOc() << ", t=" << VBOt() << std::endl;
+    std::cout << "nr. triangles: " << geometry->triangles.size() << std::endl;
+    std::cout << "nr. vertices:  " << geometry->vertices.size() << std::endl;
+    std::cout << "nr. normals:   " << geometry->normals.size() << std::endl;
+    std::cout << "nr. colors:    " << geometry->colors.size() << std::endl;
+    std::cout << "nr. texCoords: " << geometry->texCoords.size() << std::endl;
+    std::cout << "nr. materials: " << geometry->materials.size() << " (" << geometry->subMeshes.size() << " ranges)" << std::endl;
+    std::cout << "nr. levels of detail: " << getNumLevelsOfDetail() << std::endl;
+    std::cout << "BB: (" << geometry->boundingBoxMin << ") - (" << geometry->boundingBoxMax << ")" << std::endl;
+    std::cout << "  BBMid: (" << geometry->boundingBoxMid << ")" << std::endl;
+    std::cout << "  BBSize: (" << geometry->boundingBoxSize << ")" << std::endl;
+    std::cout << "  VAO ID: " << geometry->VAO() << ", VBO IDs: f=" << geometry->VBOf() << ", v=" << geometry->VBOv() << ", n=" << geometry->VBOn() << ", c=" << geometry->VBOc() << ", t=" << geometry->VBOt() << ", interleaved=" << geometry->VBOinterleaved() << std::endl;
+    std::cout << "  vertex formats: " << (geometry->quantizedVBOs ? "quantized" : "float") << std::endl;
+    std::cout << "  shared by " << geometry.use_count() << " mesh(es)" << std::endl;
+    if (!geometry->meshlets.empty())
+        std::cout << "  meshlets: " << geometry->meshlets.size() << std::endl;
+    if (geometry->bvh.isBuilt())
+        std::cout << "  BVH: " << geometry->bvh.getNumNodes() << " nodes, " << geometry->bvh.getMemoryBytes() / 1024 << " KB, built in "
+                  << std::fixed << std::setprecision(2) << geometry->bvh.getBuildSeconds() * 1000.0 << " ms" << std::defaultfloat << std::endl;
+    if (!geometry->stripChunks.empty())
+        std::cout << "  index buffer: triangle strips in " << geometry->stripChunks.size() << " chunks, "
+                  << (geometry->stripIndexType == GL_UNSIGNED_SHORT ? 16 : 32) << " bit indices" << std::endl;
     std::cout << "coloring using: ";
     switch (coloringType) {
         case ColoringType::STATIC_COLOR:
@@ -102,22 +337,93 @@ void TriangleMesh::coutData() {
 // ================
 
 void TriangleMesh::flipNormals(bool createVBOs) {
-    for (auto& n : normals) n *= -1.0f;
+    const bool hadVBOs = geometry->VAO() != 0;
+    detachGeometry();
+    for (auto& n : geometry->normals) n *= -1.0f;
     //correct VBO
-    if (createVBOs && VBOn() != 0) {
+    if (createVBOs && hadVBOs) {
         if (!f) return;
-        f->glBindBuffer(GL_ARRAY_BUFFER, VBOn());
-        f->glBufferSubData(GL_ARRAY_BUFFER, 0, normals.size() * sizeof(Normal), normals.data());
-        f->glBindBuffer(GL_ARRAY_BUFFER, 0);
+        if (geometry->VAO() == 0) {
+            // the VBOs belonged to shared data
+            createAllVBOs();
+        } else if (geometry->VBOn() != 0 && !geometry->quantizedVBOs) {
+            f->glBindBuffer(GL_ARRAY_BUFFER, geometry->VBOn());
+            f->glBufferSubData(GL_ARRAY_BUFFER, 0, geometry->normals.size() * sizeof(Normal), geometry->normals.data());
+            f->glBindBuffer(GL_ARRAY_BUFFER, 0);
+        } else {
+            // normals are packed or interleaved with the other attributes => create new VBOs (not efficient but easy)
+            recreateVBOs();
+        }
     }
 }
 
+TriangleMesh::WeldStats TriangleMesh::weldVertices(float epsilon, bool createVBOs) {
+    detachGeometry();
+    const WeldStats stats = ::weldVertices(*geometry, epsilon);
+    invalidateAdjacency();
+    invalidateBVH();
+    currentLOD = 0;
+
+    // data changed => delete VBOs and create new ones (not efficient but easy)
+    if (createVBOs) {
+        cleanupVBO();
+        createAllVBOs();
+    }
+    return stats;
+}
+
+void TriangleMesh::optimizeTriangleOrder() {
+    if (geometry->triangles.empty()) return;
+    detachGeometry();
+    ::optimizeTriangleOrder(*geometry, overdrawThreshold);
+    invalidateAdjacency();
+    invalidateBVH();
+}
+
+void TriangleMesh::buildMeshlets() {
+    detachGeometry();
+    ::buildMeshlets(*geometry);
+    // meshlets reorder the triangles within each material range
+    invalidateAdjacency();
+    invalidateBVH();
+}
+
+void TriangleMesh::optimizeVertexOrder() {
+    if (geometry->triangles.empty()) return;
+    detachGeometry();
+    ::optimizeVertexOrder(*geometry);
+    // the renumbered vertices are no longer a grid
+    geometry->gridRows = geometry->gridColumns = 0;
+    invalidateAdjacency();
+}
+
+void TriangleMesh::buildLevelsOfDetail(unsigned int numLevels) {
+    detachGeometry();
+    currentLOD = 0;
+    ::buildLevelsOfDetail(*geometry, numLevels);
+}
+
+const MeshAdjacency& TriangleMesh::getAdjacency(bool withHalfEdges) {
+    if (!geometry->adjacency.isBuilt() || (withHalfEdges && !geometry->adjacency.hasHalfEdges()))
+        geometry->adjacency.build(geometry->triangles.data(), geometry->triangles.size(), geometry->vertices.size(), withHalfEdges);
+    return geometry->adjacency;
+}
+
+const TriangleBVH& TriangleMesh::getBVH() {
+    if (!geometry->bvh.isBuilt())
+        geometry->bvh.build(geometry->vertices.data(), geometry->triangles.data(), geometry->triangles.size());
+    return geometry->bvh;
+}
+
 void TriangleMesh::translateToCenter(const Vec3f& newBBmid, bool createVBOs) {
-    Vec3f trans = newBBmid - boundingBoxMid;
-    for (auto& vertex : vertices) vertex += trans;
-    boundingBoxMin += trans;
-    boundingBoxMax += trans;
-    boundingBoxMid += trans;
+    detachGeometry();
+    Vec3f trans = newBBmid - geometry->boundingBoxMid;
+    for (auto& vertex : geometry->vertices) vertex += trans;
+    geometry->boundingBoxMin += trans;
+    geometry->boundingBoxMax += trans;
+    geometry->boundingBoxMid += trans;
+    for (auto& meshlet : geometry->meshlets) meshlet.center += trans;
+    invalidateBVH();
     // data changed => delete VBOs and create new ones (not efficient but easy)
     if (createVBOs) {
         cleanupVBO();
@@ -126,13 +432,20 @@ void TriangleMesh::translateToCenter(const Vec3f& newBBmid, bool createVBOs) {
 }
 
 void TriangleMesh::scaleToLength(const float newLength, bool createVBOs) {
-    float length = std::max(std::max(boundingBoxSize.x(), boundingBoxSize.y()), boundingBoxSize.z());
+    detachGeometry();
+    float length = std::max(std::max(geometry->boundingBoxSize.x(), geometry->boundingBoxSize.y()), geometry->boundingBoxSize.z());
     float scale = newLength / length;
-    for (auto& vertex : vertices) vertex *= scale;
-    boundingBoxMin *= scale;
-    boundingBoxMax *= scale;
-    boundingBoxMid *= scale;
-    boundingBoxSize *= scale;
+    for (auto& vertex : geometry->vertices) vertex *= scale;
+    for (auto& lod : geometry->levelsOfDetail) lod.error *= scale;
+    for (auto& meshlet : geometry->meshlets) {
+        meshlet.center *= scale;
+        meshlet.radius *= scale;
+    }
+    geometry->boundingBoxMin *= scale;
+    geometry->boundingBoxMax *= scale;
+    geometry->boundingBoxMid *= scale;
+    geometry->boundingBoxSize *= scale;
+    invalidateBVH();
     // data changed => delete VBOs and create new ones (not efficient but easy)
     if (createVBOs) {
         cleanupVBO();
@@ -147,94 +460,71 @@ void TriangleMesh::scaleToLength(const float newLength, bool createVBOs) {
 void TriangleMesh::loadOBJ(const char* filename, bool createVBOs) {
     // clear any existing mesh
     clear();
-    // load from obj
-    std::ifstream in(filename);
-    if (!in.is_open()) {
-        std::cout << "loadOBJ: can not find " << filename << std::endl;
-        return;
-    }
-
-    vertices.resize(0);
-    triangles.resize(0);
-    normals.resize(0);
-
-    // Load all vertices and triangles and ignore other entries.
-    while (!in.eof()) 
-    {
-        std::string s;        
-        in >> s;
-
-        if (s == "v") {
-            // read and store a vertex
-            GLfloat x, y, z;
-            in >> x >> y >> z;
-            vertices.push_back({ x, y, z });
-
-			// update bounding box
-			boundingBoxMin[0] = std::min(x, boundingBoxMin[0]);
-			boundingBoxMin[1] = std::min(y, boundingBoxMin[1]);
-			boundingBoxMin[2] = std::min(z, boundingBoxMin[2]);
-			boundingBoxMax[0] = std::max(x, boundingBoxMax[0]);
-			boundingBoxMax[1] = std::max(y, boundingBoxMax[1]);
-			boundingBoxMax[2] = std::max(z, boundingBoxMax[2]);
-			
-			// Ignore rest of line
-            in.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); 
-        } else if (s == "vn") {
-            // read and store a vertex normal
-            GLfloat x, y, z;
-            in >> x >> y >> z;
-            normals.push_back({ x, y, z });
-
-			// Ignore rest of line
-            in.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); 
-        } else if (s == "f") 
-        {
-            // read and store a face
-            std::string line;
-            getline(in, line);
-            std::stringstream ss(line);
-            std::vector<int> indices;
-            int num;
-
-            while (ss >> num) {
-                // convert negative indices to positive indices
-                if (num < 0) num = vertices.size() + 1 + num;
-
-                // Store and convert OBJ's 1-based indices to the required 0-based indices!
-                indices.push_back(num - 1);
-            }
-            if (indices.size() == 3)
-                triangles.push_back({ (unsigned int)indices[0], (unsigned int)indices[1], (unsigned int)indices[2] });
-            else
-                qWarning("The OBJ file contains polygons that are not triangles! Ignoring "
-                        "entry, this will lead to holes in your mesh!");
-        } else 
-        {
-            // Skip comments and other entries
-            in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-        }
+    MeshLoadOptions options;
+    options.useMeshCache = useMeshCache;
+    options.overdrawThreshold = overdrawThreshold;
+    options.useMeshlets = useMeshlets;
+    options.numLODLevels = numLODLevels;
+    if (!loadOBJGeometry(filename, options, *geometry, loadStats)) return;
 
+    // createVBO
+    if (createVBOs) {
+        createAllVBOs();
     }
+}
 
-	// update bounding box
-	boundingBoxMid = 0.5f*boundingBoxMin + 0.5f*boundingBoxMax;
-	boundingBoxSize = boundingBoxMax - boundingBoxMin;
-
-    // close ifstream
-    in.close();
-
-    // calculate normals if they are not present in the file
-    if(normals.size() != vertices.size())
-        calculateNormalsByArea();
+void TriangleMesh::loadOBJAsync(const char* filename) {
+    clear();
+    // replacing a running future would wait for it in its destructor, so the file is loaded once the running load is done
+    if (pendingLoad.valid()) {
+        queuedLoad = filename;
+        return;
+    }
+    startAsyncLoad(filename);
+}
 
-    // calculate texture coordinates
-    calculateTexCoordsSphereMapping();
+void TriangleMesh::startAsyncLoad(const std::string& name) {
+    // the worker mesh has no OpenGL functions, so it never touches the context of this thread
+    const bool cache = useMeshCache;
+    const unsigned int lodLevels = numLODLevels;
+    const float threshold = overdrawThreshold;
+    const bool meshlets = useMeshlets;
+    pendingLoad = std::async(std::launch::async, [name, cache, lodLevels, threshold, meshlets]() {
+        std::unique_ptr<TriangleMesh> mesh(new TriangleMesh());
+        mesh->toggleMeshCache(cache);
+        mesh->setLevelsOfDetail(lodLevels);
+        mesh->setOverdrawThreshold(threshold);
+        mesh->toggleMeshlets(meshlets);
+        mesh->loadOBJ(name.c_str(), false);
+        return mesh;
+    });
+}
 
-    // createVBO
+bool TriangleMesh::finishAsyncLoad(bool createVBOs) {
+    if (!pendingLoad.valid() || pendingLoad.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return false;
+    std::unique_ptr<TriangleMesh> loaded = pendingLoad.get();
+    if (!queuedLoad.empty()) {
+        // the result is outdated, a later call asked for another file
+        startAsyncLoad(queuedLoad);
+        queuedLoad.clear();
+        return false;
+    }
+    adoptGeometry(std::move(*loaded));
     if (createVBOs) {
         createAllVBOs();
     }
+    return true;
+}
+
+void TriangleMesh::adoptGeometry(TriangleMesh&& source) {
+    cleanupVBO();
+
+    // move mesh data and bounding box, the source has no GL objects
+    geometry = std::move(source.geometry);
+    source.geometry = std::make_shared<MeshData>();
+    currentLOD = 0;
+    loadStats = source.loadStats;
 }
 
 void TriangleMesh::loadOBJ(const char* filename, const Vec3f& BBmid, const float BBlength) {
@@ -243,56 +533,283 @@ void TriangleMesh::loadOBJ(const char* filename, const Vec3f& BBmid, const float
     scaleToLength(BBlength, true);
 }
 
+void TriangleMesh::loadOBJStreaming(const char* filename, size_t ringBytes) {
+    // clear any existing mesh
+    clear();
+    loadStats = ObjParseStats();
+    if (!f) {
+        std::cout << "loadOBJStreaming: needs OpenGL functions to upload " << filename << std::endl;
+        return;
+    }
+    QFile file(filename);
+    if (!file.open(QFile::ReadOnly)) {
+        std::cout << "loadOBJStreaming: can not find " << filename << std::endl;
+        return;
+    }
+    auto parseStart = std::chrono::steady_clock::now();
+
+    // half of the budget is the staging ring, the rest holds the file block and its parsed entries
+    ringBytes = std::max<size_t>(ringBytes, 1 << 16);
+    const size_t blockBytes = ringBytes / 8;
+    std::vector<char> block;
+    ObjData data;
+
+    // first pass: count all entries, find the bounding box and check how the corners use texture coordinates and
+    // normals. they can only be streamed per position if every corner uses the same index for all of them.
+    size_t numVertices = 0, numTexCoords = 0, numNormals = 0, numTriangles = 0;
+    bool anyTexCoords = false, anyNormals = false, sameIndices = true;
+    {
+        ObjBlockParser parser;
+        const bool read = forEachOBJBlock(file, blockBytes, block, [&](const char* begin, const char* end) {
+            parser.parse(begin, end, data);
+            numVertices += data.vertices.size();
+            numTexCoords += data.texCoords.size();
+            numNormals += data.normals.size();
+            for (unsigned int faceSize : data.faceSizes) numTriangles += faceSize - 2;
+            for (const ObjCorner& corner : data.corners) {
+                anyTexCoords = anyTexCoords || corner.vt >= 0;
+                anyNormals = anyNormals || corner.vn >= 0;
+                sameIndices = sameIndices && (corner.vt < 0 || corner.vt == corner.v) && (corner.vn < 0 || corner.vn == corner.v);
+            }
+            for (int k = 0; k < 3; ++k) {
+                geometry->boundingBoxMin[k] = std::min(data.boundingBoxMin[k], geometry->boundingBoxMin[k]);
+                geometry->boundingBoxMax[k] = std::max(data.boundingBoxMax[k], geometry->boundingBoxMax[k]);
+            }
+        });
+        if (!read) {
+            std::cout << "loadOBJStreaming: can not read " << filename << std::endl;
+            return;
+        }
+    }
+    if (numVertices == 0 || numTriangles == 0) {
+        std::cout << "loadOBJStreaming: " << filename << " contains no triangles" << std::endl;
+        clear();
+        return;
+    }
+    if (numVertices > std::numeric_limits<GLuint>::max()) {
+        std::cout << "loadOBJStreaming: " << filename << " has too many vertices for 32 bit indices" << std::endl;
+        clear();
+        return;
+    }
+    // attributes that are indexed differently than the positions need the (v, vt, vn) tuples of loadOBJ, which keeps
+    // the whole mesh in memory
+    const bool fileTexCoords = anyTexCoords && numTexCoords == numVertices;
+    const bool fileNormals = anyNormals && numNormals == numVertices;
+    if (!sameIndices || (anyTexCoords && !fileTexCoords) || (anyNormals && !fileNormals)) {
+        std::cout << "loadOBJStreaming: " << filename << " indexes texture coordinates or normals separately, loading it with loadOBJ" << std::endl;
+        file.close();
+        loadOBJ(filename);
+        return;
+    }
+    geometry->boundingBoxMid = 0.5f*geometry->boundingBoxMin + 0.5f*geometry->boundingBoxMax;
+    geometry->boundingBoxSize = geometry->boundingBoxMax - geometry->boundingBoxMin;
+
+    // size the buffers without uploading anything
+    geometry->f = f;
+    f->glGenVertexArrays(1, &geometry->VAO.val);
+    GLuint* buffers[4] = { &geometry->VBOv.val, &geometry->VBOn.val, &geometry->VBOt.val, &geometry->VBOf.val };
+    const size_t bufferSizes[4] = { numVertices * sizeof(Vertex), numVertices * sizeof(Normal), numVertices * sizeof(TexCoord), numTriangles * sizeof(Triangle) };
+    for (int i = 0; i < 4; ++i) {
+        f->glGenBuffers(1, buffers[i]);
+        f->glBindBuffer(GL_COPY_WRITE_BUFFER, *buffers[i]);
+        f->glBufferData(GL_COPY_WRITE_BUFFER, bufferSizes[i], nullptr, GL_STATIC_DRAW);
+    }
+    f->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    // second pass: parse again and stream every block through the staging ring
+    std::vector<char> ring(ringBytes / 2);
+    const size_t slotBytes = ring.size() / 4;
+    StagingSlot vertexSlot(f, geometry->VBOv.val, ring.data(), slotBytes);
+    StagingSlot normalSlot(f, geometry->VBOn.val, ring.data() + slotBytes, slotBytes);
+    StagingSlot texCoordSlot(f, geometry->VBOt.val, ring.data() + 2 * slotBytes, slotBytes);
+    StagingSlot triangleSlot(f, geometry->VBOf.val, ring.data() + 3 * slotBytes, slotBytes);
+    size_t droppedFaces = 0;
+    {
+        ObjBlockParser parser;
+        forEachOBJBlock(file, blockBytes, block, [&](const char* begin, const char* end) {
+            parser.parse(begin, end, data);
+            droppedFaces += data.droppedFaces;
+            vertexSlot.push(data.vertices.data(), data.vertices.size() * sizeof(Vertex));
+            if (fileTexCoords) {
+                static_assert(sizeof(ObjTexCoord) == sizeof(TexCoord), "texture coordinates are streamed as they are parsed");
+                texCoordSlot.push(data.texCoords.data(), data.texCoords.size() * sizeof(TexCoord));
+            } else {
+                for (const auto& vertex : data.vertices) {
+                    TexCoord texCoord;
+                    sphereMapping(vertex, geometry->boundingBoxMid, texCoord.u, texCoord.v);
+                    texCoordSlot.push(&texCoord, sizeof(TexCoord));
+                }
+            }
+            if (fileNormals) normalSlot.push(data.normals.data(), data.normals.size() * sizeof(Normal));
+            // triangle fan over the position indices, invalid faces become degenerate triangles to keep the size
+            const ObjCorner* corners = data.corners.data();
+            for (unsigned int faceSize : data.faceSizes) {
+                bool valid = true;
+                for (unsigned int i = 0; i < faceSize; ++i)
+                    valid = valid && corners[i].v >= 0 && static_cast<size_t>(corners[i].v) < numVertices;
+                if (!valid) ++droppedFaces;
+                for (unsigned int i = 1; i + 1 < faceSize; ++i) {
+                    const Triangle triangle = valid ? Triangle(corners[0].v, corners[i].v, corners[i + 1].v) : Triangle(0, 0, 0);
+                    triangleSlot.push(&triangle, sizeof(Triangle));
+                }
+                corners += faceSize;
+            }
+        });
+    }
+    vertexSlot.flush();
+    normalSlot.flush();
+    texCoordSlot.flush();
+    triangleSlot.flush();
+    if (droppedFaces > 0)
+        qWarning("The OBJ file contains %zu invalid faces! Ignoring these entries, this will lead to holes in your mesh!", droppedFaces);
+
+    loadStats.bytes = file.size();
+    loadStats.parseSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - parseStart).count();
+    loadStats.totalSeconds = loadStats.parseSeconds;
+    std::cout << "loadOBJStreaming: streamed " << filename << " (" << std::fixed << std::setprecision(2) << file.size() / (1024.0 * 1024.0)
+              << " MB) in " << loadStats.parseSeconds * 1000.0 << " ms, " << loadStats.megabytesPerSecond() << " MB/s" << std::defaultfloat << std::endl;
+
+    // bind VBOs to VAO object
+    f->glBindVertexArray(geometry->VAO.val);
+    f->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->VBOf.val);
+    f->glBindBuffer(GL_ARRAY_BUFFER, geometry->VBOv.val);
+    f->glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+    f->glEnableVertexAttribArray(POSITION_LOCATION);
+    f->glBindBuffer(GL_ARRAY_BUFFER, geometry->VBOn.val);
+    f->glVertexAttribPointer(NORMAL_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+    f->glEnableVertexAttribArray(NORMAL_LOCATION);
+    f->glBindBuffer(GL_ARRAY_BUFFER, geometry->VBOt.val);
+    f->glVertexAttribPointer(TEXCOORD_LOCATION, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    f->glEnableVertexAttribArray(TEXCOORD_LOCATION);
+    f->glBindVertexArray(0);
+    f->glBindBuffer(GL_ARRAY_BUFFER, 0);
+    geometry->numGPUTriangles = numTriangles;
+
+    // calculate normals if they are not present in the file
+    if (!fileNormals && !calculateNormalsByAreaOnGPU(numVertices))
+        std::cout << "loadOBJStreaming: could not calculate normals of " << filename << " on the GPU" << std::endl;
+
+    createBBVAO(f);
+}
+
 void TriangleMesh::calculateNormalsByArea() {
-    // sum up triangle normals in each vertex
-    normals.resize(vertices.size());
-    for (auto& triangle : triangles) {
-        unsigned int
-            id0 = triangle[0],
-            id1 = triangle[1],
-            id2 = triangle[2];
-        Vec3f
-            vec1 = vertices[id1] - vertices[id0],
-            vec2 = vertices[id2] - vertices[id0],
-            normal = cross(vec1, vec2);
-        normals[id0] += normal;
-        normals[id1] += normal;
-        normals[id2] += normal;
-    }
-    // normalize normals
-    for (auto& normal : normals) normal.normalize();
-}
-
-void TriangleMesh::calculateTexCoordsSphereMapping() {
-    texCoords.clear();
-    // texCoords by central projection on unit sphere
-    // optional ...
-    for (const auto& vertex : vertices) {
-        const auto dist = vertex - boundingBoxMid;
-        float u = (M_1_PI / 2) * std::atan2(dist.x(), dist.z()) + 0.5;
-        float v = M_1_PI * std::asin(dist.y() / std::sqrt(dist.x() * dist.x() + dist.y() * dist.y() + dist.z() * dist.z()));
-        texCoords.push_back(TexCoord{ u, v });
+    ::calculateNormalsByArea(*geometry, getAdjacency());
+}
+
+bool TriangleMesh::calculateNormalsByAreaOnGPU(size_t numVertices) {
+    // the sums are accumulated in a float texture with one texel per vertex
+    GLint maxTextureSize = 0, maxTexelBuffer = 0;
+    f->glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    f->glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexelBuffer);
+    const size_t width = std::min<size_t>(numVertices, maxTextureSize);
+    const size_t height = (numVertices + width - 1) / width;
+    if (height > static_cast<size_t>(maxTextureSize) || 3 * numVertices > static_cast<size_t>(maxTexelBuffer)) return false;
+
+    GLuint accumulation = compileShaders(f, NORMAL_ACCUMULATION_VS, std::strlen(NORMAL_ACCUMULATION_VS), NORMAL_ACCUMULATION_FS, std::strlen(NORMAL_ACCUMULATION_FS));
+    GLuint normalization = compileShaders(f, NORMAL_NORMALIZATION_VS, std::strlen(NORMAL_NORMALIZATION_VS), NORMAL_NORMALIZATION_FS, std::strlen(NORMAL_NORMALIZATION_FS));
+    if (accumulation == 0 || normalization == 0) {
+        deleteProgram(f, accumulation);
+        deleteProgram(f, normalization);
+        return false;
     }
 
+    // keep the state of the caller
+    GLint formerFramebuffer = 0, formerProgram = 0, formerViewport[4];
+    f->glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &formerFramebuffer);
+    f->glGetIntegerv(GL_CURRENT_PROGRAM, &formerProgram);
+    f->glGetIntegerv(GL_VIEWPORT, formerViewport);
+    const GLboolean formerBlend = f->glIsEnabled(GL_BLEND);
+    const GLboolean formerDepthTest = f->glIsEnabled(GL_DEPTH_TEST);
+    GLint formerBlendSrc = 0, formerBlendDst = 0;
+    f->glGetIntegerv(GL_BLEND_SRC_RGB, &formerBlendSrc);
+    f->glGetIntegerv(GL_BLEND_DST_RGB, &formerBlendDst);
+
+    // textures: positions as buffer texture, summed up normals and normalized normals as render targets
+    GLuint textures[3], framebuffers[2], triangleVAO = 0;
+    f->glGenTextures(3, textures);
+    f->glGenFramebuffers(2, framebuffers);
+    f->glActiveTexture(GL_TEXTURE0);
+    f->glBindTexture(GL_TEXTURE_BUFFER, textures[0]);
+    f->glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, geometry->VBOv.val);
+    for (int i = 0; i < 2; ++i) {
+        f->glBindTexture(GL_TEXTURE_2D, textures[i + 1]);
+        f->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+        f->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[i + 1], 0);
+    }
+    const bool complete = f->glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    if (complete) {
+        // one instance per triangle, the three index components are read as one integer attribute
+        f->glGenVertexArrays(1, &triangleVAO);
+        f->glBindVertexArray(triangleVAO);
+        f->glBindBuffer(GL_ARRAY_BUFFER, geometry->VBOf.val);
+        f->glVertexAttribIPointer(0, 3, GL_UNSIGNED_INT, 0, nullptr);
+        f->glVertexAttribDivisor(0, 1);
+        f->glEnableVertexAttribArray(0);
+        f->glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        f->glViewport(0, 0, width, height);
+        f->glDisable(GL_DEPTH_TEST);
+
+        // sum up triangle normals in each vertex
+        f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[0]);
+        f->glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        f->glClear(GL_COLOR_BUFFER_BIT);
+        f->glEnable(GL_BLEND);
+        f->glBlendFunc(GL_ONE, GL_ONE);
+        f->glUseProgram(accumulation);
+        const ProgramReflection& reflection = getProgramReflection(accumulation);
+        f->glUniform1i(reflection.getLocation("positions"), 0);
+        f->glUniform1ui(reflection.getLocation("targetWidth"), width);
+        f->glUniform2f(reflection.getLocation("targetSize"), width, height);
+        f->glDrawArraysInstanced(GL_POINTS, 0, 3, geometry->numGPUTriangles);
+
+        // normalize normals
+        f->glDisable(GL_BLEND);
+        f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[1]);
+        f->glUseProgram(normalization);
+        f->glBindTexture(GL_TEXTURE_2D, textures[1]);
+        f->glUniform1i(getProgramReflection(normalization).getLocation("normalSums"), 0);
+        f->glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        // copy the texels into VBOn, rows are packed so that texel i is the normal of vertex i
+        f->glBindBuffer(GL_PIXEL_PACK_BUFFER, geometry->VBOn.val);
+        f->glBufferData(GL_PIXEL_PACK_BUFFER, width * height * sizeof(Normal), nullptr, GL_STATIC_DRAW);
+        f->glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        f->glReadBuffer(GL_COLOR_ATTACHMENT0);
+        f->glReadPixels(0, 0, width, height, GL_RGB, GL_FLOAT, nullptr);
+        f->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        f->glBindVertexArray(0);
+    }
+
+    // restore the state of the caller
+    f->glBindFramebuffer(GL_FRAMEBUFFER, formerFramebuffer);
+    f->glUseProgram(formerProgram);
+    f->glViewport(formerViewport[0], formerViewport[1], formerViewport[2], formerViewport[3]);
+    f->glBlendFunc(formerBlendSrc, formerBlendDst);
+    if (formerBlend) f->glEnable(GL_BLEND); else f->glDisable(GL_BLEND);
+    if (formerDepthTest) f->glEnable(GL_DEPTH_TEST); else f->glDisable(GL_DEPTH_TEST);
+    f->glBindTexture(GL_TEXTURE_2D, 0);
+    f->glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    if (triangleVAO != 0) f->glDeleteVertexArrays(1, &triangleVAO);
+    f->glDeleteFramebuffers(2, framebuffers);
+    f->glDeleteTextures(3, textures);
+    deleteProgram(f, accumulation);
+    deleteProgram(f, normalization);
+    return complete;
 }
 
 void TriangleMesh::calculateBB() {
-    // clear bounding box data
-    boundingBoxMin = Vec3f(FLT_MAX, FLT_MAX, FLT_MAX);
-    boundingBoxMax = Vec3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
-    boundingBoxMid.zero();
-    boundingBoxSize.zero();
-    // iterate over vertices
-    for (auto& vertex : vertices) {
-        boundingBoxMin[0] = std::min(vertex[0], boundingBoxMin[0]);
-        boundingBoxMin[1] = std::min(vertex[1], boundingBoxMin[1]);
-        boundingBoxMin[2] = std::min(vertex[2], boundingBoxMin[2]);
-        boundingBoxMax[0] = std::max(vertex[0], boundingBoxMax[0]);
-        boundingBoxMax[1] = std::max(vertex[1], boundingBoxMax[1]);
-        boundingBoxMax[2] = std::max(vertex[2], boundingBoxMax[2]);
-    }
-    boundingBoxMid = 0.5f*boundingBoxMin + 0.5f*boundingBoxMax;
-    boundingBoxSize = boundingBoxMax - boundingBoxMin;
+    calculateBoundingBox(*geometry);
+}
+
+bool TriangleMesh::isGrid() const {
+    return geometry->gridRows > 1 && geometry->gridColumns > 1 && geometry->vertices.size() == static_cast<size_t>(geometry->gridRows) * geometry->gridColumns
+        && geometry->triangles.size() == 2 * static_cast<size_t>(geometry->gridRows - 1) * (geometry->gridColumns - 1);
 }
 
 GLuint TriangleMesh::createVBO(QOpenGLFunctions_3_3_Core* f, const void* data, int dataSize, GLenum target, GLenum usage) {
@@ -319,17 +836,17 @@ GLuint TriangleMesh::createVBO(QOpenGLFunctions_3_3_Core* f, const void* data, i
 }
 
 void TriangleMesh::createBBVAO(QOpenGLFunctions_3_3_Core* f) {
-    f->glGenVertexArrays(1, &VAObb.val);
+    f->glGenVertexArrays(1, &geometry->VAObb.val);
 
     // create VBOs of bounding box
-    VBOvbb.val = createVBO(f, BoxVertices, BoxVerticesSize, GL_ARRAY_BUFFER, GL_STATIC_DRAW);
-    VBOfbb.val = createVBO(f, BoxLineIndices, BoxLineIndicesSize, GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
+    geometry->VBOvbb.val = createVBO(f, BoxVertices, BoxVerticesSize, GL_ARRAY_BUFFER, GL_STATIC_DRAW);
+    geometry->VBOfbb.val = createVBO(f, BoxLineIndices, BoxLineIndicesSize, GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
 
     // bind VAO of bounding box
-    f->glBindVertexArray(VAObb.val);
-    f->glBindBuffer(GL_ARRAY_BUFFER, VBOvbb.val);
+    f->glBindVertexArray(geometry->VAObb.val);
+    f->glBindBuffer(GL_ARRAY_BUFFER, geometry->VBOvbb.val);
     f->glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-    f->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, VBOfbb.val);
+    f->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->VBOfbb.val);
 
     f->glEnableVertexAttribArray(POSITION_LOCATION);
     f->glBindVertexArray(0);
@@ -338,116 +855,202 @@ void TriangleMesh::createBBVAO(QOpenGLFunctions_3_3_Core* f) {
 }
 
 void TriangleMesh::createNormalVAO(QOpenGLFunctions_3_3_Core* f) {
-    if (vertices.size() != normals.size()) return;
+    if (geometry->vertices.size() != geometry->normals.size()) return;
     std::vector<Vec3f> normalArrowVertices;
-    normalArrowVertices.reserve(2 * vertices.size());
-    for (size_t i = 0; i < vertices.size(); ++i) {
-        normalArrowVertices.push_back(vertices[i]);
-        normalArrowVertices.push_back(vertices[i] + 0.1 * normals[i]);
+    normalArrowVertices.reserve(2 * geometry->vertices.size());
+    for (size_t i = 0; i < geometry->vertices.size(); ++i) {
+        normalArrowVertices.push_back(geometry->vertices[i]);
+        normalArrowVertices.push_back(geometry->vertices[i] + 0.1 * geometry->normals[i]);
     }
 
-    f->glGenVertexArrays(1, &VAOn.val);
-    VBOvn.val = createVBO(f, normalArrowVertices.data(), normalArrowVertices.size() * sizeof(Vertex), GL_ARRAY_BUFFER, GL_STATIC_DRAW);
-    f->glBindVertexArray(VAOn.val);
-    f->glBindBuffer(GL_ARRAY_BUFFER, VBOvn.val);
+    f->glGenVertexArrays(1, &geometry->VAOn.val);
+    geometry->VBOvn.val = createVBO(f, normalArrowVertices.data(), normalArrowVertices.size() * sizeof(Vertex), GL_ARRAY_BUFFER, GL_STATIC_DRAW);
+    f->glBindVertexArray(geometry->VAOn.val);
+    f->glBindBuffer(GL_ARRAY_BUFFER, geometry->VBOvn.val);
     f->glEnableVertexAttribArray(POSITION_LOCATION);
     f->glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
     f->glBindVertexArray(0);
     f->glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
+GLuint TriangleMesh::createAttributeVBO(GLuint location, const void* data, size_t dataSize, const AttributeFormat& format) {
+    GLuint id = createVBO(f, data, dataSize, GL_ARRAY_BUFFER, GL_STATIC_DRAW);
+    f->glBindBuffer(GL_ARRAY_BUFFER, id);
+    f->glVertexAttribPointer(location, format.size, format.type, format.normalized, 0, nullptr);
+    f->glEnableVertexAttribArray(location);
+    f->glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return id;
+}
+
+void TriangleMesh::createInterleavedVBO(const std::vector<VertexStream>& streams) {
+    // every attribute is a multiple of 4 bytes, so all attributes stay aligned
+    std::vector<size_t> offsets;
+    size_t stride = 0;
+    for (const auto& stream : streams) {
+        offsets.push_back(stride);
+        stride += stream.elementSize;
+    }
+    std::vector<char> interleaved(stride * geometry->vertices.size());
+    for (size_t s = 0; s < streams.size(); ++s) {
+        const char* source = static_cast<const char*>(streams[s].data);
+        for (size_t i = 0; i < geometry->vertices.size(); ++i)
+            std::memcpy(interleaved.data() + i * stride + offsets[s], source + i * streams[s].elementSize, streams[s].elementSize);
+    }
+    geometry->VBOinterleaved.val = createVBO(f, interleaved.data(), interleaved.size(), GL_ARRAY_BUFFER, GL_STATIC_DRAW);
+    f->glBindBuffer(GL_ARRAY_BUFFER, geometry->VBOinterleaved.val);
+    for (size_t s = 0; s < streams.size(); ++s) {
+        const AttributeFormat& format = streams[s].format;
+        f->glVertexAttribPointer(streams[s].location, format.size, format.type, format.normalized, static_cast<GLsizei>(stride),
+                                 reinterpret_cast<const void*>(offsets[s]));
+        f->glEnableVertexAttribArray(streams[s].location);
+    }
+    f->glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 void TriangleMesh::createAllVBOs() {
     if (!f) return;
+    // meshes that share the data share the VBOs, the last of them deletes them
+    geometry->f = f;
     // create VAOs
-    f->glGenVertexArrays(1, &VAO.val);
+    f->glGenVertexArrays(1, &geometry->VAO.val);
 
     // create VBOs
-    VBOf.val = createVBO(f, triangles.data(), triangles.size() * sizeof(Triangle), GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
-    VBOv.val = createVBO(f, vertices.data(), vertices.size() * sizeof(Vertex), GL_ARRAY_BUFFER, GL_STATIC_DRAW);
-    VBOn.val = createVBO(f, normals.data(), normals.size() * sizeof(Normal), GL_ARRAY_BUFFER, GL_STATIC_DRAW);
-    if (colors.size() == vertices.size()) {
-        VBOc.val = createVBO(f, colors.data(), colors.size() * sizeof(Color), GL_ARRAY_BUFFER, GL_STATIC_DRAW);
-        f->glEnableVertexAttribArray(COLOR_LOCATION);
-    }
-    if (texCoords.size() == vertices.size()) {
-        VBOt.val = createVBO(f, texCoords.data(), texCoords.size() * sizeof(TexCoord), GL_ARRAY_BUFFER, GL_STATIC_DRAW);
-        f->glEnableVertexAttribArray(TEXCOORD_LOCATION);
+    if (useTriangleStrips && isGrid()) {
+        // one strip per row, 16 bit indices if possible. about a sixth of the memory of the triangle list.
+        GridStrips strips = buildGridStrips(geometry->gridRows, geometry->gridColumns, geometry->gridRisingDiagonal);
+        if (!strips.shortIndices.empty()) {
+            geometry->stripIndexType = GL_UNSIGNED_SHORT;
+            geometry->VBOf.val = createVBO(f, strips.shortIndices.data(), strips.shortIndices.size() * sizeof(uint16_t), GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
+        } else {
+            geometry->stripIndexType = GL_UNSIGNED_INT;
+            geometry->VBOf.val = createVBO(f, strips.longIndices.data(), strips.longIndices.size() * sizeof(uint32_t), GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
+        }
+        geometry->stripChunks = std::move(strips.chunks);
+    } else {
+        if (geometry->lodTriangles.empty()) {
+            geometry->VBOf.val = createVBO(f, geometry->triangles.data(), geometry->triangles.size() * sizeof(Triangle), GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
+        } else {
+            // the simplified levels follow the full mesh
+            Triangles allTriangles;
+            allTriangles.reserve(geometry->triangles.size() + geometry->lodTriangles.size());
+            allTriangles.insert(allTriangles.end(), geometry->triangles.begin(), geometry->triangles.end());
+            allTriangles.insert(allTriangles.end(), geometry->lodTriangles.begin(), geometry->lodTriangles.end());
+            geometry->VBOf.val = createVBO(f, allTriangles.data(), allTriangles.size() * sizeof(Triangle), GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
+        }
     }
-    if (tangents.size() == vertices.size()) {
-        VBOtan.val = createVBO(f, tangents.data(), tangents.size() * sizeof(Tangent), GL_ARRAY_BUFFER, GL_STATIC_DRAW);
-        f->glEnableVertexAttribArray(TANGENT_LOCATION);   
+    // diffuse textures of the materials
+    geometry->materialTextures.assign(geometry->materials.size(), 0);
+    for (size_t i = 0; i < geometry->materials.size(); ++i) {
+        if (geometry->materials[i].diffuseMap.empty()) continue;
+        geometry->materialTextures[i] = loadImageIntoTexture(f, geometry->materials[i].diffuseMap.c_str(), true);
+        if (geometry->materialTextures[i] == 0)
+            std::cout << "createAllVBOs: can not load texture " << geometry->materials[i].diffuseMap << std::endl;
     }
 
     // bind VBOs to VAO object
-    f->glBindVertexArray(VAO.val);
-    f->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, VBOf.val);
-    f->glBindBuffer(GL_ARRAY_BUFFER, VBOv.val);
-    f->glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-    f->glEnableVertexAttribArray(POSITION_LOCATION);
-    f->glBindBuffer(GL_ARRAY_BUFFER, VBOn.val);
-    f->glVertexAttribPointer(NORMAL_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-    f->glEnableVertexAttribArray(NORMAL_LOCATION);
-    if (VBOc.val) {
-        f->glBindBuffer(GL_ARRAY_BUFFER, VBOc.val);
-        f->glVertexAttribPointer(COLOR_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-        f->glEnableVertexAttribArray(COLOR_LOCATION);
-    }
+    f->glBindVertexArray(geometry->VAO.val);
+    f->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->VBOf.val);
+    const bool withNormals = geometry->normals.size() == geometry->vertices.size();
+    const bool withColors = geometry->colors.size() == geometry->vertices.size();
+    const bool withTexCoords = geometry->texCoords.size() == geometry->vertices.size();
+    const bool withTangents = geometry->tangents.size() == geometry->vertices.size();
+    std::vector<VertexStream> streams;
+    // packed copies of the attributes, they must live until the upload
+    std::vector<std::array<uint16_t, 4>> packedPositions;
+    std::vector<uint32_t> packedNormals, packedColors, packedTexCoords, packedTangents;
+    geometry->quantizedVBOs = quantizeVertices;
+    if (!geometry->quantizedVBOs) {
+        streams.push_back({ POSITION_LOCATION, geometry->vertices.data(), geometry->vertices.size(), sizeof(Vertex), AttributeFormat{ 3, GL_FLOAT, GL_FALSE }, &geometry->VBOv });
+        if (withNormals)
+            streams.push_back({ NORMAL_LOCATION, geometry->normals.data(), geometry->normals.size(), sizeof(Normal), AttributeFormat{ 3, GL_FLOAT, GL_FALSE }, &geometry->VBOn });
+        if (withColors)
+            streams.push_back({ COLOR_LOCATION, geometry->colors.data(), geometry->colors.size(), sizeof(Color), AttributeFormat{ 3, GL_FLOAT, GL_FALSE }, &geometry->VBOc });
+        if (withTexCoords)
+            streams.push_back({ TEXCOORD_LOCATION, geometry->texCoords.data(), geometry->texCoords.size(), sizeof(TexCoord), AttributeFormat{ 2, GL_FLOAT, GL_FALSE }, &geometry->VBOt });
+        if (withTangents)
+            streams.push_back({ TANGENT_LOCATION, geometry->tangents.data(), geometry->tangents.size(), sizeof(Tangent), AttributeFormat{ 4, GL_FLOAT, GL_FALSE }, &geometry->VBOtan });
+    } else {
+        // 24 instead of 60 bytes per vertex. positions are stored relative to the bounding box in [0,1].
+        geometry->quantizationOffset = geometry->boundingBoxMin;
+        geometry->quantizationScale = geometry->boundingBoxMax - geometry->boundingBoxMin;
+        Vec3f inverseScale;
+        for (int k = 0; k < 3; ++k) inverseScale[k] = geometry->quantizationScale[k] > 0.0f ? 1.0f / geometry->quantizationScale[k] : 0.0f;
+        packedPositions.resize(geometry->vertices.size());
+        for (size_t i = 0; i < geometry->vertices.size(); ++i) {
+            for (int k = 0; k < 3; ++k) packedPositions[i][k] = packUnorm16((geometry->vertices[i][k] - geometry->quantizationOffset[k]) * inverseScale[k]);
+            packedPositions[i][3] = 0;
+        }
+        streams.push_back({ POSITION_LOCATION, packedPositions.data(), packedPositions.size(), sizeof(packedPositions[0]), AttributeFormat{ 4, GL_UNSIGNED_SHORT, GL_TRUE }, &geometry->VBOv });
 
-    if (VBOt.val) {
-        f->glBindBuffer(GL_ARRAY_BUFFER, VBOt.val);
-        f->glVertexAttribPointer(TEXCOORD_LOCATION, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
-        f->glEnableVertexAttribArray(TEXCOORD_LOCATION);
+        if (withNormals) {
+            packedNormals.resize(geometry->normals.size());
+            for (size_t i = 0; i < geometry->normals.size(); ++i) packedNormals[i] = packSnorm10(geometry->normals[i]);
+            streams.push_back({ NORMAL_LOCATION, packedNormals.data(), packedNormals.size(), sizeof(uint32_t), AttributeFormat{ 4, GL_INT_2_10_10_10_REV, GL_TRUE }, &geometry->VBOn });
+        }
+        if (withColors) {
+            packedColors.resize(geometry->colors.size());
+            for (size_t i = 0; i < geometry->colors.size(); ++i) packedColors[i] = packRGBA8(geometry->colors[i]);
+            streams.push_back({ COLOR_LOCATION, packedColors.data(), packedColors.size(), sizeof(uint32_t), AttributeFormat{ 4, GL_UNSIGNED_BYTE, GL_TRUE }, &geometry->VBOc });
+        }
+        if (withTexCoords) {
+            packedTexCoords.resize(geometry->texCoords.size());
+            for (size_t i = 0; i < geometry->texCoords.size(); ++i)
+                packedTexCoords[i] = packHalf(geometry->texCoords[i].u) | static_cast<uint32_t>(packHalf(geometry->texCoords[i].v)) << 16;
+            streams.push_back({ TEXCOORD_LOCATION, packedTexCoords.data(), packedTexCoords.size(), sizeof(uint32_t), AttributeFormat{ 2, GL_HALF_FLOAT, GL_FALSE }, &geometry->VBOt });
+        }
+        if (withTangents) {
+            // tangents are not unit length, but only their direction is used
+            packedTangents.resize(geometry->tangents.size());
+            for (size_t i = 0; i < geometry->tangents.size(); ++i)
+                packedTangents[i] = packSnorm10(geometry->tangents[i].direction.normalized(), geometry->tangents[i].handedness);
+            streams.push_back({ TANGENT_LOCATION, packedTangents.data(), packedTangents.size(), sizeof(uint32_t), AttributeFormat{ 4, GL_INT_2_10_10_10_REV, GL_TRUE }, &geometry->VBOtan });
+        }
     }
-    if (VBOtan.val) {
-        f->glBindBuffer(GL_ARRAY_BUFFER, VBOtan.val);
-        f->glVertexAttribPointer(TANGENT_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-        f->glEnableVertexAttribArray(TANGENT_LOCATION);   
+    // both layouts read vertices.size() elements of every stream, a shorter stream is left disabled instead
+    streams.erase(std::remove_if(streams.begin(), streams.end(),
+                                 [&](const VertexStream& stream) { return stream.count != geometry->vertices.size(); }),
+                  streams.end());
+    if (interleaveVertices) {
+        createInterleavedVBO(streams);
+    } else {
+        for (const auto& stream : streams)
+            stream.vbo->val = createAttributeVBO(stream.location, stream.data, stream.elementSize * geometry->vertices.size(), stream.format);
     }
 
     f->glBindVertexArray(0);
+    geometry->numGPUTriangles = 0;
+    for (const auto& chunk : geometry->stripChunks) geometry->numGPUTriangles += chunk.numTriangles;
+    if (geometry->stripChunks.empty()) geometry->numGPUTriangles = geometry->triangles.size();
 
     createBBVAO(f);
 
     createNormalVAO(f);
 }
 
+void TriangleMesh::recreateVBOs() {
+    if (!f || geometry->VAO() == 0) return;
+    cleanupVBO(f);
+    createAllVBOs();
+}
+
 void TriangleMesh::cleanupVBO() {
     if (!f) return;
     cleanupVBO(f);
 }
 
 void TriangleMesh::cleanupVBO(QOpenGLFunctions_3_3_Core* f) {
-    // delete VAO
-    if (VAO.val != 0) f->glDeleteVertexArrays(1, &VAO.val);
-    // delete VBO
-    if (VBOv.val != 0) f->glDeleteBuffers(1, &VBOv.val);
-    if (VBOn.val != 0) f->glDeleteBuffers(1, &VBOn.val);
-    if (VBOf.val != 0) f->glDeleteBuffers(1, &VBOf.val);
-    if (VBOc.val != 0) f->glDeleteBuffers(1, &VBOc.val);
-    if (VBOt.val != 0) f->glDeleteBuffers(1, &VBOt.val);
-    if (VBOtan.val != 0) f->glDeleteBuffers(1, &VBOtan.val);
-    if (VAObb.val != 0) f->glDeleteVertexArrays(1, &VAObb.val);
-    if (VBOvbb.val != 0) f->glDeleteBuffers(1, &VBOvbb.val);
-    if (VBOfbb.val != 0) f->glDeleteBuffers(1, &VBOfbb.val);
-    if (VAOn.val != 0) f->glDeleteVertexArrays(1, &VAOn.val);
-    if (VBOvn.val != 0) f->glDeleteBuffers(1, &VBOvn.val);
-    VBOv.val = 0;
-    VBOn.val = 0;
-    VBOf.val = 0;
-    VBOc.val = 0;
-    VBOt.val = 0;
-    VBOtan.val = 0;
-    VAO.val = 0;
-    VAObb.val = 0;
-    VBOfbb.val = 0;
-    VBOvbb.val = 0;
-    VAOn.val = 0;
-    VBOvn.val = 0;
+    // GL objects that other meshes share stay alive, this mesh continues with a copy of the data without them
+    if (geometry.use_count() > 1) {
+        detachGeometry();
+    } else {
+        geometry->deleteGLObjects(f);
+    }
+    currentLOD = 0;
 }
 
 // a method to draw the triangles and return the size of triangles
 unsigned int TriangleMesh::drawAndCountTriangles(RenderState& state) {
-    if (VAO.val == 0) 
+    if (geometry->VAO.val == 0) 
         return 0;
 
     if (withBB || withNormals) {
@@ -457,12 +1060,34 @@ unsigned int TriangleMesh::drawAndCountTriangles(RenderState& state) {
         if (withNormals) drawNormals(state);
         state.setCurrentProgram(formerProgram);
     }
-    drawVBO(state);
+    return static_cast<unsigned int>(drawVBO(state));
+}
 
-    return triangles.size();
+unsigned int TriangleMesh::selectLevelOfDetail(const RenderState& state, float viewportHeight, float maxPixelError) {
+    currentLOD = 0;
+    // strips are only built for grids, their index buffer has no simplified levels
+    if (geometry->levelsOfDetail.empty() || !geometry->stripChunks.empty() || geometry->VAO.val == 0) return 0;
+
+    // the error of a level is measured in object space, the model view matrix may scale it
+    const QMatrix4x4 modelView = state.getCurrentModelViewMatrix();
+    const float scale = std::max(std::max(modelView.column(0).toVector3D().length(), modelView.column(1).toVector3D().length()),
+                                 modelView.column(2).toVector3D().length());
+    // distance of the eye to the nearest point of the bounding sphere, the error can not project larger anywhere
+    const QVector3D center = modelView.map(QVector3D(geometry->boundingBoxMid.x(), geometry->boundingBoxMid.y(), geometry->boundingBoxMid.z()));
+    const float distance = center.length() - 0.5f * geometry->boundingBoxSize.length() * scale;
+    if (distance <= 0.0f) return 0;
+    // size of one unit in pixels at that distance, projection(1, 1) is cot(fovy / 2)
+    const float pixelsPerUnit = 0.5f * viewportHeight * state.getCurrentProjectionMatrix()(1, 1) / distance;
+    for (unsigned int level = geometry->levelsOfDetail.size(); level > 0; --level) {
+        if (geometry->levelsOfDetail[level - 1].error * scale * pixelsPerUnit <= maxPixelError) {
+            currentLOD = level;
+            break;
+        }
+    }
+    return currentLOD;
 }
 
-void TriangleMesh::drawVBO(RenderState& state) {
+size_t TriangleMesh::drawVBO(RenderState& state) {
     auto* f = state.getOpenGLFunctions();
 
     //Bug in Qt: They flagged glVertexAttrib3f as deprecated in modern OpenGL, which is not true.
@@ -470,7 +1095,7 @@ void TriangleMesh::drawVBO(RenderState& state) {
     static auto glVertexAttrib3fv = reinterpret_cast<glVertexAttrib3fvPtr>(QOpenGLContext::currentContext()->getProcAddress("glVertexAttrib3fv"));
     
     // The VAO keeps track of all the buffers and the element buffer, so we do not need to bind else except for the VAO
-    f->glBindVertexArray(VAO.val);
+    f->glBindVertexArray(geometry->VAO.val);
     f->glUniformMatrix4fv(state.getModelViewUniform(), 1, GL_FALSE, state.getCurrentModelViewMatrix().data());
     f->glUniformMatrix3fv(state.getNormalMatrixUniform(), 1, GL_FALSE, state.calculateNormalMatrix().data());
     switch (coloringType) {
@@ -485,7 +1110,7 @@ void TriangleMesh::drawVBO(RenderState& state) {
             //[[fallthrough]];
 
         case ColoringType::COLOR_ARRAY:
-            if (VBOc.val != 0) {
+            if (hasColorArray()) {
                 f->glUniform1ui(state.getUseTextureUniform(), GL_FALSE);
                 f->glEnableVertexAttribArray(COLOR_LOCATION);
                 break;
@@ -503,35 +1128,286 @@ void TriangleMesh::drawVBO(RenderState& state) {
             f->glDisableVertexAttribArray(COLOR_LOCATION);
             glVertexAttrib3fv(2, reinterpret_cast<const GLfloat*>(&staticColor));
 
-            GLint location;
-            auto program = state.getCurrentProgram();
-
-            location = f->glGetUniformLocation(program, "useDiffuse");
-            f->glUniform1ui(location, enableDiffuseTexture);
-
-            location = f->glGetUniformLocation(program, "useNormal");
-            f->glUniform1ui(location, enableNormalMapping);
-
-            location = f->glGetUniformLocation(program, "useDisplacement");
-            f->glUniform1ui(location, enableDisplacementMapping);
+            f->glUniform1ui(state.getUniformLocation(Uniform::USE_DIFFUSE), enableDiffuseTexture);
+            f->glUniform1ui(state.getUniformLocation(Uniform::USE_NORMAL), enableNormalMapping);
+            f->glUniform1ui(state.getUniformLocation(Uniform::USE_DISPLACEMENT), enableDisplacementMapping);
 
-            location = f->glGetUniformLocation(program, "diffuseTexture");
-            f->glUniform1i(location, 0);
+            f->glUniform1i(state.getUniformLocation(Uniform::DIFFUSE_TEXTURE), 0);
             f->glActiveTexture(GL_TEXTURE0);
             f->glBindTexture(GL_TEXTURE_2D, textureID.val);
 
-            location = f->glGetUniformLocation(program, "normalTexture");
-            f->glUniform1i(location, 1);
+            f->glUniform1i(state.getUniformLocation(Uniform::NORMAL_TEXTURE), 1);
             f->glActiveTexture(GL_TEXTURE1);
             f->glBindTexture(GL_TEXTURE_2D, normalMapID.val);
 
-            location = f->glGetUniformLocation(program, "displacementTexture");
-            f->glUniform1i(location, 3);
+            f->glUniform1i(state.getUniformLocation(Uniform::DISPLACEMENT_TEXTURE), 3);
             f->glActiveTexture(GL_TEXTURE3);
             f->glBindTexture(GL_TEXTURE_2D, displacementMapID.val);
             break;
     }
-    f->glDrawElements(GL_TRIANGLES, 3*triangles.size(), GL_UNSIGNED_INT, nullptr);
+    // quantized positions are in [0,1] relative to the bounding box. the uniforms are the identity for all other meshes.
+    if (geometry->quantizedVBOs) {
+        f->glUniform3fv(state.getPositionScaleUniform(), 1, reinterpret_cast<const GLfloat*>(&geometry->quantizationScale));
+        f->glUniform3fv(state.getPositionOffsetUniform(), 1, reinterpret_cast<const GLfloat*>(&geometry->quantizationOffset));
+    }
+    size_t numDrawn = currentLOD == 0 ? geometry->numGPUTriangles : geometry->levelsOfDetail[currentLOD - 1].numTriangles;
+    if (!geometry->stripChunks.empty()) {
+        // one strip per row of the grid, the rows are separated by the restart index
+        const size_t indexSize = geometry->stripIndexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        f->glEnable(GL_PRIMITIVE_RESTART);
+        f->glPrimitiveRestartIndex(geometry->stripIndexType == GL_UNSIGNED_SHORT ? 0xFFFFu : 0xFFFFFFFFu);
+        for (const auto& chunk : geometry->stripChunks) {
+            f->glDrawElementsBaseVertex(GL_TRIANGLE_STRIP, static_cast<GLsizei>(chunk.numIndices), geometry->stripIndexType,
+                                        reinterpret_cast<const void*>(chunk.firstIndex * indexSize), chunk.baseVertex);
+        }
+        f->glDisable(GL_PRIMITIVE_RESTART);
+    } else if (currentLOD == 0 && !geometry->meshlets.empty()) {
+        numDrawn = drawMeshlets(state);
+    } else if (geometry->subMeshes.empty()) {
+        // a simplified level follows the full mesh in VBOf
+        if (currentLOD == 0) {
+            f->glDrawElements(GL_TRIANGLES, 3*geometry->numGPUTriangles, GL_UNSIGNED_INT, nullptr);
+        } else {
+            f->glDrawElements(GL_TRIANGLES, 3*geometry->levelsOfDetail[currentLOD - 1].numTriangles, GL_UNSIGNED_INT,
+                              reinterpret_cast<const void*>(geometry->numGPUTriangles * sizeof(Triangle)));
+        }
+    } else {
+        // one draw call per material range. materials replace the static color and the texture, the ranges are sorted
+        // by material, so the state only changes between ranges.
+        const bool useMaterials = coloringType == ColoringType::STATIC_COLOR || coloringType == ColoringType::TEXTURE;
+        const std::vector<SubMesh>& ranges = currentLOD == 0 ? geometry->subMeshes : geometry->levelsOfDetail[currentLOD - 1].ranges;
+        const size_t firstTriangle = currentLOD == 0 ? 0 : geometry->numGPUTriangles;
+        if (useMaterials) f->glDisableVertexAttribArray(COLOR_LOCATION);
+        for (const auto& range : ranges) {
+            if (useMaterials) applyMaterial(state, range.material);
+            f->glDrawElements(GL_TRIANGLES, 3*range.numTriangles, GL_UNSIGNED_INT, reinterpret_cast<const void*>((firstTriangle + range.firstTriangle) * sizeof(Triangle)));
+        }
+    }
+    if (geometry->quantizedVBOs) {
+        f->glUniform3f(state.getPositionScaleUniform(), 1.0f, 1.0f, 1.0f);
+        f->glUniform3f(state.getPositionOffsetUniform(), 0.0f, 0.0f, 0.0f);
+    }
+    return numDrawn;
+}
+
+size_t TriangleMesh::drawMeshlets(RenderState& state) {
+    auto* f = state.getOpenGLFunctions();
+    // the bounds of the meshlets are in object space, so are the planes of projection * modelView and the inverse
+    // model view transformation of the eye
+    const QMatrix4x4 mvp = state.getCurrentProjectionMatrix() * state.getCurrentModelViewMatrix();
+    bool invertible = false;
+    const QVector3D eye = state.getCurrentModelViewMatrix().inverted(&invertible).map(QVector3D(0.0f, 0.0f, 0.0f));
+    // left, right, bottom, top, near, far as (a, b, c, d) with a x + b y + c z + d >= 0 inside
+    QVector4D planes[6];
+    for (int i = 0; i < 6; ++i) {
+        const QVector4D row = mvp.row(i / 2), w = mvp.row(3);
+        const QVector4D plane = i % 2 == 0 ? w + row : w - row;
+        planes[i] = plane / plane.toVector3D().length();
+    }
+    auto isVisible = [&](const Meshlet& meshlet) {
+        const QVector3D center(meshlet.center.x(), meshlet.center.y(), meshlet.center.z());
+        for (const auto& plane : planes)
+            if (QVector3D::dotProduct(plane.toVector3D(), center) + plane.w() < -meshlet.radius) return false;
+        if (!invertible || meshlet.coneCutoff >= 1.0f) return true;
+        const QVector3D toCenter = center - eye;
+        const QVector3D axis(meshlet.coneAxis.x(), meshlet.coneAxis.y(), meshlet.coneAxis.z());
+        return QVector3D::dotProduct(toCenter, axis) < meshlet.coneCutoff * toCenter.length() + meshlet.radius;
+    };
+
+    // neighbouring visible meshlets are merged into one range, one glMultiDrawElements call per material
+    const bool useMaterials = !geometry->subMeshes.empty() && (coloringType == ColoringType::STATIC_COLOR || coloringType == ColoringType::TEXTURE);
+    if (useMaterials) f->glDisableVertexAttribArray(COLOR_LOCATION);
+    auto submit = [&]() {
+        if (!meshletCounts.empty())
+            f->glMultiDrawElements(GL_TRIANGLES, meshletCounts.data(), GL_UNSIGNED_INT, meshletOffsets.data(), static_cast<GLsizei>(meshletCounts.size()));
+        meshletCounts.clear();
+        meshletOffsets.clear();
+    };
+    size_t numDrawn = 0, rangeEnd = 0;
+    int material = 0;
+    bool materialApplied = false;
+    for (size_t i = 0; i < geometry->meshlets.size(); ++i) {
+        const Meshlet& meshlet = geometry->meshlets[i];
+        if (!isVisible(meshlet)) continue;
+        if (useMaterials && (!materialApplied || geometry->meshletMaterials[i] != material)) {
+            submit();
+            material = geometry->meshletMaterials[i];
+            materialApplied = true;
+            applyMaterial(state, material);
+        }
+        if (!meshletCounts.empty() && meshlet.firstTriangle == rangeEnd) {
+            meshletCounts.back() += static_cast<GLsizei>(3 * meshlet.numTriangles);
+        } else {
+            meshletCounts.push_back(static_cast<GLsizei>(3 * meshlet.numTriangles));
+            meshletOffsets.push_back(reinterpret_cast<const void*>(meshlet.firstTriangle * sizeof(Triangle)));
+        }
+        rangeEnd = meshlet.firstTriangle + meshlet.numTriangles;
+        numDrawn += meshlet.numTriangles;
+    }
+    submit();
+    return numDrawn;
+}
+
+unsigned int TriangleMesh::drawInstanced(RenderState& state, const std::vector<Instance>& instances, float viewportHeight,
+                                         std::vector<unsigned int>& lodHistogram, float maxPixelError) {
+    // strips are only built for grids, their index buffer has no simplified levels
+    const unsigned int numLevels = geometry->stripChunks.empty() ? getNumLevelsOfDetail() : 1;
+    lodHistogram.assign(getNumLevelsOfDetail(), 0);
+    if (geometry->VAO.val == 0 || instances.empty()) return 0;
+    auto* f = state.getOpenGLFunctions();
+
+    // world space planes of projection * view, like in drawMeshlets, and the eye in world space
+    const QMatrix4x4& view = state.getCurrentModelViewMatrix();
+    const QMatrix4x4 viewProjection = state.getCurrentProjectionMatrix() * view;
+    const QVector3D eye = view.inverted().map(QVector3D(0.0f, 0.0f, 0.0f));
+    QVector4D planes[6];
+    for (int i = 0; i < 6; ++i) {
+        const QVector4D row = viewProjection.row(i / 2), w = viewProjection.row(3);
+        const QVector4D plane = i % 2 == 0 ? w + row : w - row;
+        planes[i] = plane / plane.toVector3D().length();
+    }
+    // size of one unit in pixels at distance 1, see selectLevelOfDetail
+    const float pixelsPerUnit = 0.5f * viewportHeight * state.getCurrentProjectionMatrix()(1, 1);
+    const Vec3f& mid = geometry->boundingBoxMid;
+    const float objectRadius = 0.5f * geometry->boundingBoxSize.length();
+
+    // level of every instance, -1 if it is outside the frustum
+    instanceLevels.resize(instances.size());
+    parallelFor(instances.size(), INSTANCE_BLOCK_SIZE, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const float* m = instances[i].model;
+            const QVector3D center(m[0] * mid[0] + m[4] * mid[1] + m[8] * mid[2] + m[12],
+                                   m[1] * mid[0] + m[5] * mid[1] + m[9] * mid[2] + m[13],
+                                   m[2] * mid[0] + m[6] * mid[1] + m[10] * mid[2] + m[14]);
+            const float scale = std::sqrt(std::max(std::max(m[0] * m[0] + m[1] * m[1] + m[2] * m[2], m[4] * m[4] + m[5] * m[5] + m[6] * m[6]),
+                                                   m[8] * m[8] + m[9] * m[9] + m[10] * m[10]));
+            const float radius = objectRadius * scale;
+            int level = 0;
+            for (const auto& plane : planes) {
+                if (QVector3D::dotProduct(plane.toVector3D(), center) + plane.w() < -radius) {
+                    level = -1;
+                    break;
+                }
+            }
+            const float distance = (center - eye).length() - radius;
+            if (level == 0 && distance > 0.0f) {
+                for (unsigned int l = numLevels - 1; l > 0; --l) {
+                    if (geometry->levelsOfDetail[l - 1].error * scale * pixelsPerUnit <= maxPixelError * distance) {
+                        level = static_cast<int>(l);
+                        break;
+                    }
+                }
+            }
+            instanceLevels[i] = level;
+        }
+    });
+
+    // sort the visible instances by level, each level is one contiguous range of the instance buffer
+    for (int level : instanceLevels)
+        if (level >= 0) ++lodHistogram[level];
+    std::vector<size_t> levelFirst(numLevels + 1, 0);
+    for (unsigned int l = 0; l < numLevels; ++l) levelFirst[l + 1] = levelFirst[l] + lodHistogram[l];
+    if (levelFirst[numLevels] == 0) return 0;
+    visibleInstances.resize(levelFirst[numLevels]);
+    {
+        std::vector<size_t> fill(levelFirst.begin(), levelFirst.end() - 1);
+        for (size_t i = 0; i < instances.size(); ++i)
+            if (instanceLevels[i] >= 0) visibleInstances[fill[instanceLevels[i]]++] = instances[i];
+    }
+
+    // upload, the driver replaces the storage of the last frame instead of waiting for it
+    f->glBindVertexArray(geometry->VAO.val);
+    if (geometry->VBOinstances.val == 0) f->glGenBuffers(1, &geometry->VBOinstances.val);
+    f->glBindBuffer(GL_ARRAY_BUFFER, geometry->VBOinstances.val);
+    f->glBufferData(GL_ARRAY_BUFFER, visibleInstances.size() * sizeof(Instance), visibleInstances.data(), GL_STREAM_DRAW);
+    for (GLuint column = 0; column < 4; ++column) {
+        f->glEnableVertexAttribArray(INSTANCE_MODEL_LOCATION + column);
+        f->glVertexAttribDivisor(INSTANCE_MODEL_LOCATION + column, 1);
+    }
+    f->glEnableVertexAttribArray(INSTANCE_COLOR_LOCATION);
+    f->glVertexAttribDivisor(INSTANCE_COLOR_LOCATION, 1);
+
+    // the instance colors replace the vertex colors, textures are still used
+    const bool useTexture = coloringType == ColoringType::TEXTURE && textureID.val != 0;
+    f->glUniform1ui(state.getUseTextureUniform(), useTexture);
+    if (useTexture) {
+        f->glActiveTexture(GL_TEXTURE0);
+        f->glBindTexture(GL_TEXTURE_2D, textureID.val);
+        f->glUniform1i(state.getTextureUniform(), 0);
+    }
+    if (geometry->quantizedVBOs) {
+        f->glUniform3fv(state.getPositionScaleUniform(), 1, reinterpret_cast<const GLfloat*>(&geometry->quantizationScale));
+        f->glUniform3fv(state.getPositionOffsetUniform(), 1, reinterpret_cast<const GLfloat*>(&geometry->quantizationOffset));
+    }
+
+    size_t numDrawn = 0;
+    for (unsigned int level = 0; level < numLevels; ++level) {
+        const GLsizei count = static_cast<GLsizei>(lodHistogram[level]);
+        if (count == 0) continue;
+        // glDrawElementsInstancedBaseInstance needs OpenGL 4.2, so the attributes point to the first instance instead
+        const size_t offset = levelFirst[level] * sizeof(Instance);
+        for (GLuint column = 0; column < 4; ++column)
+            f->glVertexAttribPointer(INSTANCE_MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                                     reinterpret_cast<const void*>(offset + offsetof(Instance, model) + 4 * column * sizeof(float)));
+        f->glVertexAttribPointer(INSTANCE_COLOR_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                                 reinterpret_cast<const void*>(offset + offsetof(Instance, color)));
+
+        const size_t numTriangles = level == 0 ? geometry->numGPUTriangles : geometry->levelsOfDetail[level - 1].numTriangles;
+        numDrawn += numTriangles * count;
+        if (!geometry->stripChunks.empty()) {
+            const size_t indexSize = geometry->stripIndexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+            f->glEnable(GL_PRIMITIVE_RESTART);
+            f->glPrimitiveRestartIndex(geometry->stripIndexType == GL_UNSIGNED_SHORT ? 0xFFFFu : 0xFFFFFFFFu);
+            for (const auto& chunk : geometry->stripChunks) {
+                f->glDrawElementsInstancedBaseVertex(GL_TRIANGLE_STRIP, static_cast<GLsizei>(chunk.numIndices), geometry->stripIndexType,
+                                                     reinterpret_cast<const void*>(chunk.firstIndex * indexSize), count, chunk.baseVertex);
+            }
+            f->glDisable(GL_PRIMITIVE_RESTART);
+            continue;
+        }
+        // the simplified levels follow the full mesh in VBOf, one draw call per material range for their textures
+        const size_t firstTriangle = level == 0 ? 0 : geometry->numGPUTriangles;
+        const std::vector<SubMesh>& ranges = level == 0 ? geometry->subMeshes : geometry->levelsOfDetail[level - 1].ranges;
+        if (ranges.empty()) {
+            f->glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(3 * numTriangles), GL_UNSIGNED_INT,
+                                       reinterpret_cast<const void*>(firstTriangle * sizeof(Triangle)), count);
+        }
+        for (const auto& range : ranges) {
+            if (useTexture) applyMaterial(state, range.material);
+            f->glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(3 * range.numTriangles), GL_UNSIGNED_INT,
+                                       reinterpret_cast<const void*>((firstTriangle + range.firstTriangle) * sizeof(Triangle)), count);
+        }
+    }
+
+    // the VAO is also drawn without instances
+    for (GLuint column = 0; column < 4; ++column) f->glDisableVertexAttribArray(INSTANCE_MODEL_LOCATION + column);
+    f->glDisableVertexAttribArray(INSTANCE_COLOR_LOCATION);
+    f->glBindBuffer(GL_ARRAY_BUFFER, 0);
+    f->glBindVertexArray(0);
+    if (geometry->quantizedVBOs) {
+        f->glUniform3f(state.getPositionScaleUniform(), 1.0f, 1.0f, 1.0f);
+        f->glUniform3f(state.getPositionOffsetUniform(), 0.0f, 0.0f, 0.0f);
+    }
+    return static_cast<unsigned int>(numDrawn);
+}
+
+void TriangleMesh::applyMaterial(RenderState& state, int material) {
+    auto* f = state.getOpenGLFunctions();
+    //Bug in Qt: They flagged glVertexAttrib3f as deprecated in modern OpenGL, which is not true.
+    //We have to load it manually. Make it static so we do it only once.
+    static auto glVertexAttrib3fv = reinterpret_cast<glVertexAttrib3fvPtr>(QOpenGLContext::currentContext()->getProcAddress("glVertexAttrib3fv"));
+
+    const Vec3f& color = material >= 0 ? geometry->materials[material].diffuse : staticColor;
+    glVertexAttrib3fv(COLOR_LOCATION, reinterpret_cast<const GLfloat*>(&color));
+    if (coloringType != ColoringType::TEXTURE) return;
+    // materials without texture fall back to the texture of the mesh, then to the color
+    const GLuint texture = material >= 0 && geometry->materialTextures[material] != 0 ? geometry->materialTextures[material] : textureID.val;
+    f->glUniform1ui(state.getUseTextureUniform(), texture != 0);
+    if (texture != 0) {
+        f->glActiveTexture(GL_TEXTURE0);
+        f->glBindTexture(GL_TEXTURE_2D, texture);
+        f->glUniform1i(state.getTextureUniform(), 0);
+    }
 }
 
 // ===========
@@ -543,14 +1419,14 @@ bool TriangleMesh::isInsideFrustum(std::vector<Plane> planes, QMatrix4x4 mvp)
 {
     // use bounding box min max to define 8 corners
     Vec3f corners[8] = {
-        Vec3f(boundingBoxMin.x(), boundingBoxMin.y(), boundingBoxMin.z()), // x y z
-        Vec3f(boundingBoxMax.x(), boundingBoxMin.y(), boundingBoxMin.z()), // X y z
-        Vec3f(boundingBoxMin.x(), boundingBoxMax.y(), boundingBoxMin.z()), // x Y z
-        Vec3f(boundingBoxMax.x(), boundingBoxMax.y(), boundingBoxMin.z()), // X Y z
-        Vec3f(boundingBoxMin.x(), boundingBoxMin.y(), boundingBoxMax.z()), // x y Z
-        Vec3f(boundingBoxMax.x(), boundingBoxMin.y(), boundingBoxMax.z()), // X y Z
-        Vec3f(boundingBoxMin.x(), boundingBoxMax.y(), boundingBoxMax.z()), // x Y Z
-        Vec3f(boundingBoxMax.x(), boundingBoxMax.y(), boundingBoxMax.z())  // X Y Z
+        Vec3f(geometry->boundingBoxMin.x(), geometry->boundingBoxMin.y(), geometry->boundingBoxMin.z()), // x y z
+        Vec3f(geometry->boundingBoxMax.x(), geometry->boundingBoxMin.y(), geometry->boundingBoxMin.z()), // X y z
+        Vec3f(geometry->boundingBoxMin.x(), geometry->boundingBoxMax.y(), geometry->boundingBoxMin.z()), // x Y z
+        Vec3f(geometry->boundingBoxMax.x(), geometry->boundingBoxMax.y(), geometry->boundingBoxMin.z()), // X Y z
+        Vec3f(geometry->boundingBoxMin.x(), geometry->boundingBoxMin.y(), geometry->boundingBoxMax.z()), // x y Z
+        Vec3f(geometry->boundingBoxMax.x(), geometry->boundingBoxMin.y(), geometry->boundingBoxMax.z()), // X y Z
+        Vec3f(geometry->boundingBoxMin.x(), geometry->boundingBoxMax.y(), geometry->boundingBoxMax.z()), // x Y Z
+        Vec3f(geometry->boundingBoxMax.x(), geometry->boundingBoxMax.y(), geometry->boundingBoxMax.z())  // X Y Z
     };
 
     for (auto& plane : planes)
@@ -632,11 +1508,11 @@ void TriangleMesh::setStaticColor(Vec3f color) {
 
 void TriangleMesh::drawBB(RenderState &state) {
     auto* f = state.getOpenGLFunctions();
-    f->glBindVertexArray(VAObb.val);
+    f->glBindVertexArray(geometry->VAObb.val);
     //Transform BB to correct position.
     state.pushModelViewMatrix();
-    state.getCurrentModelViewMatrix().translate(boundingBoxMid.x(), boundingBoxMid.y(), boundingBoxMid.z());
-    state.getCurrentModelViewMatrix().scale(boundingBoxSize.x(), boundingBoxSize.y(), boundingBoxSize.z());
+    state.getCurrentModelViewMatrix().translate(geometry->boundingBoxMid.x(), geometry->boundingBoxMid.y(), geometry->boundingBoxMid.z());
+    state.getCurrentModelViewMatrix().scale(geometry->boundingBoxSize.x(), geometry->boundingBoxSize.y(), geometry->boundingBoxSize.z());
     f->glUniformMatrix4fv(state.getModelViewUniform(), 1, GL_FALSE, state.getCurrentModelViewMatrix().data());
     //Set color to constant white.
     //Bug in Qt: They flagged glVertexAttrib3f as deprecated in modern OpenGL, which is not true.
@@ -650,7 +1526,7 @@ void TriangleMesh::drawBB(RenderState &state) {
 
 void TriangleMesh::drawNormals(RenderState &state) {
     auto* f = state.getOpenGLFunctions();
-    f->glBindVertexArray(VAOn.val);
+    f->glBindVertexArray(geometry->VAOn.val);
     f->glUniformMatrix4fv(state.getModelViewUniform(), 1, GL_FALSE, state.getCurrentModelViewMatrix().data());
 
     //Set color to constant white.
@@ -659,7 +1535,7 @@ void TriangleMesh::drawNormals(RenderState &state) {
     static auto glVertexAttrib3f = reinterpret_cast<glVertexAttrib3fPtr>(QOpenGLContext::currentContext()->getProcAddress("glVertexAttrib3f"));
     glVertexAttrib3f(2, 1.0f, 1.0f, 1.0f);
 
-    f->glDrawArrays(GL_LINES, 0, vertices.size() * 2);
+    f->glDrawArrays(GL_LINES, 0, geometry->vertices.size() * 2);
 }
 
 void TriangleMesh::generateSphere(QOpenGLFunctions_3_3_Core* f) {
@@ -668,6 +1544,10 @@ void TriangleMesh::generateSphere(QOpenGLFunctions_3_3_Core* f) {
     int latdiv  = 100; // minimum 2
 
     setGLFunctionPtr(f);
+    detachGeometry();
+    invalidateAdjacency();
+    invalidateBVH();
+    invalidateMeshlets();
 
     // Generate vertices.
     for (int latitude = 0; latitude <= latdiv; latitude++) {
@@ -686,10 +1566,10 @@ void TriangleMesh::generateSphere(QOpenGLFunctions_3_3_Core* f) {
 
             Vec3f pos(x, y, z);
 
-            vertices.push_back(pos);
-            normals.push_back(pos);
-            texCoords.push_back({ 2.0f - 2.0f * u, v });
-            tangents.push_back(cross(Vec3f(0, 1, 0), pos));
+            geometry->vertices.push_back(pos);
+            geometry->normals.push_back(pos);
+            geometry->texCoords.push_back({ 2.0f - 2.0f * u, v });
+            geometry->tangents.push_back(Tangent{ cross(Vec3f(0, 1, 0), pos), 1.0f });
         }
     }
 
@@ -701,16 +1581,25 @@ void TriangleMesh::generateSphere(QOpenGLFunctions_3_3_Core* f) {
             unsigned int bottomNext = bottomBase + (longitude + 1);
             unsigned int topCurrent = topBase + longitude;
             unsigned int topNext = topBase + (longitude + 1);
-            triangles.emplace_back(bottomCurrent, bottomNext, topNext);
-            triangles.emplace_back(topNext, topCurrent, bottomCurrent);
+            geometry->triangles.emplace_back(bottomCurrent, bottomNext, topNext);
+            geometry->triangles.emplace_back(topNext, topCurrent, bottomCurrent);
         }
     }
 
-    boundingBoxMid = Vec3f(0, 0, 0);
-    boundingBoxSize = Vec3f(2, 2, 2);
-    boundingBoxMin = Vec3f(-1, -1, -1);
-    boundingBoxMax = Vec3f(1, 1, 1);
-
+    geometry->boundingBoxMid = Vec3f(0, 0, 0);
+    geometry->boundingBoxSize = Vec3f(2, 2, 2);
+    geometry->boundingBoxMin = Vec3f(-1, -1, -1);
+    geometry->boundingBoxMax = Vec3f(1, 1, 1);
+
+    // the grid numbering of the vertices is kept for the triangle strips
+    geometry->gridRows = latdiv + 1;
+    geometry->gridColumns = longdiv + 1;
+    geometry->gridRisingDiagonal = true;
+    // the strips replace the triangle order, so it is only optimized if they are not used
+    if (!useTriangleStrips || !isGrid()) {
+        optimizeTriangleOrder();
+        if (useMeshlets) buildMeshlets();
+    }
     createAllVBOs();
 }
 
@@ -719,86 +1608,35 @@ void TriangleMesh::generateTerrain(int l, int w, std::vector<std::vector<double>
     // The terrain should be a grid of size l x w nodes.
 
     // generate heightmap using The Fault Algorithm
-    vertices.clear();
-    colors.clear();
-    triangles.clear();
-
-    // center vertices around the origin
-    for (int x = -l/2; x < l/2; x++) 
-    for (int z = -w/2; z < w/2; z++)
-    {
-	    double height = heightmap[x + l/2][z + w/2];
-
-    	// for each cell (x,z) add vertices (x, height, z)
-        vertices.emplace_back(x, height, z);
-
-	    calculateTerrainColor(height, displacementType);
-    }
+    detachGeometry();
+    geometry->colors.clear();
+    invalidateAdjacency();
+    invalidateBVH();
+    invalidateMeshlets();
 
-    // for each cell create two triangles: 
-    // triangle 1 has the cell, the cell to the right and the cell below
-    // triangle 2 has the cell to the right, the cell below and the cell below of the cell to the right
-    for (int x = 0; x < l - 1; x++) {
-        for (int z = 0; z < w - 1; z++) {
-            int cell = x * w + z;
-            int right = cell + 1;
-            int below = cell + w;
-            int belowRight = below + 1;
+    // vertices, triangles and bounding box of the grid
+    ::generateTerrainGrid(l, w, heightmap, *geometry);
 
-            triangles.emplace_back(cell, right, below);
-            triangles.emplace_back(right, below, belowRight);
-        }
-    }
+    // one color per vertex, in the order of the vertices
+    for (int x = -l/2; x < l/2; x++)
+    for (int z = -w/2; z < w/2; z++)
+	    calculateTerrainColor(heightmap[x + l/2][z + w/2], displacementType);
 
     calculateNormalsByArea();
-    calculateBB();
+    // the rows run along z. the triangle order only matters if strips are disabled, the vertices keep their grid numbering.
+    geometry->gridRows = w > 0 ? static_cast<unsigned int>(geometry->vertices.size() / w) : 0;
+    geometry->gridColumns = w;
+    geometry->gridRisingDiagonal = false;
+    if (!useTriangleStrips || !isGrid()) {
+        optimizeTriangleOrder();
+        if (useMeshlets) buildMeshlets();
+    }
     createAllVBOs();
 }
 
 std::vector<std::vector<double>> TriangleMesh::generateHeightmap(int l, int w, int iterations, int displacementType)
 {
-    std::vector<std::vector<double>> heightmap(l, std::vector<double>(w));
-
-    float d = std::sqrt(w * w + l * l);
-    double displacement = 0.1;
-    float waveSize = d / 10.0f;
-
-    for (int i = 0; i < iterations; i++)
-    {
-        float v = std::rand();
-        // convert v to radian
-        v = v * M_PI / 180.0f;
-        float a = std::sin(v);
-        float b = std::cos(v);
-        // rand() / RAND_MAX gives a random number between 0 and 1.
-        // therefore c will be a random number between -d/2 and d/2
-        float c = (static_cast<float>(rand()) / RAND_MAX) * d - d / 2.0f;
-
-        for (int x = 0; x < heightmap.size(); x++)
-        {
-            for (int z = 0; z < heightmap[0].size(); z++)
-            {
-                float dist = a * x + b * z - c;
-              
-                // cosine function
-            	if (displacementType == 0) {
-                    float cosValue = std::cos(dist / waveSize * M_PI);
-                    heightmap[x][z] += displacement / 2.0f * cosValue;
-                }
-                // sine function
-                else if (displacementType == 1) {
-                    float sinValue = std::sin(dist / waveSize * M_PI);
-                    heightmap[x][z] += displacement / 2.0f * sinValue;
-                }
-                // step function
-                else {
-                    heightmap[x][z] += dist > 0 ? displacement : -displacement;
-                }
-            }
-        }
-    }
-
-    return heightmap;
+    return ::generateHeightmap(l, w, iterations, displacementType);
 }
 
 void TriangleMesh::calculateTerrainColor(double height, int displacementType)
@@ -872,41 +1710,37 @@ void TriangleMesh::calculateTerrainColor(double height, int displacementType)
             color = white;
     }
 
-    colors.push_back(color);
+    geometry->colors.push_back(color);
 }
 
 void TriangleMesh::copyObject(const TriangleMesh& source, bool createVBOs) {
     clear();
 
-    // copy mesh data
-    vertices = source.vertices;
-    triangles = source.triangles;
-    normals = source.normals;
-    texCoords = source.texCoords;
-    tangents = source.tangents;
-
-    // copy bounding box data
-    boundingBoxMin = source.boundingBoxMin;
-    boundingBoxMax = source.boundingBoxMax;
-    boundingBoxMid = source.boundingBoxMid;
-    boundingBoxSize = source.boundingBoxSize;
+    // share mesh data, GPU buffers and bounding box
+    geometry = source.geometry;
 
     // copy OpenGL function pointer
     f = source.f;
 
-    // Create VBOs if requested
-    if (createVBOs) {
+    // Create VBOs if requested and no other copy did so yet
+    if (createVBOs && geometry->VAO() == 0) {
         createAllVBOs();
     }
 }
 
-void TriangleMesh::setAirplanePosition(const std::vector<std::vector<double>>& heightmap, int l, int w)
+Vec3f TriangleMesh::randomPositionAbove(float height)
 {
-    int randX = rand() % (l - 1) + 1;
-    int randZ = rand() % (w - 1) + 1;
-
-    // position = (x, y, z);
-	position.x() = randX - static_cast<float>(l) / 2;
-	position.z() = randZ - static_cast<float>(w) / 2;
-    position.y() = heightmap[randX][randZ] + 2.f;
+    const Vec3f& lower = geometry->boundingBoxMin;
+    const Vec3f& upper = geometry->boundingBoxMax;
+    Vec3f point;
+    point.x() = lower.x() + (upper.x() - lower.x()) * static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+    point.z() = lower.z() + (upper.z() - lower.z()) * static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+
+    const Vec3f origin(point.x(), upper.y() + 1.0f, point.z());
+    RayHit hit;
+    if (getBVH().intersect(origin, Vec3f(0.0f, -1.0f, 0.0f), FLT_MAX, hit))
+        point.y() = origin.y() - hit.t + height;
+    else
+        point.y() = upper.y() + height;
+    return point;
 }
@@ -8,10 +8,18 @@
 #include <QOpenGLContext>
 #include <QVector3D>
 
+#include <future>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "vec3.h"
 #include "utilities.h"
+#include "objparser.h"
+#include "meshoptimizer.h"
+#include "meshadjacency.h"
+#include "meshgeometry.h"
+#include "bvh.h"
 
 //Forward declaration, avoids being forced to include header
 class QOpenGLFunctions_3_3_Core;
@@ -28,20 +36,29 @@ public:
 
     Vec3f position;
 
+    // one copy of the mesh drawn by drawInstanced
+    struct Instance {
+        float model[16]; // model matrix, column-major like QMatrix4x4::constData
+        Vec3f color;     // replaces the vertex colors
+    };
+
 private:
     // typedefs for data
     typedef Vec3ui Triangle;
     typedef Vec3f Vertex;
     typedef Vec3f Normal;
     typedef Vec3f Color;
-    struct TexCoord { float u, v; };
+    typedef ObjTexCoord TexCoord;
     // clip planes ax+by+cz-d=0
     struct Plane {
         QVector3D n;  // normal (a,b,c)
         float d;      // distance
     };
 
-    typedef Vec3f Tangent;
+    typedef MeshTangent Tangent;
+    // range of triangles with one material, and the material itself
+    typedef ObjSubMesh SubMesh;
+    typedef ObjMaterial Material;
 
     typedef std::vector<Triangle> Triangles;
     typedef std::vector<Vertex> Vertices;
@@ -50,28 +67,86 @@ private:
     typedef std::vector<TexCoord> TexCoords;
     typedef std::vector<Tangent> Tangents;
 
+    // simplified version of the mesh with the same vertices. its ranges index lodTriangles, which follow the triangles
+    // of the full mesh in VBOf.
+    typedef MeshLevelOfDetail LevelOfDetail;
+
+    // geometry, GPU buffers and bounding box of a mesh. copyObject shares them between meshes instead of copying them,
+    // a mesh that changes shared data gets its own copy first, see detachGeometry. the last mesh that refers to the
+    // data deletes its GL objects. meshlets are not drawn if VBOf holds strips.
+    struct MeshData : MeshGeometry {
+        // VAO and VBO ids for vertices, normals, faces, colors, texCoords, tangents
+        autoMoved<GLuint> VAO{}, VBOv{}, VBOn{}, VBOf{}, VBOc{}, VBOt{}, VBOtan{};
+        // all vertex attributes in one VBO, replaces VBOv, VBOn, VBOc, VBOt and VBOtan in the interleaved layout
+        autoMoved<GLuint> VBOinterleaved{};
+        // VBO for bounding box
+        autoMoved<GLuint> VAObb{}, VBOvbb{}, VBOfbb{};
+        //VBO for normal lines
+        autoMoved<GLuint> VAOn{}, VBOvn{};
+        // per-instance attributes of drawInstanced, attached to VAO
+        autoMoved<GLuint> VBOinstances{};
+        // diffuse textures of the materials, 0 if a material has none
+        std::vector<GLuint> materialTextures;
+        // number of triangles in VBOf, also valid for streamed meshes that keep no CPU copy
+        size_t numGPUTriangles{0};
+        // the VBOs use the compact formats, positions are dequantized with offset + scale * position in the shader
+        bool quantizedVBOs{false};
+        Vec3f quantizationOffset;
+        Vec3f quantizationScale;
+        // generated grid meshes have gridRows x gridColumns vertices in row-major order, see buildGridStrips
+        unsigned int gridRows{0}, gridColumns{0};
+        bool gridRisingDiagonal{false};
+        // chunks of the strip index buffer in VBOf, empty if VBOf holds triangles
+        std::vector<StripChunk> stripChunks;
+        GLenum stripIndexType{GL_UNSIGNED_SHORT};
+        // connectivity of triangles, built on first use by getAdjacency and dropped whenever the connectivity changes
+        MeshAdjacency adjacency;
+        // ray queries against the triangles, built on first use by getBVH and dropped whenever positions or triangles change
+        TriangleBVH bvh;
+
+        // functions the GL objects were created with, used to delete them
+        QOpenGLFunctions_3_3_Core* f{nullptr};
+
+        MeshData() = default;
+        // copies the CPU data, but none of the GL objects and neither adjacency nor BVH
+        MeshData(const MeshData& other);
+        MeshData& operator= (const MeshData& other) = delete;
+        ~MeshData();
+
+        // delete the GL objects and the data that only describes them
+        void deleteGLObjects(QOpenGLFunctions_3_3_Core* f);
+    };
+    // never null, except in a mesh that was moved from
+    std::shared_ptr<MeshData> geometry;
 
-    // data of TriangleMesh
-    Vertices vertices;    // vertex positions
-    Normals normals;      // normals per vertex
-    Triangles triangles;  // indices of vertices that form a triangle
-    Colors colors;        // r,g,b in [0,1]
-    TexCoords texCoords;  // u,v in [0,1]
-    Tangents tangents;    // tangent per vertex
     Vec3f staticColor;
     ColoringType coloringType{ColoringType::STATIC_COLOR};
 
-    // VAO and VBO ids for vertices, normals, faces, colors, texCoords, tangents
-    autoMoved<GLuint> VAO{}, VBOv{}, VBOn{}, VBOf{}, VBOc{}, VBOt{}, VBOtan{};
-    // VBO for bounding box
-    autoMoved<GLuint> VAObb{}, VBOvbb{}, VBOfbb{};
-    //VBO for normal lines
-    autoMoved<GLuint> VAOn{}, VBOvn{};
     // texture
     autoMoved<GLuint> textureID{};
     autoMoved<GLuint> normalMapID{};
     autoMoved<GLuint> displacementMapID{};
 
+    // upload compact vertex formats: 16 bit positions relative to the bounding box, 10 bit normals and tangents,
+    // half float texCoords and RGBA8 colors
+    bool quantizeVertices{false};
+    // store the attributes of a vertex next to each other in VBOinterleaved instead of one VBO per attribute
+    bool interleaveVertices{false};
+    // draw grid meshes as triangle strips with primitive restart instead of triangles
+    bool useTriangleStrips{true};
+    // cull clusters of the full mesh against the view frustum and by their normal cones before drawing
+    bool useMeshlets{false};
+    // index ranges of the visible meshlets, reused every frame
+    std::vector<GLsizei> meshletCounts;
+    std::vector<const void*> meshletOffsets;
+    // level of detail of every instance (-1 if culled) and the visible instances sorted by level, reused every frame
+    std::vector<int> instanceLevels;
+    std::vector<Instance> visibleInstances;
+    // number of levels loadOBJ builds, 0 disables levels of detail
+    unsigned int numLODLevels{0};
+    // level drawVBO draws, 0 is the full mesh
+    unsigned int currentLOD{0};
+
     // draw mode data
     bool withBB{false};
     bool withNormals{false};
@@ -81,11 +156,16 @@ private:
     bool enableNormalMapping = false;
     bool enableDisplacementMapping = false;
 
-    // bounding box data
-    Vec3f boundingBoxMin;
-    Vec3f boundingBoxMax;
-    Vec3f boundingBoxMid;
-    Vec3f boundingBoxSize;
+    // throughput of the last loadOBJ call
+    ObjParseStats loadStats;
+    // read and write .meshbin caches next to loaded OBJ files
+    bool useMeshCache{true};
+    // ACMR factor optimizeTriangleOrder may give up for less overdraw, values below 1 disable the overdraw pass
+    float overdrawThreshold{OVERDRAW_THRESHOLD};
+    // mesh that loadOBJAsync is building on a worker thread
+    std::future<std::unique_ptr<TriangleMesh>> pendingLoad;
+    // file of a loadOBJAsync call while another load was running, started when that one is done
+    std::string queuedLoad;
 
     mutable QOpenGLFunctions_3_3_Core* f;
 
@@ -107,28 +187,55 @@ public:
     void coutData();
 
     // get raw data references
-    std::vector<Vec3f>& getVertices() { return vertices; }
-    std::vector<Vec3ui>& getTriangles() { return triangles; }
-    std::vector<Vec3f>& getNormals() { return normals; }
-    std::vector<Vec3f>& getColors() { return colors; }
-    std::vector<TexCoord>& getTexCoords() { return texCoords; }
+    std::vector<Vec3f>& getVertices() { return geometry->vertices; }
+    std::vector<Vec3ui>& getTriangles() { return geometry->triangles; }
+    std::vector<Vec3f>& getNormals() { return geometry->normals; }
+    std::vector<Vec3f>& getColors() { return geometry->colors; }
+    std::vector<TexCoord>& getTexCoords() { return geometry->texCoords; }
 
     // get size of all elements
-    unsigned int getNumVertices() { return vertices.size(); }
-    unsigned int getNumNormals() { return normals.size(); }
-    unsigned int getNumTriangles() { return triangles.size(); }
-    unsigned int getNumColors() { return colors.size(); }
-    unsigned int getNumTexCoords() { return texCoords.size(); }
+    unsigned int getNumVertices() { return geometry->vertices.size(); }
+    unsigned int getNumNormals() { return geometry->normals.size(); }
+    unsigned int getNumTriangles() { return geometry->triangles.size(); }
+    unsigned int getNumColors() { return geometry->colors.size(); }
+    unsigned int getNumTexCoords() { return geometry->texCoords.size(); }
+
+    // get statistics of the last loadOBJ call
+    const ObjParseStats& getLoadStats() const { return loadStats; }
 
     // get boundingBox data
-    Vec3f getBoundingBoxMin() { return boundingBoxMin; }
-    Vec3f getBoundingBoxMax() { return boundingBoxMax; }
-    Vec3f getBoundingBoxMid() { return boundingBoxMid; }
-    Vec3f getBoundingBoxSize() { return boundingBoxSize; }
+    Vec3f getBoundingBoxMin() { return geometry->boundingBoxMin; }
+    Vec3f getBoundingBoxMax() { return geometry->boundingBoxMax; }
+    Vec3f getBoundingBoxMid() { return geometry->boundingBoxMid; }
+    Vec3f getBoundingBoxSize() { return geometry->boundingBoxSize; }
 
     // flip all normals
     void flipNormals(bool createVBOs = true);
 
+    // result of weldVertices
+    typedef MeshWeldStats WeldStats;
+
+    // merges vertices whose positions are at most epsilon apart, using a spatial hash grid. vertices with different
+    // texture coordinates or colors are kept apart so that seams survive, normals and tangents of merged vertices are
+    // averaged. triangles that collapse are removed. loadOBJ merges the exact duplicates of files without normals.
+    WeldStats weldVertices(float epsilon, bool createVBOs = true);
+
+    // reorders the triangles of every material range for the post-transform vertex cache, then sorts clusters of them
+    // against overdraw, and prints ACMR/ATVR before and after. called after loading and generating meshes.
+    void optimizeTriangleOrder();
+
+    // renumbers the vertices in the order the triangles use them and permutes all vertex attributes accordingly.
+    // call it after the triangle order is final and before createAllVBOs.
+    void optimizeVertexOrder();
+
+    // groups the triangles of every material range into meshlets with bounds for culling and reorders the triangles so
+    // that every meshlet is one range. call it after optimizeTriangleOrder and before optimizeVertexOrder.
+    void buildMeshlets();
+
+    // builds numLevels simplified versions of the mesh, each with at most half the triangles of the one before. stops
+    // early if the simplification gets stuck. call it after the vertex order is final and before createAllVBOs.
+    void buildLevelsOfDetail(unsigned int numLevels);
+
     //set texture ID
     void setTexture(GLuint texID) { textureID.val = texID; };
     void setNormalTexture(GLuint texID) { normalMapID.val = texID; };
@@ -143,6 +250,28 @@ public:
     void toggleDiffuse(bool enable) { enableDiffuseTexture = enable; }
     void toggleNormalMapping(bool enable) { enableNormalMapping = enable; }
     void toggleDisplacementMapping(bool enable) { enableDisplacementMapping = enable; }
+    //enable or disable the binary mesh cache of loadOBJ
+    void toggleMeshCache(bool enable) { useMeshCache = enable; }
+    //set the ACMR factor the overdraw optimization may give up, takes effect the next time a mesh is loaded or generated
+    void setOverdrawThreshold(float threshold) { overdrawThreshold = threshold; }
+    //enable or disable the compact vertex formats, takes effect the next time the VBOs are created
+    void toggleQuantizedVertices(bool enable) { quantizeVertices = enable; }
+    //enable or disable the interleaved vertex layout, takes effect the next time the VBOs are created
+    void toggleInterleavedVertices(bool enable) { interleaveVertices = enable; }
+    //enable or disable triangle strips for grid meshes, takes effect the next time the VBOs are created. generated grids
+    //only get an optimized triangle order if strips are disabled when they are generated
+    void toggleTriangleStrips(bool enable) { useTriangleStrips = enable; }
+    //enable or disable meshlet culling, takes effect the next time a mesh is loaded or generated
+    void toggleMeshlets(bool enable) { useMeshlets = enable; }
+    //set the number of simplified levels loadOBJ builds, 0 disables levels of detail
+    void setLevelsOfDetail(unsigned int levels) { numLODLevels = levels; }
+    unsigned int getNumLevelsOfDetail() const { return 1 + geometry->levelsOfDetail.size(); }
+    //vertex -> triangle and vertex -> vertex lists of the current triangles, and the half-edges if requested
+    const MeshAdjacency& getAdjacency(bool withHalfEdges = false);
+    //hierarchy for ray queries in object space, hit triangles are indices into the current triangles
+    const TriangleBVH& getBVH();
+    //delete and create the VBOs, e.g. to apply a new vertex layout
+    void recreateVBOs();
 
     // scales vertices so that the largest bounding box size has length newLength
     void scaleToLength(float newLength, bool createVBOs = true);
@@ -152,31 +281,74 @@ public:
     // =================
 
     // read from an OBJ file. also calculates normals if not given in the file.
+    // the processed mesh is cached in filename.meshbin and reused as long as the OBJ file does not change.
+    // the CPU side is loadOBJGeometry with the load settings of this mesh.
     void loadOBJ(const char* filename, bool createVBOs = true);
 
     // read from an OBJ file. also calculates normals if not given in the file.
     // translates and scales vertices with bounding box center at BBmid and largest side BBlength
     void loadOBJ(const char* filename, const Vec3f& BBmid, float BBlength);
 
+    // read from an OBJ file that may be larger than main memory. the file is read twice in blocks: the first pass
+    // counts the entries and sizes the VBOs, the second pass uploads the parsed blocks through a staging ring.
+    // CPU memory stays in the order of ringBytes, no data is kept on the CPU. texture coordinates and normals of the file
+    // are used if every corner indexes them like its position, otherwise the file is loaded with loadOBJ instead.
+    // missing normals are calculated on the GPU, missing texture coordinates by sphere mapping. meant for scans larger
+    // than main memory, the models of the view fit into memory and are loaded with loadOBJAsync instead.
+    void loadOBJStreaming(const char* filename, size_t ringBytes = OBJ_STREAM_RING_BYTES);
+
+    // like loadOBJ, but parsing, normal and texture coordinate calculation run on a worker thread. the mesh stays
+    // empty until finishAsyncLoad is called on the GL thread after the worker is done. if a load is still running, the
+    // file is loaded after it and the result of the running load is dropped, the call never waits for the worker.
+    void loadOBJAsync(const char* filename);
+    // takes over the result of loadOBJAsync if it is ready. returns true if the mesh changed.
+    bool finishAsyncLoad(bool createVBOs = true);
+    bool isLoading() const { return pendingLoad.valid(); }
+
     void generateSphere(QOpenGLFunctions_3_3_Core* f);
 
     void generateTerrain(int l, int w, std::vector<std::vector<double>>& heightmap, int displacementType);
     std::vector<std::vector<double>> generateHeightmap(int l, int w, int iterations, int displacementType);
     void calculateTerrainColor(double height, int displacementType);
+    // shares the mesh data and GPU buffers of source instead of copying them. the VBOs are only created if source
+    // has none yet, so that any number of copies costs as much memory and upload time as one. all copies draw with
+    // the vertex formats and meshlets of the mesh that created the VBOs.
     void copyObject(const TriangleMesh& source, bool createVBOs);
 
-    void setAirplanePosition(const std::vector<std::vector<double>>& heightmap, int l, int w);
+    // random position height units above the surface, e.g. of an airplane above the terrain. the surface is found by a
+    // ray cast straight down, positions above holes are height units above the bounding box.
+    Vec3f randomPositionAbove(float height);
 
 private:
+    // gives this mesh its own copy of the mesh data if other meshes share it, call it before changing the data.
+    // the copy has no GL objects yet.
+    void detachGeometry();
+
+    // starts loadOBJ of name on a worker thread with the load settings of this mesh
+    void startAsyncLoad(const std::string& name);
+
+    // moves the mesh data and bounding box of source into this mesh, keeps the draw settings
+    void adoptGeometry(TriangleMesh&& source);
+
     // calculate normals, weighted by area
     void calculateNormalsByArea();
 
-    // calculate texture coordinates by central projection
-    void calculateTexCoordsSphereMapping();
+    // call whenever triangles or the number of vertices change
+    void invalidateAdjacency() { geometry->adjacency.clear(); }
+    // call whenever positions or triangles change
+    void invalidateBVH() { geometry->bvh.clear(); }
+    // call whenever the triangle order changes
+    void invalidateMeshlets() { geometry->meshlets.clear(); geometry->meshletMaterials.clear(); }
+
+    // calculate normals, weighted by area, from VBOv and VBOf into VBOn without reading the mesh back to the CPU
+    bool calculateNormalsByAreaOnGPU(size_t numVertices);
 
     // calculates axis aligned bounding box data
     void calculateBB();
 
+    // the vertices and triangles still form the grid of gridRows x gridColumns vertices
+    bool isGrid() const;
+
     // create VBOs for vertices, faces, normals, colors, textureCoords
     void createAllVBOs();
     // create VBOs for normals
@@ -186,6 +358,28 @@ private:
     // create VBO
     GLuint createVBO(QOpenGLFunctions_3_3_Core* f, const void* data, int dataSize, GLenum target, GLenum usage);
 
+    // how the components of one vertex attribute are stored
+    struct AttributeFormat {
+        GLint size;
+        GLenum type;
+        GLboolean normalized;
+    };
+    // one vertex attribute as it is uploaded, count elements of elementSize bytes
+    struct VertexStream {
+        GLuint location;
+        const void* data;
+        size_t count;
+        size_t elementSize;
+        AttributeFormat format;
+        autoMoved<GLuint>* vbo; // VBO of the attribute in the separate layout
+    };
+    // create the VBO of a vertex attribute and attach it to the bound VAO
+    GLuint createAttributeVBO(GLuint location, const void* data, size_t dataSize, const AttributeFormat& format);
+    // create VBOinterleaved from all streams and attach them to the bound VAO
+    void createInterleavedVBO(const std::vector<VertexStream>& streams);
+    // the bound VAO has a color per vertex
+    bool hasColorArray() const { return geometry->VBOc.val != 0 || (geometry->VBOinterleaved.val != 0 && geometry->colors.size() == geometry->vertices.size()); }
+
     // clean up VBO data (delete from gpu memory)
     void cleanupVBO();
     void cleanupVBO(QOpenGLFunctions_3_3_Core* f);
@@ -202,12 +396,30 @@ public:
     // draw mesh with current drawing mode settings. returns the number of triangles drawn.
     unsigned int drawAndCountTriangles(RenderState& state);
 
+    // chooses the coarsest level of detail whose error projects to at most maxPixelError pixels with the current
+    // matrices, viewportHeight is in pixels. the level is drawn until the next call. returns the level, 0 is the full mesh.
+    unsigned int selectLevelOfDetail(const RenderState& state, float viewportHeight, float maxPixelError = LOD_PIXEL_ERROR);
+
     bool isBoundingBoxVisible(const RenderState& state);
 
+    // draws all instances inside the view frustum with one glDrawElementsInstanced call per level of detail and
+    // material. instances are culled by their bounding spheres, and each gets the level selectLevelOfDetail would
+    // choose. the current model view matrix is the view matrix of the Camera uniform block, the program must read
+    // the instance attributes like Shader/instanced.vert. lodHistogram receives the number of drawn instances per
+    // level. returns the number of triangles drawn.
+    unsigned int drawInstanced(RenderState& state, const std::vector<Instance>& instances, float viewportHeight,
+                               std::vector<unsigned int>& lodHistogram, float maxPixelError = LOD_PIXEL_ERROR);
+
 private:
 
-    // draw VBO
-    void drawVBO(RenderState& state);
+    // draw VBO, returns the number of triangles drawn
+    size_t drawVBO(RenderState& state);
+
+    // draw the meshlets that are inside the view frustum and not backfacing, returns the number of triangles drawn
+    size_t drawMeshlets(RenderState& state);
+
+    // set color and texture of a material for the following draw call, -1 restores the mesh's own ones
+    void applyMaterial(RenderState& state, int material);
 
     // draw the bounding box (wired, immediate mode) (withBB)
     void drawBB(RenderState& state);